@@ -0,0 +1,118 @@
+#include "ltime.h"
+#include <limits.h>
+#include <math.h>
+
+/*
+ *  Alignment of timestamp series
+ *
+ *  Both operations merge sorted packed arrays in a single linear pass,
+ *  comparing raw ticks instead of calling the Time metamethods.
+ */
+
+/*
+ *  indices = Ltime.asof(ref, src[, tolerance])
+ *  For each reference time, the index of the last source time at or before it,
+ *  0 when there is none or when it is more than tolerance (an Epoch) earlier
+ *  ref and src are sorted Ticks objects or tables accepted by Ltime.Ticks
+ */
+int align_asof(lua_State *L) {
+
+	long long tolerance = -1;
+	if (!lua_isnoneornil(L, 3)) {
+		tolerance = parameterToTicks(L, 3);
+		luaL_argcheck(L, tolerance >= 0, 3, LTIME_ERR_ASOF_TOLERANCE);
+	}
+	// tables are converted to Ticks objects pushed above the arguments
+	lua_settop(L, 2);
+	t_ticks *ref = toTicks(L, 1);
+	t_ticks *src = toTicks(L, 2);
+	lua_createtable(L, ref->n, 0);
+	size_t j = 0;
+	for (size_t i = 0; i < ref->n; i++) {
+		long long t = ticksAt(ref, i);
+		while (j < src->n && ticksAt(src, j) <= t)
+			j++;
+		lua_Integer match = j;
+		if (j > 0 && tolerance >= 0 && t - ticksAt(src, j - 1) > tolerance)
+			match = 0;
+		lua_pushinteger(L, match);
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
+enum { RESAMPLE_FFILL, RESAMPLE_NEAREST, RESAMPLE_COUNT, RESAMPLE_SUM, RESAMPLE_MEAN, RESAMPLE_MIN, RESAMPLE_MAX };
+
+/*
+ *  grid, result = Ltime.resample(ticks, step, mode[, values])
+ *  grid is a Ticks of the multiples of step from the first to the last time
+ *  mode "ffill": index of the last time at or before each grid time
+ *  mode "nearest": index of the closest time, the earlier one on ties
+ *  mode "count": number of times in each window [grid time, grid time + step)
+ *  modes "sum", "mean", "min", "max": aggregate of the values (a table of
+ *  numbers, one per time) in each window, NaN for the empty windows except sum
+ */
+int align_resample(lua_State *L) {
+
+	static const char *const modes[] = { "ffill", "nearest", "count", "sum", "mean", "min", "max", NULL };
+	long long step = parameterToTicks(L, 2);
+	luaL_argcheck(L, step > 0, 2, LTIME_ERR_RESAMPLE_STEP);
+	int mode = luaL_checkoption(L, 3, NULL, modes);
+	int values = 0;
+	if (mode >= RESAMPLE_SUM) {
+		luaL_checktype(L, 4, LUA_TTABLE);
+		values = 4;
+	}
+	lua_settop(L, 4);
+	t_ticks *self = toTicks(L, 1);
+	if (values)
+		luaL_argcheck(L, lua_rawlen(L, values) == self->n, 4, LTIME_ERR_RESAMPLE_VALUES);
+	size_t n = 0;
+	long long origin = 0;
+	if (self->n > 0) {
+		long long first = ticksAt(self, 0), last = ticksAt(self, self->n - 1);
+		origin = first - first % step;
+		luaL_argcheck(L, last >= first && (last - origin) / step < INT_MAX, 2, LTIME_ERR_RESAMPLE_STEP);
+		n = (last - origin) / step + 1;
+	}
+	t_ticks *grid = newTicks(L, n);
+	lua_createtable(L, n, 0);
+	size_t j = 0;
+	for (size_t k = 0; k < n; k++) {
+		long long g = origin + k * step;
+		grid->t[k] = g;
+		if (mode == RESAMPLE_FFILL || mode == RESAMPLE_NEAREST) {
+			while (j < self->n && ticksAt(self, j) <= g)
+				j++;
+			lua_Integer match = j;
+			// j is the first time after g, compare with the last one at or before
+			if (mode == RESAMPLE_NEAREST && j < self->n && (j == 0 || ticksAt(self, j) - g < g - ticksAt(self, j - 1)))
+				match = j + 1;
+			lua_pushinteger(L, match);
+		} else {
+			long long end = g + step;
+			lua_Integer count = 0;
+			lua_Number sum = 0, min = HUGE_VAL, max = -HUGE_VAL;
+			for (; j < self->n && ticksAt(self, j) < end; j++) {
+				count++;
+				if (values) {
+					lua_rawgeti(L, values, j + 1);
+					lua_Number v = lua_tonumber(L, -1);
+					lua_pop(L, 1);
+					sum += v;
+					min = v < min ? v : min;
+					max = v > max ? v : max;
+				}
+			}
+			switch (mode) {
+				case RESAMPLE_COUNT:	lua_pushinteger(L, count); break;
+				case RESAMPLE_SUM:		lua_pushnumber(L, sum); break;
+				case RESAMPLE_MEAN:		lua_pushnumber(L, count ? sum / count : NAN); break;
+				case RESAMPLE_MIN:		lua_pushnumber(L, count ? min : NAN); break;
+				default:				lua_pushnumber(L, count ? max : NAN); break;
+			}
+		}
+		lua_rawseti(L, -2, k + 1);
+	}
+	return 2;
+}
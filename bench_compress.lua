@@ -0,0 +1,37 @@
+-- Compression ratio and speed of Ltime.compress on regular and jittered series
+print "LTime compression benchmark for Lua 5.3"
+
+package.cpath = "./?.so;" .. package.cpath
+local ltime = require"ltime"
+
+local N = 1000000
+local ROUNDS = 5
+local origin = ltime.Time"2014-01-28":vms()
+
+-- N values one second apart, each moved by up to jitter ticks
+local function series(jitter)
+	local ticks = ltime.Ticks(N)
+	for i = 1, N do
+		ticks[i] = origin + i * 10000000 + (jitter > 0 and math.random(0, jitter) or 0)
+	end
+	return ticks
+end
+
+-- Millions of values per second of ROUNDS calls to f
+local function speed(f)
+	local start = os.clock()
+	for _ = 1, ROUNDS do f() end
+	return N * ROUNDS / (os.clock() - start) / 1e6
+end
+
+math.randomseed(1)
+print(string.format("%d values, %d rounds", N, ROUNDS))
+print(string.format("%-18s %8s %14s %14s", "series", "ratio", "encode M/s", "decode M/s"))
+for _, case in ipairs{ {"regular 1 s", 0}, {"50 us jitter", 500}, {"5 ms jitter", 50000} } do
+	local ticks = series(case[2])
+	local blob = ltime.compress(ticks)
+	assert(ltime.decompress(blob)[N] == ticks[N])
+	local encode = speed(function() return ltime.compress(ticks) end)
+	local decode = speed(function() return ltime.decompress(blob) end)
+	print(string.format("%-18s %7.1fx %14.1f %14.1f", case[1], N * 8 / #blob, encode, decode))
+end
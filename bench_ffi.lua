@@ -0,0 +1,36 @@
+-- Time and Epoch arithmetic, comparisons and formatting: FFI binding under
+-- LuaJIT, C module under Lua 5.3 (run the same script with both)
+package.cpath = "./?.so;" .. package.cpath
+package.path = "./?.lua;" .. package.path
+local ltime = require(jit and "ltime_ffi" or "ltime")
+print("LTime benchmark, " .. (jit and jit.version .. " FFI binding" or _VERSION .. " C module"))
+
+-- Shortcuts
+local T, E = ltime.Time, ltime.Epoch
+
+-- Millions of iterations per second of f(n)
+local function bench(name, n, f)
+	local start = os.clock()
+	local result = f(n)
+	print(string.format("%-26s %10.1f M/s", name, n / (os.clock() - start) / 1e6), result)
+end
+
+local origin, step, limit = T"2014-01-28", E(1.5), T"2014-01-29"
+
+bench("add and two compares", 10000000, function(n)
+	local t, hits = origin, 0
+	for _ = 1, n do
+		t = t + step
+		if t > limit then t = origin end
+		if t == origin then hits = hits + 1 end
+	end
+	return hits
+end)
+
+bench("format %F %T", 1000000, function(n)
+	local length = 0
+	for i = 1, n do
+		length = length + #(origin + E(i)):format"%F %T"
+	end
+	return length
+end)
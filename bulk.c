@@ -0,0 +1,409 @@
+#include "ltime.h"
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+ *  Bulk conversions over large batches of timestamps
+ *
+ *  The Lua stack is only touched from the calling thread: inputs are
+ *  gathered into plain C arrays first, the pure C conversions (parseVMS,
+ *  formatVMS) then run on a pool of worker threads, and the results are
+ *  pushed back to Lua in order once all workers have joined.
+ */
+
+typedef struct s_job {
+	void	(*func)(void *, size_t, size_t);
+	void	*context;
+	size_t	from;
+	size_t	to;
+} t_job;
+
+static void *parallel_worker(void *arg) {
+
+	t_job *job = (t_job *)arg;
+	job->func(job->context, job->from, job->to);
+	return NULL;
+}
+
+/*
+ *  Run func(context, from, to) over [0, n), split into contiguous chunks
+ *  The calling thread processes the first chunk, func must not call the Lua API
+ */
+void parallelFor(size_t n, int threads, void (*func)(void *, size_t, size_t), void *context) {
+
+	if ((size_t)threads > n / LTIME_PARALLEL_MIN_CHUNK)
+		threads = n / LTIME_PARALLEL_MIN_CHUNK;
+	if (threads < 1)
+		threads = 1;
+	t_job jobs[threads];
+	pthread_t ids[threads];
+	int started[threads];
+	size_t chunk = n / threads, rest = n % threads, from = 0;
+	for (int i = 0; i < threads; i++) {
+		jobs[i].func = func;
+		jobs[i].context = context;
+		jobs[i].from = from;
+		from += chunk + ((size_t)i < rest ? 1 : 0);
+		jobs[i].to = from;
+	}
+	for (int i = 1; i < threads; i++) {
+		started[i] = pthread_create(&ids[i], NULL, parallel_worker, &jobs[i]) == 0;
+		if (!started[i])	// out of threads: do it ourselves
+			parallel_worker(&jobs[i]);
+	}
+	parallel_worker(&jobs[0]);
+	for (int i = 1; i < threads; i++)
+		if (started[i])
+			pthread_join(ids[i], NULL);
+}
+
+/*
+ *  Number of threads from the options table at index: {threads=n}
+ *  Absent means 1, 0 means one per online CPU
+ */
+int threadsOption(lua_State *L, int index) {
+
+	if (lua_type(L, index) != LUA_TTABLE)
+		return 1;
+	lua_getfield(L, index, "threads");
+	lua_Integer threads = luaL_optinteger(L, -1, 1);
+	lua_pop(L, 1);
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1)
+		threads = 1;
+	if (threads > LTIME_MAX_THREADS)
+		threads = LTIME_MAX_THREADS;
+	return threads;
+}
+
+typedef struct s_parse_job {
+	const char		**strings;
+	size_t			*lengths;
+	long long		*result;
+	const t_format	*format;	/* NULL for the ISO 8601 parser */
+} t_parse_job;
+
+static void parse_worker(void *context, size_t from, size_t to) {
+
+	t_parse_job *job = (t_parse_job *)context;
+	for (size_t i = from; i < to; i++) {
+		if (job->format)
+			job->result[i] = scanVMS(job->format, job->strings[i], job->lengths[i]);
+		else
+			job->result[i] = parseVMS(job->strings[i], job->lengths[i]);
+	}
+}
+
+/*
+ *  Ticks = Ltime.parse_many(table_or_buffer[, options])
+ *  table_or_buffer is either a table of ISO 8601 strings, or a single
+ *  string with one ISO 8601 timestamp per line
+ *  options: {threads=n}
+ */
+int bulk_parse_many(lua_State *L) {
+
+	int threads = threadsOption(L, 2);
+	size_t n = 0;
+	if (lua_type(L, 1) == LUA_TSTRING) {
+		size_t length;
+		const char *buffer = lua_tolstring(L, 1, &length);
+		const char *p = buffer, *end = buffer + length, *eol;
+		while (p < end) {
+			eol = memchr(p, '\n', end - p);
+			n++;
+			p = eol ? eol + 1 : end;
+		}
+		t_parse_job job;
+		job.format = NULL;
+		job.strings = (const char **)lua_newuserdata(L, n * (sizeof(const char *) + sizeof(size_t)));
+		job.lengths = (size_t *)(job.strings + n);
+		p = buffer;
+		for (size_t i = 0; i < n; i++) {
+			eol = memchr(p, '\n', end - p);
+			job.strings[i] = p;
+			job.lengths[i] = (eol ? eol : end) - p;
+			if (job.lengths[i] && p[job.lengths[i] - 1] == '\r')
+				job.lengths[i]--;
+			p = eol ? eol + 1 : end;
+		}
+		job.result = newTicks(L, n)->t;
+		parallelFor(n, threads, parse_worker, &job);
+		for (size_t i = 0; i < n; i++)
+			if (job.result[i] == -1)
+				luaL_error(L, LTIME_ERR_BULK_ELEMENT, (int)(i + 1));
+	} else {
+		luaL_checktype(L, 1, LUA_TTABLE);
+		n = lua_rawlen(L, 1);
+		t_parse_job job;
+		job.format = NULL;
+		job.strings = (const char **)lua_newuserdata(L, n * (sizeof(const char *) + sizeof(size_t)));
+		job.lengths = (size_t *)(job.strings + n);
+		for (size_t i = 0; i < n; i++) {
+			lua_rawgeti(L, 1, i + 1);
+			if (lua_type(L, -1) != LUA_TSTRING)
+				luaL_error(L, LTIME_ERR_BULK_ELEMENT, (int)(i + 1));
+			// the string stays referenced by the table
+			job.strings[i] = lua_tolstring(L, -1, &job.lengths[i]);
+			lua_pop(L, 1);
+		}
+		job.result = newTicks(L, n)->t;
+		parallelFor(n, threads, parse_worker, &job);
+		for (size_t i = 0; i < n; i++)
+			if (job.result[i] == -1)
+				luaL_error(L, LTIME_ERR_BULK_ELEMENT, (int)(i + 1));
+	}
+	return 1;
+}
+
+typedef struct s_format_job {
+	const t_format	*format;
+	const t_ticks	*ticks;
+	size_t			from;
+	char			*buffer;
+	int				*lengths;
+} t_format_job;
+
+static void format_worker(void *context, size_t from, size_t to) {
+
+	t_format_job *job = (t_format_job *)context;
+	size_t stride = job->format->max_length;
+	for (size_t i = from; i < to; i++)
+		job->lengths[i] = formatVMS(job->format, ticksAt(job->ticks, job->from + i), &job->buffer[i * stride]);
+}
+
+/*
+ *  table = Ltime.format_many(ticks, format[, options])
+ *  ticks is a Ticks object or a table of Time objects / raw ticks
+ *  format is a format string or a compiled Ltime.Format
+ *  options: {threads=n}
+ */
+int bulk_format_many(lua_State *L) {
+
+	int threads = threadsOption(L, 3);
+	t_ticks *ticks = toTicks(L, 1);
+	size_t length = formatArgumentLength(L, 2, LTIME_MT_FORMAT);
+	long long memory[formatMemorySize(length) / sizeof(long long) + 1];
+	t_format *format = formatArgument(L, 2, LTIME_MT_FORMAT, memory, datetime_spec);
+	size_t n = ticks->n;
+	size_t block = n < LTIME_BULK_BLOCK ? n : LTIME_BULK_BLOCK;
+
+	// render block by block to bound the scratch memory
+	t_format_job job;
+	job.format = format;
+	job.ticks = ticks;
+	job.lengths = (int *)lua_newuserdata(L, block * (sizeof(int) + format->max_length) + 1);
+	job.buffer = (char *)(job.lengths + block);
+	lua_createtable(L, n, 0);
+	for (size_t from = 0; from < n; from += block) {
+		size_t count = n - from < block ? n - from : block;
+		job.from = from;
+		parallelFor(count, threads, format_worker, &job);
+		for (size_t i = 0; i < count; i++) {
+			lua_pushlstring(L, &job.buffer[i * format->max_length], job.lengths[i]);
+			lua_rawseti(L, -2, from + i + 1);
+		}
+	}
+	return 1;
+}
+
+/*
+ *  string = Ltime.format_join(ticks, format[, sep])
+ *  Format all the values into a single string, separated by sep (default "")
+ *  ticks and format are as in format_many
+ */
+int bulk_format_join(lua_State *L) {
+
+	lua_settop(L, 3);	// a converted table goes above the arguments
+	t_ticks *ticks = toTicks(L, 1);
+	size_t length = formatArgumentLength(L, 2, LTIME_MT_FORMAT);
+	long long memory[formatMemorySize(length) / sizeof(long long) + 1];
+	t_format *format = formatArgument(L, 2, LTIME_MT_FORMAT, memory, datetime_spec);
+	size_t sep_length;
+	const char *sep = luaL_optlstring(L, 3, "", &sep_length);
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	for (size_t i = 0; i < ticks->n; i++) {
+		if (i)
+			luaL_addlstring(&b, sep, sep_length);
+		char *buffer = luaL_prepbuffsize(&b, format->max_length);
+		luaL_addsize(&b, formatVMS(format, ticksAt(ticks, i), buffer));
+	}
+	luaL_pushresult(&b);
+	return 1;
+}
+
+/*
+ *  file = Ltime.format_into(file, ticks, format[, sep])
+ *  Like format_join, but the output goes straight to an io library file
+ *  Return nil, message, errno when writing fails
+ */
+int bulk_format_into(lua_State *L) {
+
+	luaL_Stream *stream = (luaL_Stream *)luaL_checkudata(L, 1, LUA_FILEHANDLE);
+	if (!stream->closef)
+		luaL_error(L, LTIME_ERR_BULK_CLOSED_FILE);
+	lua_settop(L, 4);	// a converted table goes above the arguments
+	t_ticks *ticks = toTicks(L, 2);
+	size_t length = formatArgumentLength(L, 3, LTIME_MT_FORMAT);
+	long long memory[formatMemorySize(length) / sizeof(long long) + 1];
+	t_format *format = formatArgument(L, 3, LTIME_MT_FORMAT, memory, datetime_spec);
+	size_t sep_length;
+	const char *sep = luaL_optlstring(L, 4, "", &sep_length);
+
+	// render into a fixed chunk, flushed whenever the next value might not fit
+	size_t size = LUAL_BUFFERSIZE * 4, cursor = 0, need = format->max_length + sep_length;
+	if (size < need)
+		size = need;
+	char *chunk = (char *)lua_newuserdata(L, size);
+	for (size_t i = 0; i < ticks->n; i++) {
+		if (size - cursor < need) {
+			if (fwrite(chunk, 1, cursor, stream->f) != cursor)
+				return luaL_fileresult(L, 0, NULL);
+			cursor = 0;
+		}
+		if (i) {
+			memcpy(&chunk[cursor], sep, sep_length);
+			cursor += sep_length;
+		}
+		cursor += formatVMS(format, ticksAt(ticks, i), &chunk[cursor]);
+	}
+	if (fwrite(chunk, 1, cursor, stream->f) != cursor)
+		return luaL_fileresult(L, 0, NULL);
+	lua_pushvalue(L, 1);
+	return 1;
+}
+
+/*
+ *  Split the next line off [*p, end[, without its line terminator
+ */
+static void nextLine(const char **p, const char *end, const char **line, const char **stop) {
+
+	const char *eol = memchr(*p, '\n', end - *p);
+	*line = *p;
+	*stop = eol ? eol : end;
+	if (*stop > *line && (*stop)[-1] == '\r')
+		(*stop)--;
+	*p = eol ? eol + 1 : end;
+}
+
+/*
+ *  Locate field col (0 based) of the line [p, end[
+ *  Fields are split on sep, a field starting with a double quote runs up to
+ *  the closing quote (doubled quotes inside are kept as is)
+ *  Return 0 if the line has fewer fields
+ */
+static int findField(const char *p, const char *end, char sep, int col, const char **field, size_t *length) {
+
+	for (int i = 0; ; i++) {
+		const char *start = p;
+		if (p < end && *p == '"') {
+			p++;
+			while (p < end && !(*p == '"' && (p + 1 == end || p[1] != '"')))
+				p += *p == '"' ? 2 : 1;
+			if (i == col) {
+				*field = start + 1;
+				*length = p - start - 1;
+				return 1;
+			}
+			while (p < end && *p != sep) p++;
+		} else {
+			while (p < end && *p != sep) p++;
+			if (i == col) {
+				*field = start;
+				*length = p - start;
+				return 1;
+			}
+		}
+		if (p == end)
+			return 0;
+		p++;
+	}
+}
+
+/*
+ *  Ticks, errors, count = Ltime.parse_column(buffer[, options])
+ *  Parse one column of a CSV/TSV buffer, one row per line, empty lines skipped
+ *  options: {sep=",", col=1, header=false, format=nil, threads=1}
+ *  format is a format string or a compiled Ltime.Format, ISO 8601 when absent
+ *  Rows that cannot be parsed are set to 0 and flagged in errors, a bitmap
+ *  string where bit (i - 1) % 8 of byte (i - 1) // 8 is set for a bad row i;
+ *  count is the number of bad rows
+ */
+int bulk_parse_column(lua_State *L) {
+
+	size_t length;
+	const char *buffer = luaL_checklstring(L, 1, &length);
+	const char *sep = ",";
+	lua_Integer col = 1;
+	int header = 0;
+	int threads = threadsOption(L, 2);
+	if (lua_type(L, 2) == LUA_TTABLE) {
+		lua_getfield(L, 2, "sep");
+		sep = luaL_optstring(L, -1, ",");
+		lua_getfield(L, 2, "col");
+		col = luaL_optinteger(L, -1, 1);
+		lua_getfield(L, 2, "header");
+		header = lua_toboolean(L, -1);
+		lua_getfield(L, 2, "format");	// stays on the stack, the format string must remain referenced
+		if (col < 1 || col > INT_MAX || strlen(sep) != 1)
+			luaL_error(L, LTIME_ERR_BULK_COLUMN);
+	} else {
+		lua_pushnil(L);
+	}
+	int format_index = lua_gettop(L);
+	size_t format_length = lua_isnil(L, format_index) ? 0 : formatArgumentLength(L, format_index, LTIME_MT_FORMAT);
+	long long memory[formatMemorySize(format_length) / sizeof(long long) + 1];
+	t_parse_job job;
+	job.format = lua_isnil(L, format_index) ? NULL : formatArgument(L, format_index, LTIME_MT_FORMAT, memory, datetime_spec);
+
+	// count the rows, then locate the fields
+	const char *p = buffer, *end = buffer + length, *line, *stop;
+	size_t n = 0;
+	for (int skip = header; p < end; ) {
+		nextLine(&p, end, &line, &stop);
+		if (stop == line)
+			continue;
+		if (skip)
+			skip = 0;
+		else
+			n++;
+	}
+	job.strings = (const char **)lua_newuserdata(L, n * (sizeof(const char *) + sizeof(size_t)) + 1);
+	job.lengths = (size_t *)(job.strings + n);
+	p = buffer;
+	size_t i = 0;
+	for (int skip = header; p < end; ) {
+		nextLine(&p, end, &line, &stop);
+		if (stop == line)
+			continue;
+		if (skip) {
+			skip = 0;
+			continue;
+		}
+		if (!findField(line, stop, sep[0], col - 1, &job.strings[i], &job.lengths[i])) {
+			job.strings[i] = line;
+			job.lengths[i] = 0;	// never parses
+		}
+		i++;
+	}
+	job.result = newTicks(L, n)->t;
+	parallelFor(n, threads, parse_worker, &job);
+
+	// flag and clear the bad rows
+	unsigned char *errors = (unsigned char *)lua_newuserdata(L, (n + 7) / 8 + 1);
+	memset(errors, 0, (n + 7) / 8);
+	lua_Integer bad = 0;
+	for (i = 0; i < n; i++) {
+		if (job.result[i] == -1) {
+			job.result[i] = 0;
+			errors[i / 8] |= 1 << (i % 8);
+			bad++;
+		}
+	}
+	lua_pushlstring(L, (const char *)errors, (n + 7) / 8);
+	lua_remove(L, -2);
+	lua_pushinteger(L, bad);
+	return 3;
+}
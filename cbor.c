@@ -0,0 +1,296 @@
+#include "ltime.h"
+#include <limits.h>
+#include <math.h>
+
+/*
+ *  CBOR timestamps
+ *
+ *  tag 1:    epoch-based date/time, an integer number of unix seconds, or a
+ *            float64 when there is a fraction (precision is lost beyond the
+ *            microsecond for current dates)
+ *  tag 1001: extended time, a map {1: seconds[, -9: nanoseconds]}, exact
+ *  Decoding accepts integers and half/single/double floats for tag 1, and
+ *  the -3, -6 and -9 (milli, micro, nanoseconds) fraction keys for tag 1001.
+ */
+
+/* Longest encoded timestamp: tag 1001, map, 2 keys, int64 and uint32 */
+#define CBOR_MAX_LENGTH		20
+
+/*
+ *  Write a CBOR head: major type and argument, in the shortest form
+ *  Return the number of bytes written
+ */
+static int writeHead(unsigned char *p, int major, unsigned long long value) {
+
+	major <<= 5;
+	if (value < 24) {
+		p[0] = major | value;
+		return 1;
+	}
+	int n = value <= 0xff ? 1 : value <= 0xffff ? 2 : value <= 0xffffffffULL ? 4 : 8;
+	p[0] = major | (n == 1 ? 24 : n == 2 ? 25 : n == 4 ? 26 : 27);
+	writeBigEndian(&p[1], value, n);
+	return n + 1;
+}
+
+/*
+ *  Write an integer (major type 0 or 1)
+ */
+static int writeInteger(unsigned char *p, long long value) {
+
+	if (value >= 0)
+		return writeHead(p, 0, value);
+	return writeHead(p, 1, -1 - value);
+}
+
+/*
+ *  Read a CBOR head, return its length, 0 if truncated or indefinite
+ */
+static int readHead(const unsigned char *p, size_t length, int *major, unsigned long long *value) {
+
+	if (length < 1)
+		return 0;
+	*major = p[0] >> 5;
+	int info = p[0] & 0x1f;
+	if (info < 24) {
+		*value = info;
+		return 1;
+	}
+	if (info > 27)
+		return 0;
+	int n = 1 << (info - 24);
+	if (length < (size_t)n + 1)
+		return 0;
+	*value = readBigEndian(&p[1], n);
+	return n + 1;
+}
+
+/*
+ *  Read an integer (major type 0 or 1)
+ *  Return its length, 0 on error
+ */
+static int readInteger(const unsigned char *p, size_t length, long long *value) {
+
+	int major;
+	unsigned long long v;
+	int n = readHead(p, length, &major, &v);
+	if (!n || major > 1 || v > (unsigned long long)LLONG_MAX)
+		return 0;
+	*value = major ? -1 - (long long)v : (long long)v;
+	return n;
+}
+
+/*
+ *  IEEE 754 half precision to double
+ */
+static double halfToDouble(unsigned half) {
+
+	int exponent = (half >> 10) & 0x1f;
+	double mantissa = half & 0x3ff;
+	double value = exponent == 0 ? ldexp(mantissa, -24)
+		: exponent == 31 ? (mantissa ? NAN : INFINITY)
+		: ldexp(mantissa + 1024, exponent - 25);
+	return half & 0x8000 ? -value : value;
+}
+
+/*
+ *  Encode a VMS timestamp with tag 1 or 1001, out must hold CBOR_MAX_LENGTH bytes
+ *  Return the encoded length
+ */
+static int cborEncode(unsigned char *out, long long t, int tag) {
+
+	long long sec, nsec;
+	vmsToUnix(t, &sec, &nsec);
+	int n = writeHead(out, 6, tag);
+	if (tag == 1001) {
+		n += writeHead(&out[n], 5, nsec ? 2 : 1);
+		n += writeInteger(&out[n], 1);
+		n += writeInteger(&out[n], sec);
+		if (nsec) {
+			n += writeInteger(&out[n], -9);
+			n += writeInteger(&out[n], nsec);
+		}
+	} else if (nsec == 0) {
+		n += writeInteger(&out[n], sec);
+	} else {
+		union { double d; unsigned long long u; } value;
+		value.d = (double)(t - VMS_1970) / 1e7;
+		out[n++] = 0xfb;
+		writeBigEndian(&out[n], value.u, 8);
+		n += 8;
+	}
+	return n;
+}
+
+/*
+ *  Decode a tag 1 or tag 1001 timestamp at p
+ *  Return the encoded length, 0 if p does not hold a valid timestamp
+ */
+static int cborDecode(const unsigned char *p, size_t length, long long *t) {
+
+	int major;
+	unsigned long long tag, v;
+	int n = readHead(p, length, &major, &tag);
+	if (!n || major != 6 || (tag != 1 && tag != 1001))
+		return 0;
+	if (tag == 1001) {
+		unsigned long long pairs;
+		long long key, value, sec = 0, nsec = 0;
+		int size = readHead(&p[n], length - n, &major, &pairs);
+		if (!size || major != 5 || pairs < 1 || pairs > 2)
+			return 0;
+		n += size;
+		int has_sec = 0;
+		while (pairs--) {
+			if (!(size = readInteger(&p[n], length - n, &key)))
+				return 0;
+			n += size;
+			if (!(size = readInteger(&p[n], length - n, &value)))
+				return 0;
+			n += size;
+			if (key == 1) {
+				sec = value;
+				has_sec = 1;
+			} else if (key == -9 && value >= 0 && value < 1000000000LL) {
+				nsec = value;
+			} else if (key == -6 && value >= 0 && value < 1000000LL) {
+				nsec = value * 1000;
+			} else if (key == -3 && value >= 0 && value < 1000LL) {
+				nsec = value * 1000000;
+			} else {
+				return 0;
+			}
+		}
+		if (!has_sec)
+			return 0;
+		*t = unixToVMS(sec, nsec);
+		return *t < 0 ? 0 : n;
+	}
+	if (n >= (int)length)
+		return 0;
+	double seconds;
+	int size;
+	switch (p[n]) {
+		case 0xf9:
+		case 0xfa:
+		case 0xfb: {
+			size = p[n] == 0xf9 ? 2 : p[n] == 0xfa ? 4 : 8;
+			if (length - n < (size_t)size + 1)
+				return 0;
+			v = readBigEndian(&p[n + 1], size);
+			if (size == 2) {
+				seconds = halfToDouble(v);
+			} else if (size == 4) {
+				union { float f; unsigned u; } value;
+				value.u = v;
+				seconds = value.f;
+			} else {
+				union { double d; unsigned long long u; } value;
+				value.u = v;
+				seconds = value.d;
+			}
+			n += size + 1;
+			double sec = floor(seconds);
+			if (!(sec >= -VMS_1970 / 1e7 && sec <= 9e11))	// also rejects NaN
+				return 0;
+			long long ticks = (long long)floor((seconds - sec) * 1e7 + 0.5);
+			*t = VMS_1970 + (long long)sec * 10000000LL + ticks;
+			return *t < 0 ? 0 : n;
+		}
+		default: {
+			long long sec;
+			if (!(size = readInteger(&p[n], length - n, &sec)))
+				return 0;
+			*t = unixToVMS(sec, 0);
+			return *t < 0 ? 0 : n + size;
+		}
+	}
+}
+
+/*
+ *  Tag option at index: 1 (default) or 1001
+ */
+static int tagOption(lua_State *L, int index) {
+
+	lua_Integer tag = luaL_optinteger(L, index, 1);
+	if (tag != 1 && tag != 1001)
+		luaL_error(L, LTIME_ERR_CBOR_TAG);
+	return tag;
+}
+
+/*
+ *  string = Ltime.cbor_encode(t[, tag])
+ *  t is a Time, raw ticks or anything accepted by Ltime.Time
+ *  tag is 1 (default) or 1001
+ */
+int cbor_encode(lua_State *L) {
+
+	int tag = tagOption(L, 2);
+	unsigned char buffer[CBOR_MAX_LENGTH];
+	int length = cborEncode(buffer, elementToVMS(L, 1), tag);
+	lua_pushlstring(L, (const char *)buffer, length);
+	return 1;
+}
+
+/*
+ *  Time, next = Ltime.cbor_decode(string[, init])
+ *  Decode the timestamp at position init (default 1), next is the position
+ *  following it
+ */
+int cbor_decode(lua_State *L) {
+
+	size_t length;
+	const unsigned char *p = (const unsigned char *)luaL_checklstring(L, 1, &length);
+	lua_Integer init = luaL_optinteger(L, 2, 1);
+	long long t;
+	int n = 0;
+	if (init >= 1 && (size_t)init <= length)
+		n = cborDecode(p + init - 1, length - init + 1, &t);
+	if (!n)
+		luaL_error(L, LTIME_ERR_CBOR_FORMAT);
+	newDatetime(L)->t = t;
+	lua_pushinteger(L, init + n);
+	return 2;
+}
+
+/*
+ *  string = Ltime.cbor_encode_many(ticks[, tag])
+ *  ticks is a Ticks object or a table of Time objects / raw ticks
+ *  Return a CBOR sequence of the encoded timestamps
+ */
+int cbor_encode_many(lua_State *L) {
+
+	int tag = tagOption(L, 2);
+	lua_settop(L, 2);
+	t_ticks *ticks = toTicks(L, 1);
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	for (size_t i = 0; i < ticks->n; i++) {
+		unsigned char *buffer = (unsigned char *)luaL_prepbuffsize(&b, CBOR_MAX_LENGTH);
+		luaL_addsize(&b, cborEncode(buffer, ticksAt(ticks, i), tag));
+	}
+	luaL_pushresult(&b);
+	return 1;
+}
+
+/*
+ *  Ticks = Ltime.cbor_decode_many(string)
+ *  Decode a CBOR sequence of timestamps
+ */
+int cbor_decode_many(lua_State *L) {
+
+	size_t length;
+	const unsigned char *p = (const unsigned char *)luaL_checklstring(L, 1, &length);
+	size_t n = 0;
+	long long t;
+	for (size_t i = 0; i < length; n++) {
+		int size = cborDecode(p + i, length - i, &t);
+		if (!size)
+			luaL_error(L, LTIME_ERR_CBOR_FORMAT);
+		i += size;
+	}
+	t_ticks *ticks = newTicks(L, n);
+	for (size_t i = 0, k = 0; k < n; k++)
+		i += cborDecode(p + i, length - i, &ticks->t[k]);
+	return 1;
+}
@@ -0,0 +1,206 @@
+#include "ltime.h"
+#include <pthread.h>
+
+/*
+ *  Cached current time
+ *
+ *  A process wide VMS timestamp, refreshed by Ltime.update_now() once per
+ *  event loop iteration or by a background thread at a fixed resolution.
+ *  Reading it costs an atomic load instead of a clock read. The thread runs
+ *  while at least one Lua state holds a guard: Ltime.stop_clock() or the
+ *  guard's __gc, run when the state is closed and before ltime.so may be
+ *  unloaded, release it. A child forked while the thread runs inherits the
+ *  guards but not the thread: it reads the clock directly until it calls
+ *  Ltime.start_clock() again, which starts a thread of its own.
+ */
+
+static long long cachedNow;			/* 0 until the first update */
+static long long resolution;		/* of the background thread, in ticks */
+static int stopping;
+static int users;					/* Lua states holding a guard */
+static int orphaned;				/* forked child, guards without the thread */
+static pthread_t updater;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t atfork = PTHREAD_ONCE_INIT;
+
+#define CLOCK_GUARD_KEY "LTime_ClockGuard_instance"	/* registry field of the guard */
+
+typedef struct s_clock_guard {
+	int active;
+} t_clock_guard;
+
+static long long readClock(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return VMS_1970 + 10000000LL * (long long)ts.tv_sec + ts.tv_nsec / 100;
+}
+
+static inline long long cachedTicks(void) {
+
+	long long t = __atomic_load_n(&cachedNow, __ATOMIC_RELAXED);
+	if (t == 0 || __atomic_load_n(&orphaned, __ATOMIC_RELAXED)) {
+		t = readClock();
+		__atomic_store_n(&cachedNow, t, __ATOMIC_RELAXED);
+	}
+	return t;
+}
+
+static void *clockUpdater(void *arg) {
+
+	while (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&cachedNow, readClock(), __ATOMIC_RELAXED);
+		long long r = __atomic_load_n(&resolution, __ATOMIC_RELAXED);
+		struct timespec ts = { r / 10000000LL, r % 10000000LL * 100 };
+		nanosleep(&ts, NULL);
+	}
+	return NULL;
+}
+
+/*
+ *  fork() keeps only the calling thread, hold the lock across it so that the
+ *  child gets a consistent state, and mark the guards of the child orphaned
+ */
+static void forkPrepare(void) {
+
+	pthread_mutex_lock(&lock);
+}
+
+static void forkParent(void) {
+
+	pthread_mutex_unlock(&lock);
+}
+
+static void forkChild(void) {
+
+	if (users > 0)
+		__atomic_store_n(&orphaned, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&lock);
+}
+
+static void registerAtFork(void) {
+
+	pthread_atfork(forkPrepare, forkParent, forkChild);
+}
+
+/*
+ *  Release the guard of a Lua state, the last one stops the thread
+ */
+static void releaseGuard(t_clock_guard *guard) {
+
+	if (!guard->active)
+		return;
+	guard->active = 0;
+	pthread_mutex_lock(&lock);
+	if (--users == 0) {
+		if (!orphaned) {
+			__atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+			pthread_join(updater, NULL);
+		}
+		__atomic_store_n(&orphaned, 0, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+/*
+ *  Time = Ltime.cached_now([dest])
+ *  The cached current time, in a new Time or in dest
+ */
+int clock_cached_now(lua_State *L) {
+
+	t_datetime *self = destDatetime(L, 1);
+	self->t = cachedTicks();
+	return 1;
+}
+
+/*
+ *  ticks = Ltime.cached_now_ticks()
+ *  The cached current time as a VMS timestamp integer, no allocation
+ */
+int clock_cached_now_ticks(lua_State *L) {
+
+	lua_pushinteger(L, cachedTicks());
+	return 1;
+}
+
+/*
+ *  Ltime.update_now()
+ *  Refresh the cached current time from the clock
+ */
+int clock_update_now(lua_State *L) {
+
+	__atomic_store_n(&cachedNow, readClock(), __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ *  Ltime.start_clock([resolution])
+ *  Refresh the cached current time from a background thread every resolution,
+ *  anything accepted by Ltime.Epoch up to one second (default 1 ms)
+ *  Calling it again only changes the resolution, or restarts the thread in a
+ *  forked child
+ */
+int clock_start(lua_State *L) {
+
+	long long r = lua_isnoneornil(L, 1) ? 10000LL : parameterToTicks(L, 1);
+	luaL_argcheck(L, r > 0 && r <= 10000000LL, 1, LTIME_ERR_CLOCK_RESOLUTION);
+	__atomic_store_n(&resolution, r, __ATOMIC_RELAXED);
+	int held = lua_getfield(L, LUA_REGISTRYINDEX, CLOCK_GUARD_KEY) != LUA_TNIL;
+	if (held && !__atomic_load_n(&orphaned, __ATOMIC_RELAXED))
+		return 0;
+	pthread_once(&atfork, registerAtFork);
+	pthread_mutex_lock(&lock);
+	if (users == 0 || orphaned) {
+		__atomic_store_n(&stopping, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cachedNow, readClock(), __ATOMIC_RELAXED);
+		if (pthread_create(&updater, NULL, clockUpdater, NULL) != 0) {
+			pthread_mutex_unlock(&lock);
+			return luaL_error(L, LTIME_ERR_CLOCK_THREAD);
+		}
+		__atomic_store_n(&orphaned, 0, __ATOMIC_RELAXED);
+	}
+	if (held) {
+		pthread_mutex_unlock(&lock);
+		return 0;
+	}
+	users++;
+	pthread_mutex_unlock(&lock);
+	t_clock_guard *guard = (t_clock_guard *)lua_newuserdata(L, sizeof(t_clock_guard));
+	guard->active = 1;
+	luaL_setmetatable(L, LTIME_MT_CLOCK_GUARD);
+	lua_setfield(L, LUA_REGISTRYINDEX, CLOCK_GUARD_KEY);
+	return 0;
+}
+
+/*
+ *  Ltime.stop_clock()
+ *  Stop refreshing the cached current time for this Lua state
+ */
+int clock_stop(lua_State *L) {
+
+	if (lua_getfield(L, LUA_REGISTRYINDEX, CLOCK_GUARD_KEY) != LUA_TNIL) {
+		releaseGuard((t_clock_guard *)lua_touserdata(L, -1));
+		lua_pushnil(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, CLOCK_GUARD_KEY);
+	}
+	return 0;
+}
+
+static int clock_guard_gc(lua_State *L) {
+
+	releaseGuard((t_clock_guard *)lua_touserdata(L, 1));
+	return 0;
+}
+
+int open_clock(lua_State *L) {
+
+	static const luaL_Reg clock_guard_meta_methods[] = {
+		{"__gc", clock_guard_gc},
+		{NULL, NULL}
+	};
+
+	luaL_newmetatable(L, LTIME_MT_CLOCK_GUARD);
+	luaL_setfuncs(L, clock_guard_meta_methods, 0);
+
+	return 1;
+}
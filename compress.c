@@ -0,0 +1,277 @@
+#include "ltime.h"
+
+/*
+ *  Delta-of-delta compression of tick series (Gorilla style)
+ *
+ *  The first value is stored as is on 64 bits. Every following value is
+ *  stored as the difference between its delta and the previous delta,
+ *  which is 0 for a perfectly periodic series, with a variable length
+ *  prefix code:
+ *    0                      same delta
+ *    10   + 12 bits         delta of delta in [-2048, 2047]
+ *    110  + 20 bits         delta of delta in [-524288, 524287]
+ *    1110 + 32 bits         delta of delta fits 32 bits
+ *    1111 + 64 bits         anything else
+ *  Compressed data is LTIME_COMPRESSED_MAGIC, the value count as a varint,
+ *  then the bit stream, most significant bit first.
+ */
+
+/* Bits written per value, at most */
+#define MAX_VALUE_BITS	68
+
+typedef struct s_encoder {
+	unsigned char	*data;		/* zeroed bit stream */
+	size_t			capacity;	/* in bytes */
+	size_t			bit;		/* bits written */
+	size_t			count;		/* values written */
+	long long		last;
+	long long		delta;
+} t_encoder;
+
+#define isEncoder(L, i) ((t_encoder *)luaL_checkudata(L, i, LTIME_MT_TICKS_ENCODER))
+
+/*
+ *  Write the n low bits of value, data must be zeroed
+ */
+static void putBits(unsigned char *data, size_t *bit, unsigned long long value, int n) {
+
+	while (n > 0) {
+		int room = 8 - (*bit & 7);
+		int take = n < room ? n : room;
+		data[*bit >> 3] |= ((value >> (n - take)) & ((1U << take) - 1)) << (room - take);
+		*bit += take;
+		n -= take;
+	}
+}
+
+/*
+ *  Read n bits into value
+ *  Return 0 past the end of the stream
+ */
+static int getBits(const unsigned char *data, size_t bits, size_t *bit, int n, unsigned long long *value) {
+
+	if (bits - *bit < (size_t)n)
+		return 0;
+	*value = 0;
+	while (n > 0) {
+		int room = 8 - (*bit & 7);
+		int take = n < room ? n : room;
+		*value = (*value << take) | ((data[*bit >> 3] >> (room - take)) & ((1U << take) - 1));
+		*bit += take;
+		n -= take;
+	}
+	return 1;
+}
+
+/*
+ *  Append a value to the stream, there must be room for MAX_VALUE_BITS more bits
+ */
+static void encode(t_encoder *self, long long t) {
+
+	if (self->count++ == 0) {
+		putBits(self->data, &self->bit, t, 64);
+		self->last = t;
+		self->delta = 0;
+		return;
+	}
+	// wrapping unsigned arithmetic, decoded the same way
+	long long delta = (long long)((unsigned long long)t - self->last);
+	long long dod = (long long)((unsigned long long)delta - self->delta);
+	if (dod == 0)
+		putBits(self->data, &self->bit, 0, 1);
+	else if (dod >= -2048 && dod < 2048) {
+		putBits(self->data, &self->bit, 2, 2);
+		putBits(self->data, &self->bit, dod, 12);
+	} else if (dod >= -524288 && dod < 524288) {
+		putBits(self->data, &self->bit, 6, 3);
+		putBits(self->data, &self->bit, dod, 20);
+	} else if (dod >= -2147483648LL && dod < 2147483648LL) {
+		putBits(self->data, &self->bit, 14, 4);
+		putBits(self->data, &self->bit, dod, 32);
+	} else {
+		putBits(self->data, &self->bit, 15, 4);
+		putBits(self->data, &self->bit, dod, 64);
+	}
+	self->last = t;
+	self->delta = delta;
+}
+
+/*
+ *  Push the compressed representation of an encoder
+ */
+static void pushCompressed(lua_State *L, const t_encoder *self) {
+
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	luaL_addlstring(&b, LTIME_COMPRESSED_MAGIC, 4);
+	addVarint(&b, self->count);
+	if (self->bit)
+		luaL_addlstring(&b, (const char *)self->data, (self->bit + 7) / 8);
+	luaL_pushresult(&b);
+}
+
+/*
+ *  string = Ltime.compress(ticks)
+ *  ticks is a Ticks object or a table of Time objects / raw ticks
+ */
+int compress_ticks(lua_State *L) {
+
+	lua_settop(L, 1);
+	t_ticks *ticks = toTicks(L, 1);
+	t_encoder encoder;
+	memset(&encoder, 0, sizeof(t_encoder));
+	encoder.capacity = (ticks->n * MAX_VALUE_BITS + 7) / 8 + 1;
+	encoder.data = (unsigned char *)lua_newuserdata(L, encoder.capacity);
+	memset(encoder.data, 0, encoder.capacity);
+	for (size_t i = 0; i < ticks->n; i++)
+		encode(&encoder, ticksAt(ticks, i));
+	pushCompressed(L, &encoder);
+	return 1;
+}
+
+/*
+ *  Ticks = Ltime.decompress(string)
+ */
+int decompress_ticks(lua_State *L) {
+
+	size_t length;
+	const unsigned char *p = (const unsigned char *)luaL_checklstring(L, 1, &length);
+	const unsigned char *end = p + length;
+	unsigned long long count = 0, value = 0;
+	if (length < 4 || memcmp(p, LTIME_COMPRESSED_MAGIC, 4) != 0)
+		luaL_error(L, LTIME_ERR_COMPRESSED_FORMAT);
+	p += 4;
+	if (!readVarint(&p, end, &count))
+		luaL_error(L, LTIME_ERR_COMPRESSED_FORMAT);
+	size_t bits = (end - p) * 8, bit = 0;
+	// every value takes at least one bit, the first one 64
+	if (count && (count - 1 > bits || bits < 64 || count - 1 > bits - 64))
+		luaL_error(L, LTIME_ERR_COMPRESSED_FORMAT);
+	t_ticks *ticks = newTicks(L, count);
+	long long last = 0, delta = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (i == 0) {
+			getBits(p, bits, &bit, 64, &value);
+			last = value;
+		} else {
+			// prefix: number of leading 1 bits, up to 4
+			int ones = 0;
+			while (ones < 4) {
+				if (!getBits(p, bits, &bit, 1, &value))
+					luaL_error(L, LTIME_ERR_COMPRESSED_FORMAT);
+				if (!value)
+					break;
+				ones++;
+			}
+			static const int widths[] = {0, 12, 20, 32, 64};
+			int n = widths[ones];
+			long long dod = 0;
+			if (n) {
+				if (!getBits(p, bits, &bit, n, &value))
+					luaL_error(L, LTIME_ERR_COMPRESSED_FORMAT);
+				dod = (long long)value;
+				if (n < 64 && (value >> (n - 1)) & 1)	// sign extend
+					dod = (long long)(value - (1ULL << n));
+			}
+			delta = (long long)((unsigned long long)delta + dod);
+			last = (long long)((unsigned long long)last + delta);
+		}
+		ticks->t[i] = last;
+	}
+	return 1;
+}
+
+/*
+ *  TicksEncoder = Ltime.TicksEncoder()
+ *  Streaming compressor, appending one value at a time
+ */
+int encoder_new(lua_State *L) {
+
+	t_encoder *self = (t_encoder *)lua_newuserdata(L, sizeof(t_encoder));
+	memset(self, 0, sizeof(t_encoder));
+	luaL_setmetatable(L, LTIME_MT_TICKS_ENCODER);
+	return 1;
+}
+
+/*
+ *  Append a value: a Time, a raw tick integer or anything accepted by Ltime.Time
+ *  TicksEncoder = TicksEncoder:append(t)
+ */
+static int encoder_append(lua_State *L) {
+
+	t_encoder *self = isEncoder(L, 1);
+	long long t = elementToVMS(L, 2);
+	if ((self->bit + MAX_VALUE_BITS + 7) / 8 > self->capacity) {
+		size_t capacity = self->capacity ? self->capacity * 2 : 256;
+		unsigned char *data = realloc(self->data, capacity);
+		if (!data)
+			luaL_error(L, LTIME_ERR_OUT_OF_MEMORY);
+		memset(data + self->capacity, 0, capacity - self->capacity);
+		self->data = data;
+		self->capacity = capacity;
+	}
+	encode(self, t);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/*
+ *  Compressed data of all the values appended so far, as Ltime.compress()
+ *  string = TicksEncoder:data()
+ */
+static int encoder_data(lua_State *L) {
+
+	pushCompressed(L, isEncoder(L, 1));
+	return 1;
+}
+
+/*
+ *  Number of values appended
+ *  count = TicksEncoder:count()
+ */
+static int encoder_count(lua_State *L) {
+
+	t_encoder *self = isEncoder(L, 1);
+	lua_pushinteger(L, self->count);
+	return 1;
+}
+
+/*
+ *  TicksEncoder:__gc()
+ */
+static int encoder_gc(lua_State *L) {
+
+	t_encoder *self = isEncoder(L, 1);
+	free(self->data);
+	self->data = NULL;
+	self->capacity = self->bit = self->count = 0;
+	return 0;
+}
+
+int open_compress(lua_State *L) {
+
+	static const luaL_Reg encoder_methods[] = {
+		{"append", encoder_append},
+		{"data", encoder_data},
+		{"count", encoder_count},
+		{NULL, NULL}
+	};
+
+	static const luaL_Reg encoder_meta_methods[] = {
+		{"__len", encoder_count},
+		{"__gc", encoder_gc},
+		{NULL, NULL}
+	};
+
+	// create the metatable first
+	luaL_newmetatable(L, LTIME_MT_TICKS_ENCODER);
+	// and set all metamethods except __index
+	luaL_setfuncs(L, encoder_meta_methods, 0);
+
+	// create the library table
+	luaL_newlib(L, encoder_methods);
+	// and set the __index metamethod
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}
@@ -0,0 +1,288 @@
+#include "ltime.h"
+#include <limits.h>
+#include <math.h>
+
+/*
+ *  Bulk conversions between VMS ticks and foreign timestamp encodings
+ *
+ *  Values are loaded into a packed array first, then converted in place by
+ *  a branch-free loop per encoding that the compiler can vectorize. Integer
+ *  encodings convert exactly, only the resolution finer than 100 ns of unix
+ *  nanoseconds and NTP fractions is rounded off. Excel serial dates are
+ *  doubles: in packed arrays they are stored as the bits of the double, as a
+ *  binary file of float64 values mapped with Ltime.mmap_ticks would hold them.
+ *  Values whose conversion would overflow 64 bits are rejected beforehand, as
+ *  are NTP timestamps outside of era 0 (1900 to 2036).
+ */
+
+#define VMS_1601		(-94187LL * 864000000000LL)	/* FILETIME origin */
+#define VMS_1900		(15020LL * 864000000000LL)	/* NTP origin */
+#define EXCEL_1970		25569						/* serial day of 1970-01-01 */
+#define TICKS_PER_DAY	864000000000LL
+
+enum { ENCODING_UNIX, ENCODING_UNIX_MS, ENCODING_UNIX_US, ENCODING_UNIX_NS, ENCODING_FILETIME, ENCODING_EXCEL, ENCODING_NTP };
+
+static const char *const encodings[] = { "unix", "unix_ms", "unix_us", "unix_ns", "filetime", "excel", "ntp", NULL };
+
+typedef struct s_range {
+	long long lo, hi;
+} t_range;
+
+/* Foreign values that decode to VMS ticks without overflow, per encoding (Excel apart) */
+static const t_range decodeRanges[] = {
+	{ LLONG_MIN / 10000000LL, (LLONG_MAX - VMS_1970) / 10000000LL },
+	{ LLONG_MIN / 10000LL, (LLONG_MAX - VMS_1970) / 10000LL },
+	{ LLONG_MIN / 10LL, (LLONG_MAX - VMS_1970) / 10LL },
+	{ LLONG_MIN, LLONG_MAX },
+	{ LLONG_MIN - VMS_1601, LLONG_MAX },
+	{ LLONG_MIN, LLONG_MAX },
+	{ LLONG_MIN, LLONG_MAX }
+};
+
+/* VMS ticks that encode without overflow, per encoding */
+static const t_range encodeRanges[] = {
+	{ LLONG_MIN + VMS_1970, LLONG_MAX },
+	{ LLONG_MIN + VMS_1970, LLONG_MAX },
+	{ LLONG_MIN + VMS_1970, LLONG_MAX },
+	{ VMS_1970 + LLONG_MIN / 100, VMS_1970 + LLONG_MAX / 100 },	/* 1677-09-21 to 2262-04-11 */
+	{ LLONG_MIN, LLONG_MAX + VMS_1601 },
+	{ LLONG_MIN + VMS_1970, LLONG_MAX },
+	{ VMS_1900, VMS_1900 + (1LL << 32) * 10000000LL - 1 }		/* era 0 */
+};
+
+/* Division rounding towards minus infinity, for timestamps before the origins */
+static inline long long floorDiv(long long a, long long b) {
+	long long q = a / b;
+	return q - ((a % b) < 0);
+}
+
+static inline double bitsToDouble(long long bits) {
+	double d;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+static inline long long doubleToBits(double d) {
+	long long bits;
+	memcpy(&bits, &d, sizeof(bits));
+	return bits;
+}
+
+/*
+ *  Index of the first of n values out of range, n if none
+ *  The min/max pass vectorizes, values are only searched one by one on failure
+ */
+static size_t outOfRange(const long long *t, size_t n, const t_range *range) {
+
+	long long min = LLONG_MAX, max = LLONG_MIN;
+	for (size_t i = 0; i < n; i++) {
+		min = t[i] < min ? t[i] : min;
+		max = t[i] > max ? t[i] : max;
+	}
+	if (min >= range->lo && max <= range->hi)
+		return n;
+	size_t i = 0;
+	while (t[i] >= range->lo && t[i] <= range->hi)
+		i++;
+	return i;
+}
+
+/*
+ *  Index of the first of n Excel serial dates (bits of doubles) that is not
+ *  finite or out of range, n if none
+ */
+static size_t excelOutOfRange(const long long *t, size_t n) {
+
+	// the whole days, times ticks per day, plus the fraction of one day
+	const double lo = EXCEL_1970 + (double)(LLONG_MIN / TICKS_PER_DAY);
+	const double hi = EXCEL_1970 + (double)((LLONG_MAX - VMS_1970) / TICKS_PER_DAY - 1);
+	size_t i = 0;
+	while (i < n) {
+		double x = bitsToDouble(t[i]);
+		if (!(x >= lo && x <= hi))	// NaN fails both comparisons
+			break;
+		i++;
+	}
+	return i;
+}
+
+/*
+ *  Convert n foreign values to VMS ticks in place
+ */
+static void decodeTicks(int encoding, long long *t, size_t n) {
+
+	switch (encoding) {
+		case ENCODING_UNIX:
+			for (size_t i = 0; i < n; i++)
+				t[i] = VMS_1970 + t[i] * 10000000LL;
+			break;
+		case ENCODING_UNIX_MS:
+			for (size_t i = 0; i < n; i++)
+				t[i] = VMS_1970 + t[i] * 10000LL;
+			break;
+		case ENCODING_UNIX_US:
+			for (size_t i = 0; i < n; i++)
+				t[i] = VMS_1970 + t[i] * 10LL;
+			break;
+		case ENCODING_UNIX_NS:
+			for (size_t i = 0; i < n; i++)
+				t[i] = VMS_1970 + floorDiv(t[i], 100);
+			break;
+		case ENCODING_FILETIME:
+			for (size_t i = 0; i < n; i++)
+				t[i] = VMS_1601 + t[i];
+			break;
+		case ENCODING_EXCEL:
+			// split the days off, a whole serial date times ticks per day needs more than 53 bits
+			for (size_t i = 0; i < n; i++) {
+				double x = bitsToDouble(t[i]);
+				double days = floor(x);
+				t[i] = VMS_1970 + ((long long)days - EXCEL_1970) * TICKS_PER_DAY + llround((x - days) * TICKS_PER_DAY);
+			}
+			break;
+		case ENCODING_NTP:
+			// 32 bits of seconds since 1900 and 32 bits of fraction, era 0
+			for (size_t i = 0; i < n; i++) {
+				unsigned long long ntp = (unsigned long long)t[i];
+				t[i] = VMS_1900 + (long long)(ntp >> 32) * 10000000LL + (long long)(((ntp & 0xFFFFFFFFULL) * 10000000ULL + 0x80000000ULL) >> 32);
+			}
+			break;
+	}
+}
+
+/*
+ *  Convert n VMS ticks to foreign values in place
+ */
+static void encodeTicks(int encoding, long long *t, size_t n) {
+
+	switch (encoding) {
+		case ENCODING_UNIX:
+			for (size_t i = 0; i < n; i++)
+				t[i] = floorDiv(t[i] - VMS_1970, 10000000LL);
+			break;
+		case ENCODING_UNIX_MS:
+			for (size_t i = 0; i < n; i++)
+				t[i] = floorDiv(t[i] - VMS_1970, 10000LL);
+			break;
+		case ENCODING_UNIX_US:
+			for (size_t i = 0; i < n; i++)
+				t[i] = floorDiv(t[i] - VMS_1970, 10LL);
+			break;
+		case ENCODING_UNIX_NS:
+			for (size_t i = 0; i < n; i++)
+				t[i] = (t[i] - VMS_1970) * 100LL;
+			break;
+		case ENCODING_FILETIME:
+			for (size_t i = 0; i < n; i++)
+				t[i] = t[i] - VMS_1601;
+			break;
+		case ENCODING_EXCEL:
+			for (size_t i = 0; i < n; i++) {
+				long long days = floorDiv(t[i] - VMS_1970, TICKS_PER_DAY);
+				long long rest = t[i] - VMS_1970 - days * TICKS_PER_DAY;
+				t[i] = doubleToBits((double)(days + EXCEL_1970) + (double)rest / TICKS_PER_DAY);
+			}
+			break;
+		case ENCODING_NTP:
+			for (size_t i = 0; i < n; i++) {
+				long long seconds = floorDiv(t[i] - VMS_1900, 10000000LL);
+				long long rest = t[i] - VMS_1900 - seconds * 10000000LL;
+				t[i] = (long long)(((unsigned long long)seconds << 32) | ((((unsigned long long)rest << 32) + 5000000ULL) / 10000000ULL));
+			}
+			break;
+	}
+}
+
+/*
+ *  Destination Ticks at index for n values, or a new one if absent
+ *  Leave it on top of the stack
+ */
+static t_ticks *destTicks(lua_State *L, int index, size_t n) {
+
+	if (lua_isnoneornil(L, index))
+		return newTicks(L, n);
+	t_ticks *dest = (t_ticks *)luaL_checkudata(L, index, LTIME_MT_TICKS);
+	if (dest->map)
+		luaL_error(L, LTIME_ERR_TICKS_READONLY);
+	if (dest->n != n)
+		luaL_error(L, LTIME_ERR_CONVERT_LENGTH);
+	lua_pushvalue(L, index);
+	return dest;
+}
+
+/*
+ *  Ticks = Ltime.decode_ticks(encoding, values[, dest])
+ *  values is a table of numbers or a Ticks object holding the raw foreign values
+ *  dest is a Ticks object of the same length to fill, possibly values itself
+ */
+int convert_decode(lua_State *L) {
+
+	int encoding = luaL_checkoption(L, 1, NULL, encodings);
+	t_ticks *source = (t_ticks *)luaL_testudata(L, 2, LTIME_MT_TICKS);
+	if (!source)
+		luaL_checktype(L, 2, LUA_TTABLE);
+	size_t n = source ? source->n : lua_rawlen(L, 2);
+	t_ticks *dest = destTicks(L, 3, n);
+	if (source) {
+		if (source->swap)
+			for (size_t i = 0; i < n; i++)
+				dest->t[i] = ticksAt(source, i);
+		else if (dest != source)
+			memcpy(dest->t, source->t, n * sizeof(long long));
+	} else {
+		for (size_t i = 0; i < n; i++) {
+			lua_rawgeti(L, 2, i + 1);
+			int isnum;
+			if (encoding == ENCODING_EXCEL) {
+				dest->t[i] = doubleToBits(lua_tonumberx(L, -1, &isnum));
+			} else {
+				dest->t[i] = lua_tointegerx(L, -1, &isnum);
+			}
+			if (!isnum)
+				luaL_error(L, LTIME_ERR_BULK_ELEMENT, (int)(i + 1));
+			lua_pop(L, 1);
+		}
+	}
+	size_t bad = encoding == ENCODING_EXCEL ? excelOutOfRange(dest->t, n) : outOfRange(dest->t, n, &decodeRanges[encoding]);
+	if (bad < n)
+		luaL_error(L, LTIME_ERR_BULK_ELEMENT, (int)(bad + 1));
+	decodeTicks(encoding, dest->t, n);
+	return 1;
+}
+
+/*
+ *  values = Ltime.encode_ticks(encoding, ticks[, dest])
+ *  ticks is a Ticks object or a table accepted by Ltime.Ticks
+ *  Without dest, return a table of numbers (integers, floats for "excel")
+ *  dest is a Ticks object of the same length to fill with the raw foreign
+ *  values, possibly ticks itself
+ */
+int convert_encode(lua_State *L) {
+
+	int encoding = luaL_checkoption(L, 1, NULL, encodings);
+	int table = lua_isnoneornil(L, 3);
+	lua_settop(L, 3);
+	t_ticks *source = toTicks(L, 2);
+	size_t n = source->n;
+	t_ticks *dest = table ? newTicks(L, n) : destTicks(L, 3, n);
+	if (source->swap)
+		for (size_t i = 0; i < n; i++)
+			dest->t[i] = ticksAt(source, i);
+	else if (dest != source)
+		memcpy(dest->t, source->t, n * sizeof(long long));
+	size_t bad = outOfRange(dest->t, n, &encodeRanges[encoding]);
+	if (bad < n)
+		luaL_error(L, LTIME_ERR_BULK_ELEMENT, (int)(bad + 1));
+	encodeTicks(encoding, dest->t, n);
+	if (!table)
+		return 1;
+	lua_createtable(L, n, 0);
+	for (size_t i = 0; i < n; i++) {
+		if (encoding == ENCODING_EXCEL)
+			lua_pushnumber(L, bitsToDouble(dest->t[i]));
+		else
+			lua_pushinteger(L, dest->t[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
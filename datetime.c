@@ -14,6 +14,20 @@
 t_datetime *newDatetime(lua_State *L) {
 	t_datetime *self = (t_datetime *)lua_newuserdata(L, sizeof(t_datetime));
 	luaL_setmetatable(L, LTIME_MT_DATETIME);
+	STAT(TIME_ALLOC);
+	return self;
+}
+
+/*
+ * Destination of a getter: the Time object at index if there is one,
+ * otherwise a new one
+ * - leave the object on top of the stack
+ */
+t_datetime *destDatetime(lua_State *L, int index) {
+	if (lua_isnoneornil(L, index))
+		return newDatetime(L);
+	t_datetime *self = (t_datetime *)luaL_checkudata(L, index, LTIME_MT_DATETIME);
+	lua_pushvalue(L, index);
 	return self;
 }
 
@@ -58,7 +72,7 @@ int toMJD(unsigned Y, unsigned M, unsigned D) {
  *  M from 01 to 12, D from 01 to 31, h from 00 to 23, m from 00 to 59, s from 00 to 59
  *  Return -1 if input datetime is prior to 1858-11-17 00:00:00.0000000
  */
-static long long toVMS(unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+long long toVMS(unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
 	long long MJD = (long long)toMJD(Y, M, D);
 	if (MJD == -1 || h > 23 || m > 59 || s > 59 || us > 999999)
@@ -67,65 +81,79 @@ static long long toVMS(unsigned Y, unsigned M, unsigned D, unsigned h, unsigned
 }
 
 /*
- *  Lua parameter at index to VMS timestamp
+ *  ISO 8601 like string of the given length to VMS timestamp
+ *  Relaxed version.... more like MySQL. And hopefully fast.
+ *  Pure C, safe to call from any thread
+ *  Return -1 if the string does not represent a valid datetime
+ */
+long long parseVMS(const char *p, size_t length) {
+	unsigned Y = 0, M = 0, D = 0, h = 0, m = 0, s = 0, us=0;
+	register int n;
+	const char *end = p + length;
+	while (p<end && isspace(*p)) p++;
+	// <Y> <M> <D>
+	n = 4;
+	while (p<end && isdigit(*p) && n--) Y=Y*10+(*p++ -'0');
+	if (p<end && !isdigit(*p)) p++;
+	n = 2;
+	while (p<end && isdigit(*p) && n--) M=M*10+(*p++ -'0');
+	if (p<end && !isdigit(*p)) p++;
+	n = 2;
+	while (p<end && isdigit(*p) && n--) D=D*10+(*p++ -'0');
+	while (p<end && !isdigit(*p)) p++;
+
+	// optional time part [T] <h> <m> [<s> [ . <fs>]]
+	if (p<end) {
+		//if (*p && (*p=='T' || *p==':')) p++;
+		n = 2;
+		while (p<end && isdigit(*p) && n--) h=h*10+(*p++ -'0');
+		if (p<end && !isdigit(*p)) p++;
+		n = 2;
+		while (p<end && isdigit(*p) && n--) m=m*10+(*p++ -'0');
+		if (p<end && !isdigit(*p)) p++;
+		n = 2;
+		while (p<end && isdigit(*p) && n--) s=s*10+(*p++ -'0');
+		if (p<end && *p=='.') p++;
+		if (p<end) {
+			n=6;
+			while (p<end && isdigit(*p) && n--) us=us*10+(*p++ -'0');
+			while (n-- > 0) us=us*10; // right pad
+		}
+	}
+	return toVMS(Y, M, D, h, m, s, us);
+}
+
+/*
+ *  Lua parameter at index, of type ltype, to VMS timestamp
  */
-static long long parameterToVMS(lua_State *L, int index) {
-	int	ltype = index==0 ? LUA_TNIL : lua_type(L, index);
+static inline long long valueToVMS(lua_State *L, int index, int ltype) {
 	/* nil is considered "now" */
 	if (ltype == LUA_TNIL) {
+		STAT(TIME_NOW);
 		struct timeval tv;
 		gettimeofday(&tv, NULL);
 		return VMS_1970 + 10000000LL * (long long)tv.tv_sec + 10LL * (long long)tv.tv_usec;
 	}
 	/* Parameter is a number, considered number of seconds since 1970-01-01 00:00:00 */
 	else if (ltype == LUA_TNUMBER) {
+		STAT(TIME_NUMBER);
 		return VMS_1970 + (long long)(10000000LL * lua_tonumber(L, index));
 	}
 	/* Parameter is a string, considered strict ISO 8601 string */
 	else if (ltype == LUA_TSTRING) {
-		// Relaxed version.... more like MySQL. And hopefully fast.
-		unsigned Y = 0, M = 0, D = 0, h = 0, m = 0, s = 0, us=0;
-		register int n;
-		char *p = (char *)lua_tostring(L, index);
-		while (*p && isspace(*p)) p++;
-		// <Y> <M> <D>
-		n = 4;
-		while (*p && isdigit(*p) && n--) Y=Y*10+(*p++ -'0');
-		if (*p && !isdigit(*p)) p++;
-		n = 2;
-		while (*p && isdigit(*p) && n--) M=M*10+(*p++ -'0');
-		if (*p && !isdigit(*p)) p++;
-		n = 2;
-		while (*p && isdigit(*p) && n--) D=D*10+(*p++ -'0');
-		while (*p && !isdigit(*p)) p++;
-
-		// optional time part [T] <h> <m> [<s> [ . <fs>]]
-		if (*p) {
-			//if (*p && (*p=='T' || *p==':')) p++;
-			n = 2;
-			while (*p && isdigit(*p) && n--) h=h*10+(*p++ -'0');
-			if (*p && !isdigit(*p)) p++;
-			n = 2;
-			while (*p && isdigit(*p) && n--) m=m*10+(*p++ -'0');
-			if (*p && !isdigit(*p)) p++;
-			n = 2;
-			while (*p && isdigit(*p) && n--) s=s*10+(*p++ -'0');
-			if (*p && *p=='.') p++;
-			if (*p) {
-				n=6;
-				while (*p && isdigit(*p) && n--) us=us*10+(*p++ -'0');
-				while (n-- > 0) us=us*10; // right pad
-			}
-		}
-		long long t = toVMS(Y, M, D, h, m, s, us);
+		size_t length;
+		const char *p = lua_tolstring(L, index, &length);
+		STAT(TIME_STRING);
+		STAT_BEGIN(start);
+		long long t = parseVMS(p, length);
+		STAT_END(TIME_STRING, start);
 		if (t == -1)
 			luaL_error(L, LTIME_ERR_DATETIME_CONSTRUCTOR);
 		return t;
-
-		//*/
 	}
 	/* Parameter is a table */
 	else if (ltype == LUA_TTABLE) {
+		STAT(TIME_TABLE);
 		unsigned Y = tableFieldToUnsigned(L, index, LTIME_KEY_YEAR);
 		unsigned M = tableFieldToUnsigned(L, index, LTIME_KEY_MONTH);
 		unsigned D = tableFieldToUnsigned(L, index, LTIME_KEY_DAY);
@@ -140,11 +168,37 @@ static long long parameterToVMS(lua_State *L, int index) {
 	}
 	else {
 		t_datetime *param = luaL_checkudata(L, index, LTIME_MT_DATETIME);
+		STAT(TIME_OBJECT);
 		return param->t;
 	}
 	return 0;
 }
 
+/*
+ *  Lua parameter at index to VMS timestamp
+ *  Probes: parse_entry(lua type, string length), parse_return(lua type, timestamp)
+ */
+long long parameterToVMS(lua_State *L, int index) {
+	int	ltype = index==0 ? LUA_TNIL : lua_type(L, index);
+	PROBE2(parse_entry, ltype, ltype == LUA_TSTRING ? (long)lua_rawlen(L, index) : 0L);
+	long long t = valueToVMS(L, index, ltype);
+	PROBE2(parse_return, ltype, t);
+	return t;
+}
+
+/*
+ *  Time argument at index to VMS timestamp, absent or nil is "now"
+ *  Time objects take the fast path
+ */
+long long timeArgument(lua_State *L, int index) {
+	t_datetime *param = (t_datetime *)luaL_testudata(L, index, LTIME_MT_DATETIME);
+	if (param) {
+		STAT(TIME_OBJECT);
+		return param->t;
+	}
+	return parameterToVMS(L, lua_isnoneornil(L, index) ? 0 : index);
+}
+
 /*
  *  Modified Julian Day to Gregorian Calendar Y-M-D
  *  Algorithm from http://quasar.as.utexas.edu/BillInfo/JulianDatesG.html
@@ -191,9 +245,11 @@ void fromVMS(long long t, unsigned *Y, unsigned *M, unsigned *D, unsigned *h, un
  *  Time = Ltime.Time(parameter)
  */
 int datetime_new(lua_State *L) {
+	PROBE(time_new_entry);
 	int top = lua_gettop(L);
 	t_datetime *self = newDatetime(L);
 	self->t = parameterToVMS(L, top>0 ? 1 : 0 );
+	PROBE1(time_new_return, self->t);
 	return 1;
 }
 
@@ -221,13 +277,13 @@ int datetime_mktime(lua_State *L) {
 }
 
 /*
- * 	Return a clone of the Time object
- *  Time2 = Time:clone()
+ * 	Return a clone of the Time object, into dest if given
+ *  Time2 = Time:clone([dest])
  */ 
 static int datetime_clone(lua_State *L) {
 	
 	t_datetime *self = (t_datetime *)luaL_checkudata(L, 1, LTIME_MT_DATETIME);
-	t_datetime *clone = newDatetime(L);
+	t_datetime *clone = destDatetime(L, 2);
 	clone->t = self->t;
 	return 1;
 }
@@ -235,15 +291,15 @@ static int datetime_clone(lua_State *L) {
 /*
  *  Set/get date without affecting time of day
  *  Setter: Time = Time:date(parameter)
- *  Getter: Time2 = Time:date()
+ *  Getter: Time2 = Time:date([nil, dest])
  */
 static int datetime_date(lua_State *L) {
 	
 	t_datetime *self = (t_datetime *)luaL_checkudata(L, 1, LTIME_MT_DATETIME);
 	unsigned Y, M, D, h, m, s, us;
 	fromVMS(self->t, &Y, &M, &D, &h, &m, &s, &us);
-	if (lua_gettop(L) == 1) {
-		t_datetime *result = newDatetime(L);
+	if (lua_gettop(L) == 1 || (lua_isnil(L, 2) && lua_gettop(L) > 2)) {
+		t_datetime *result = destDatetime(L, 3);
 		result->t = toVMS(Y, M, D, 0, 0, 0, 0);
 	} else {
 		long long t = parameterToVMS(L, 2);
@@ -257,15 +313,15 @@ static int datetime_date(lua_State *L) {
 /*
  *  Set/get time of day without affecting date
  *  Setter: Time = Time:time(parameter)
- *  Getter: Epoch = Time:time()
+ *  Getter: Epoch = Time:time([nil, dest])
  */
 static int datetime_time(lua_State *L) {
 	
 	t_datetime *self = (t_datetime *)luaL_checkudata(L, 1, LTIME_MT_DATETIME);
 	unsigned Y, M, D, h, m, s, us;
 	fromVMS(self->t, &Y, &M, &D, &h, &m, &s, &us);
-	if (lua_gettop(L) == 1) { // getter
-		t_epoch *result = newEpoch(L);
+	if (lua_gettop(L) == 1 || (lua_isnil(L, 2) && lua_gettop(L) > 2)) { // getter
+		t_epoch *result = destEpoch(L, 3);
 		result->t = ((((long long)h * 60 + m) * 60 + s) * (long long)1e6 + us) * 10;
 	} else { // setter
 		long long t = parameterToTicks(L, 2);
@@ -495,6 +551,7 @@ static int datetime_unix(lua_State *L) {
  */
 static int datetime_unm(lua_State *L) {
 
+	STAT(TIME_META);
 	luaL_error(L, LTIME_ERR_DATETIME_UNM_UNDEFINED);
 	return 0;
 }
@@ -503,6 +560,8 @@ static int datetime_unm(lua_State *L) {
  *  Time.__add(a, b)
  */
 static int datetime_add(lua_State *L) {
+	STAT(TIME_META);
+	PROBE1(arith_entry, "time_add");
 	long long t1, t2;
 	t_datetime *self = luaL_checkudata(L, 1, LTIME_MT_DATETIME);
 	t1 = self->t;
@@ -511,6 +570,7 @@ static int datetime_add(lua_State *L) {
 	result->t = t1 + t2;
 	if (result->t < 0)
 		luaL_error(L, LTIME_ERR_DATETIME_OUT_OF_RANGE);
+	PROBE1(arith_return, "time_add");
 	return 1;
 }
 
@@ -519,6 +579,8 @@ static int datetime_add(lua_State *L) {
  */
 static int datetime_sub(lua_State *L) {
 
+	STAT(TIME_META);
+	PROBE1(arith_entry, "time_sub");
 	t_datetime *a = luaL_checkudata(L, 1, LTIME_MT_DATETIME);
 	t_datetime *b = luaL_testudata(L, 2, LTIME_MT_DATETIME);
 	if (b) {
@@ -531,6 +593,7 @@ static int datetime_sub(lua_State *L) {
 		if (result->t < 0)
 			luaL_error(L, LTIME_ERR_DATETIME_OUT_OF_RANGE);
 	}
+	PROBE1(arith_return, "time_sub");
 	return 1;
 }
 
@@ -539,6 +602,7 @@ static int datetime_sub(lua_State *L) {
  */
 static int datetime_mul(lua_State *L) {
 	
+	STAT(TIME_META);
 	luaL_error(L, LTIME_ERR_DATETIME_MUL_UNDEFINED);
 	return 0;
 }
@@ -548,6 +612,7 @@ static int datetime_mul(lua_State *L) {
  */
 static int datetime_div(lua_State *L) {
 	
+	STAT(TIME_META);
 	luaL_error(L, LTIME_ERR_DATETIME_DIV_UNDEFINED);
 	return 0;
 }
@@ -557,6 +622,8 @@ static int datetime_div(lua_State *L) {
  */
 static int datetime_mod(lua_State *L) {
 
+	STAT(TIME_META);
+	PROBE1(arith_entry, "time_mod");
 	t_datetime *self = luaL_checkudata(L, 1, LTIME_MT_DATETIME);
 
 	/* Second operand is a number, considered number of seconds, return seconds */
@@ -574,6 +641,7 @@ static int datetime_mod(lua_State *L) {
 		t_epoch *result = newEpoch(L);
 		result->t = self->t % t;
 	}
+	PROBE1(arith_return, "time_mod");
 	return 1;
 }
 
@@ -586,6 +654,7 @@ static int datetime_mod(lua_State *L) {
  * 	function __concat(a,b) return tostring(a)..tostring(b); end
  */
 static int datetime_concat(lua_State *L) {
+	STAT(TIME_META);
 	luaL_tolstring(L,1,NULL);
 	luaL_tolstring(L,2,NULL);
 	lua_concat(L, 2);
@@ -596,6 +665,7 @@ static int datetime_concat(lua_State *L) {
  *  Time.__eq(a, b)
  */
 static int datetime_eq(lua_State *L) {
+	STAT(TIME_META);
 	lua_pushboolean(L, parameterToVMS(L, 1) == parameterToVMS(L, 2));
 	return 1;
 }
@@ -604,6 +674,7 @@ static int datetime_eq(lua_State *L) {
  *  Time.__lt(a, b)
  */
 static int datetime_lt(lua_State *L) {
+	STAT(TIME_META);
 	lua_pushboolean(L, parameterToVMS(L, 1) < parameterToVMS(L, 2));
 	return 1;
 }
@@ -612,35 +683,31 @@ static int datetime_lt(lua_State *L) {
  *  Time.__le(a, b)
  */
 static int datetime_le(lua_State *L) {
+	STAT(TIME_META);
 	lua_pushboolean(L, parameterToVMS(L, 1) <= parameterToVMS(L, 2));
 	return 1;
 }
 
+/*
+ *  VMS timestamp to YYYY-MM-DD hh:mm:ss[.uuuuuu], buffer must hold 42 characters
+ *  Return the length written
+ */
+int timeToString(long long t, char *buffer) {
+	unsigned Y, M, D, h, m, s, us;
+	fromVMS(t, &Y, &M, &D, &h, &m, &s, &us);
+	if (us)
+		return snprintf(buffer, 40, "%04u-%02u-%02u %02u:%02u:%02u.%06u", Y, M, D, h, m, s, us);
+	return snprintf(buffer, 40, "%04u-%02u-%02u %02u:%02u:%02u", Y, M, D, h, m, s);
+}
+
 /*
  *  Time:__tostring()
  * 	Format the value for use in MySQL
  */
 static int datetime_tostring(lua_State *L) {
 	t_datetime *self = (t_datetime *)luaL_checkudata(L, 1, LTIME_MT_DATETIME);
-	unsigned Y, M, D, h, m, s, us;
 	char buffer[42];
-	fromVMS(self->t, &Y, &M, &D, &h, &m, &s, &us);
-/*	if (us && us % 1000)
-		sprintf(buffer, "%04u-%02u-%02u %02u:%02u:%02u.%06u", Y, M, D, h, m, s, us);
-	else if (us)
-		sprintf(buffer, "%04u-%02u-%02u %02u:%02u:%02u.%03u", Y, M, D, h, m, s, us / 1000);
-	else //if (h || m || s)
-		sprintf(buffer, "%04u-%02u-%02u %02u:%02u:%02u", Y, M, D, h, m, s);
-//	else
-//		sprintf(buffer, "%04u-%02u-%02u", Y, M, D);
-*/
-
-	if (us)
-		snprintf(buffer, 40, "%04u-%02u-%02u %02u:%02u:%02u.%06u", Y, M, D, h, m, s, us);
-	else
-		snprintf(buffer, 40, "%04u-%02u-%02u %02u:%02u:%02u", Y, M, D, h, m, s);
-
-	lua_pushstring(L, buffer);
+	lua_pushlstring(L, buffer, timeToString(self->t, buffer));
 	return 1;
 }
 
@@ -657,6 +724,7 @@ int open_datetime(lua_State *L) {
 		
     static const luaL_Reg datetime_methods[] = {
 		{"format", datetime_format},
+		{"rfc3339", datetime_rfc3339},
 		{"clone", datetime_clone},
 		{"date", datetime_date},
 		{"time", datetime_time},
@@ -697,6 +765,10 @@ int open_datetime(lua_State *L) {
 
 	// create the library table
 	luaL_newlib(L, datetime_methods);
+	// http_date keeps its one second cache as upvalue
+	newHttpDateCache(L);
+	lua_pushcclosure(L, datetime_http_date, 1);
+	lua_setfield(L, -2, "http_date");
 	// and set the __index metamethod
 	lua_setfield(L, -2, "__index");
 	
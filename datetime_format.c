@@ -11,6 +11,42 @@ static char *weekdays[] = {"Monday", "Tuesday", "Wednesday", "Thursday", "Friday
 static char *abreviated_months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
 static char *months[] = {"January", "February", "March", "April", "May", "June", "July", "August", "September", "October", "November", "December"};
 
+/*
+ *  Write value as a decimal number, left padded with pad up to width characters
+ *  Return the number of characters written
+ */
+int writeUnsigned(char *buffer, unsigned long long value, int width, char pad) {
+
+	char digits[20];
+	int n = 0;
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	int length = 0;
+	while (width-- > n)
+		buffer[length++] = pad;
+	while (n)
+		buffer[length++] = digits[--n];
+	return length;
+}
+
+/*
+ *  Write hh:mm:ss, return the number of characters written (8)
+ */
+int writeTime(char *buffer, unsigned h, unsigned m, unsigned s) {
+
+	buffer[0] = '0' + h / 10 % 10;
+	buffer[1] = '0' + h % 10;
+	buffer[2] = ':';
+	buffer[3] = '0' + m / 10;
+	buffer[4] = '0' + m % 10;
+	buffer[5] = ':';
+	buffer[6] = '0' + s / 10;
+	buffer[7] = '0' + s % 10;
+	return 8;
+}
+
 /*
  *  %a -> The abreviated weekday in english
  */
@@ -18,7 +54,7 @@ static int format_a(char *buffer, long long t, unsigned Y, unsigned M, unsigned
 
 	int weekday = (t / 864000000000 + 2) % 7;
 	int length = strlen(abreviated_weekdays[weekday]);
-	strncpy(buffer, abreviated_weekdays[weekday], length);
+	memcpy(buffer, abreviated_weekdays[weekday], length);
 	return length;
 }
 
@@ -29,7 +65,7 @@ static int format_A(char *buffer, long long t, unsigned Y, unsigned M, unsigned
 
 	int weekday = (t / 864000000000 + 2) % 7;
 	int length = strlen(weekdays[weekday]);
-	strncpy(buffer, weekdays[weekday], length);
+	memcpy(buffer, weekdays[weekday], length);
 	return length;
 }
 
@@ -39,7 +75,7 @@ static int format_A(char *buffer, long long t, unsigned Y, unsigned M, unsigned
 static int format_b(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
 	int length = strlen(abreviated_months[M - 1]);
-	strncpy(buffer, abreviated_months[M - 1], length);
+	memcpy(buffer, abreviated_months[M - 1], length);
 	return length;
 }
 
@@ -49,7 +85,7 @@ static int format_b(char *buffer, long long t, unsigned Y, unsigned M, unsigned
 static int format_B(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
 	int length = strlen(months[M - 1]);
-	strncpy(buffer, months[M - 1], length);
+	memcpy(buffer, months[M - 1], length);
 	return length;
 }
 
@@ -58,8 +94,7 @@ static int format_B(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_C(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 3, "%02u", Y / 100);
-	return 2;
+	return writeUnsigned(buffer, Y / 100 % 100, 2, '0');
 }
 
 /*
@@ -67,8 +102,7 @@ static int format_C(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_d(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 3, "%02u", D);
-	return 2;
+	return writeUnsigned(buffer, D, 2, '0');
 }
 
 /*
@@ -76,7 +110,11 @@ static int format_d(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_D(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 9, "%02u/%02u/%02u", D, M, Y % 100);
+	writeUnsigned(buffer, D, 2, '0');
+	buffer[2] = '/';
+	writeUnsigned(&buffer[3], M, 2, '0');
+	buffer[5] = '/';
+	writeUnsigned(&buffer[6], Y % 100, 2, '0');
 	return 8;
 }
 
@@ -85,8 +123,7 @@ static int format_D(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_e(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 
-	snprintf(buffer, 3, "%2u", D);
-	return 2;
+	return writeUnsigned(buffer, D, 2, ' ');
 }
 
 /*
@@ -94,7 +131,11 @@ static int format_e(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_F(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 
-	snprintf(buffer, 11, "%04u-%02u-%02u", Y, M, D);
+	writeUnsigned(buffer, Y, 4, '0');
+	buffer[4] = '-';
+	writeUnsigned(&buffer[5], M, 2, '0');
+	buffer[7] = '-';
+	writeUnsigned(&buffer[8], D, 2, '0');
 	return 10;
 }
 
@@ -104,7 +145,7 @@ static int format_F(char *buffer, long long t, unsigned Y, unsigned M, unsigned
 static int format_h(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
 	int length = strlen(abreviated_months[M - 1]);
-	strncpy(buffer, abreviated_months[M - 1], length);
+	memcpy(buffer, abreviated_months[M - 1], length);
 	return length;
 }
 
@@ -113,8 +154,7 @@ static int format_h(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_H(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 3, "%02u", h);
-	return 2;
+	return writeUnsigned(buffer, h, 2, '0');
 }
 
 /*
@@ -126,8 +166,7 @@ static int format_I(char *buffer, long long t, unsigned Y, unsigned M, unsigned
 		h = h - 12;
 	if (h == 0)
 		h = 12;
-	snprintf(buffer, 3, "%02u", h);
-	return 2;
+	return writeUnsigned(buffer, h, 2, '0');
 }
 
 /*
@@ -135,8 +174,7 @@ static int format_I(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_j(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 4, "%03d", toMJD(Y, M, D) - toMJD(Y, 1, 1) + 1);
-	return 3;
+	return writeUnsigned(buffer, toMJD(Y, M, D) - toMJD(Y, 1, 1) + 1, 3, '0');
 }
 
 /*
@@ -144,8 +182,7 @@ static int format_j(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_k(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 3, "%2u", h);
-	return 2;
+	return writeUnsigned(buffer, h, 2, ' ');
 }
 
 /*
@@ -157,8 +194,7 @@ static int format_l(char *buffer, long long t, unsigned Y, unsigned M, unsigned
 		h = h - 12;
 	if (h == 0)
 		h = 12;
-	snprintf(buffer, 3, "%2u", h);
-	return 2;
+	return writeUnsigned(buffer, h, 2, ' ');
 }
 
 /*
@@ -166,8 +202,7 @@ static int format_l(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_m(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 3, "%02u", M);
-	return 2;
+	return writeUnsigned(buffer, M, 2, '0');
 }
 
 /*
@@ -175,8 +210,7 @@ static int format_m(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_M(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 3, "%02u", m);
-	return 2;
+	return writeUnsigned(buffer, m, 2, '0');
 }
 
 /*
@@ -223,8 +257,7 @@ static int format_P(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_q(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 4, "%03u", us / 1000);
-	return 3;
+	return writeUnsigned(buffer, us / 1000, 3, '0');
 }
 
 /*
@@ -232,8 +265,7 @@ static int format_q(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_Q(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 4, "%03u", us % 1000);
-	return 3;
+	return writeUnsigned(buffer, us % 1000, 3, '0');
 }
 
 /*
@@ -246,7 +278,10 @@ static int format_r(char *buffer, long long t, unsigned Y, unsigned M, unsigned
 		h = h - 12;
 	if (h == 0)
 		h = 12;
-	snprintf(buffer, 12, "%02u:%02u:%02u %s", h, m, s, p);
+	writeTime(buffer, h, m, s);
+	buffer[8] = ' ';
+	buffer[9] = p[0];
+	buffer[10] = p[1];
 	return 11;
 }
 
@@ -255,7 +290,9 @@ static int format_r(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_R(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 6, "%02u:%02u", h, m);
+	writeUnsigned(buffer, h, 2, '0');
+	buffer[2] = ':';
+	writeUnsigned(&buffer[3], m, 2, '0');
 	return 5;
 }
 
@@ -264,7 +301,13 @@ static int format_R(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_s(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	return snprintf(buffer, 24, "%lld", t - VMS_1970);
+	t -= VMS_1970;
+	long long seconds = t / 10000000LL - (t % 10000000LL < 0);	// rounded down, as read back by scanVMS
+	if (seconds < 0) {
+		buffer[0] = '-';
+		return 1 + writeUnsigned(&buffer[1], -seconds, 1, '0');
+	}
+	return writeUnsigned(buffer, seconds, 1, '0');
 }
 
 /*
@@ -272,8 +315,7 @@ static int format_s(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_S(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 3, "%02u", s);
-	return 2;
+	return writeUnsigned(buffer, s, 2, '0');
 }
 
 /*
@@ -290,8 +332,7 @@ static int format_t(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_T(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 9, "%02u:%02u:%02u", h, m, s);
-	return 8;
+	return writeTime(buffer, h, m, s);
 }
 
 /*
@@ -308,8 +349,18 @@ static int format_u(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_v(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 19, "0x%llX", t);
-	return 18;
+	static const char hex[] = "0123456789ABCDEF";
+	char digits[16];
+	int n = 0;
+	do {
+		digits[n++] = hex[t & 0xF];
+		t = (unsigned long long)t >> 4;
+	} while (t);
+	buffer[0] = '0';
+	buffer[1] = 'x';
+	for (int i = 0; i < n; i++)
+		buffer[2 + i] = digits[n - 1 - i];
+	return n + 2;
 }
 
 /*
@@ -317,7 +368,11 @@ static int format_v(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_x(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 11, "%04u-%02u-%02u", Y, M, D);
+	writeUnsigned(buffer, Y, 4, '0');
+	buffer[4] = '-';
+	writeUnsigned(&buffer[5], M, 2, '0');
+	buffer[7] = '-';
+	writeUnsigned(&buffer[8], D, 2, '0');
 	return 10;
 }
 
@@ -326,8 +381,7 @@ static int format_x(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_X(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 9, "%02u:%02u:%02u", h, m, s);
-	return 8;
+	return writeTime(buffer, h, m, s);
 }
 
 /*
@@ -335,8 +389,7 @@ static int format_X(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_y(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 3, "%02u", Y % 100);
-	return 2;
+	return writeUnsigned(buffer, Y % 100, 2, '0');
 }
 
 /*
@@ -344,8 +397,7 @@ static int format_y(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_Y(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 5, "%04u", Y);
-	return 4;
+	return writeUnsigned(buffer, Y, 4, '0');
 }
 
 /*
@@ -353,8 +405,7 @@ static int format_Y(char *buffer, long long t, unsigned Y, unsigned M, unsigned
  */
 static int format_dot(char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
 	
-	snprintf(buffer, 7, "%06u", us);
-	return 6;
+	return writeUnsigned(buffer, us, 6, '0');
 }
 
 /*
@@ -378,7 +429,7 @@ static t_spec specs[] = {
 	{'d', 2, format_d},
 	{'D', 8, format_D},
 	{'e', 2, format_e},
-	{'F', 10, format_F},
+	{'F', 11, format_F},
 	{'h', 3, format_h},
 	{'H', 2, format_H},
 	{'I', 2, format_I},
@@ -400,74 +451,561 @@ static t_spec specs[] = {
 	{'T', 8, format_T},
 	{'u', 1, format_u},
 	{'v', 18, format_v},
-	{'x', 10, format_x},
+	{'x', 11, format_x},
 	{'X', 8, format_X},
 	{'y', 2, format_y},
-	{'Y', 4, format_Y},
+	{'Y', 5, format_Y},
 	{'.', 6, format_dot},
 	{'%', 1, format_percent},
 	{0, 0, 0}
 };
 
 /*
- *  Compute the max possible length of the formated string
+ *  Lookup a conversion specifier character in specs[]
+ *  Return its index and set its maximum length, or return -1 if unknown
  */
-static int format_max_length(const char *format) {
-	
-	int	length = 0;
-	for (int i = 0; format[i]; i++) {
-		if (format[i] == '%' && format[i + 1] != '\0') {
-			int j;
-			for (j = 0; specs[j].c; j++) {
-				if (format[i + 1] == specs[j].c) {
-					length += specs[j].max_length;
-					break;
-				}
-			}
-			if (specs[j].c == 0) {
-				length += 2;
-			}
+int datetime_spec(char c, int *max_length) {
+
+	for (int j = 0; specs[j].c; j++) {
+		if (specs[j].c == c) {
+			*max_length = specs[j].max_length;
+			return j;
+		}
+	}
+	return -1;
+}
+
+/*
+ *  Number of bytes needed to compile a format string of the given length
+ */
+size_t formatMemorySize(size_t length) {
+
+	return sizeof(t_format) + (length + 1) * sizeof(t_format_op) + length + 1;
+}
+
+/*
+ *  Compile a format string into memory (at least formatMemorySize() bytes)
+ *  Conversions are resolved through lookup, literal text is merged into runs
+ *  Unknown conversions are kept as literal text
+ */
+t_format *compileFormat(void *memory, const char *format, size_t length, int (*lookup)(char, int *)) {
+
+	t_format *self = (t_format *)memory;
+	self->ops = (t_format_op *)(self + 1);
+	self->text = (char *)(self->ops + length + 1);
+	self->count = 0;
+	self->max_length = 0;
+	memcpy(self->text, format, length);
+	self->text[length] = '\0';
+	for (size_t i = 0; i < length; i++) {
+		int spec = -1, max_length = 0;
+		if (format[i] == '%' && i + 1 < length)
+			spec = lookup(format[i + 1], &max_length);
+		if (spec >= 0) {
+			t_format_op *op = &self->ops[self->count++];
+			op->spec = spec;
+			op->offset = i;
+			op->length = 0;
+			self->max_length += max_length;
 			i++;
+			continue;
+		}
+		// literal text, possibly an unknown conversion kept as is
+		int n = (format[i] == '%' && i + 1 < length) ? 2 : 1;
+		t_format_op *last = self->count ? &self->ops[self->count - 1] : NULL;
+		if (last && last->spec < 0 && last->offset + last->length == (int)i) {
+			last->length += n;
+		} else {
+			t_format_op *op = &self->ops[self->count++];
+			op->spec = -1;
+			op->offset = i;
+			op->length = n;
+		}
+		self->max_length += n;
+		i += n - 1;
+	}
+	return self;
+}
+
+/*
+ *  Render a VMS timestamp with a compiled format
+ *  buffer must hold at least format->max_length characters
+ *  Return the length of the formatted string (not null terminated)
+ */
+int formatVMS(const t_format *format, long long t, char *buffer) {
+
+	int cursor = 0;
+	unsigned Y, M, D, h, m, s, us;
+	fromVMS(t, &Y, &M, &D, &h, &m, &s, &us);
+	for (int i = 0; i < format->count; i++) {
+		const t_format_op *op = &format->ops[i];
+		if (op->spec >= 0) {
+			cursor += specs[op->spec].func(&buffer[cursor], t, Y, M, D, h, m, s, us);
 		} else {
-			length++;
+			memcpy(&buffer[cursor], &format->text[op->offset], op->length);
+			cursor += op->length;
 		}
 	}
+	return cursor;
+}
+
+/*
+ *  Write a single conversion of specs[] into buffer
+ *  Return the number of characters written
+ */
+int formatSpec(int spec, char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return specs[spec].func(buffer, t, Y, M, D, h, m, s, us);
+}
+
+/*
+ *  Does the conversion change within a second ?
+ */
+int datetime_spec_subsecond(int spec) {
+
+	return strchr("qQ.v", specs[spec].c) != NULL;
+}
+
+/*
+ *  Read 1 to width decimal digits into value
+ *  Return 0 if there is no digit at p
+ */
+static int scanUnsigned(const char **p, const char *end, int width, unsigned long long *value) {
+
+	const char *start = *p;
+	*value = 0;
+	while (*p < end && width-- && isdigit((unsigned char)**p))
+		*value = *value * 10 + (*(*p)++ - '0');
+	return *p > start;
+}
+
+/*
+ *  Match an english month name (abbreviated, or full when full is set), case insensitive
+ *  Return the month from 1 to 12, 0 if there is no match
+ */
+static unsigned scanMonth(const char **p, const char *end, int full) {
+
+	for (int i = 0; i < 12; i++) {
+		const char *name = full ? months[i] : abreviated_months[i];
+		size_t length = strlen(name), j = 0;
+		if ((size_t)(end - *p) < length)
+			continue;
+		while (j < length && tolower((unsigned char)(*p)[j]) == tolower((unsigned char)name[j]))
+			j++;
+		if (j == length) {
+			*p += length;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ *  Parse a string with a compiled format, the reverse of formatVMS()
+ *  The numeric conversions, month and weekday names, %p and %s are supported,
+ *  literal text must match exactly and surrounding white space is ignored
+ *  Pure C, safe to call from any thread
+ *  Return -1 if the string does not match the format or is not a valid datetime
+ */
+long long scanVMS(const t_format *format, const char *p, size_t length) {
+
+	unsigned long long Y = 0, M = 1, D = 1, h = 0, m = 0, s = 0, us = 0, v, unix = 0;
+	int pm = -1, has_unix = 0;
+	const char *end = p + length;
+	while (p < end && isspace((unsigned char)*p)) p++;
+	for (int i = 0; i < format->count; i++) {
+		const t_format_op *op = &format->ops[i];
+		if (op->spec < 0) {
+			if (end - p < op->length || memcmp(p, &format->text[op->offset], op->length))
+				return -1;
+			p += op->length;
+			continue;
+		}
+		int ok = 1;
+		switch (specs[op->spec].c) {
+			case 'Y': ok = scanUnsigned(&p, end, 4, &Y); break;
+			case 'y': ok = scanUnsigned(&p, end, 2, &Y); Y += Y < 69 ? 2000 : 1900; break;
+			case 'm': ok = scanUnsigned(&p, end, 2, &M); break;
+			case 'e': if (p < end && *p == ' ') p++;	// fall through
+			case 'd': ok = scanUnsigned(&p, end, 2, &D); break;
+			case 'k': if (p < end && *p == ' ') p++;	// fall through
+			case 'H': ok = scanUnsigned(&p, end, 2, &h); break;
+			case 'l': if (p < end && *p == ' ') p++;	// fall through
+			case 'I': ok = scanUnsigned(&p, end, 2, &h); pm = pm < 0 ? 0 : pm; break;
+			case 'M': ok = scanUnsigned(&p, end, 2, &m); break;
+			case 'S': ok = scanUnsigned(&p, end, 2, &s); break;
+			case 'q': ok = scanUnsigned(&p, end, 3, &v); us += v * 1000; break;
+			case 'Q': ok = scanUnsigned(&p, end, 3, &v); us += v; break;
+			case '.': {
+				const char *start = p;
+				ok = scanUnsigned(&p, end, 6, &us);
+				for (int n = 6 - (p - start); n > 0; n--) us *= 10;	// right pad
+				break;
+			}
+			case 's': ok = scanUnsigned(&p, end, 12, &unix); has_unix = 1; break;
+			case 'F':
+				ok = scanUnsigned(&p, end, 4, &Y) && p < end && *p++ == '-'
+					&& scanUnsigned(&p, end, 2, &M) && p < end && *p++ == '-'
+					&& scanUnsigned(&p, end, 2, &D);
+				break;
+			case 'R':
+			case 'T':
+				ok = scanUnsigned(&p, end, 2, &h) && p < end && *p++ == ':'
+					&& scanUnsigned(&p, end, 2, &m);
+				if (ok && specs[op->spec].c == 'T')
+					ok = p < end && *p++ == ':' && scanUnsigned(&p, end, 2, &s);
+				break;
+			case 'b':
+			case 'h': ok = (M = scanMonth(&p, end, 0)) != 0; break;
+			case 'B': ok = (M = scanMonth(&p, end, 1)) != 0; break;
+			case 'a':
+			case 'A':	// weekdays carry no information, skip the name
+				ok = p < end && isalpha((unsigned char)*p);
+				while (p < end && isalpha((unsigned char)*p)) p++;
+				break;
+			case 'p':
+			case 'P':
+				ok = end - p >= 2 && (p[1] == 'M' || p[1] == 'm');
+				if (ok) {
+					if (*p == 'P' || *p == 'p')
+						pm = 1;
+					else if (*p == 'A' || *p == 'a')
+						pm = pm < 0 ? 0 : pm;
+					else
+						ok = 0;
+					p += 2;
+				}
+				break;
+			case 'n':
+			case 't': while (p < end && isspace((unsigned char)*p)) p++; break;
+			case '%': ok = p < end && *p++ == '%'; break;
+			default: ok = 0;	// conversions that cannot be read back
+		}
+		if (!ok)
+			return -1;
+	}
+	while (p < end && isspace((unsigned char)*p)) p++;
+	if (p != end)
+		return -1;
+	if (has_unix)	// up to 9999-12-31 23:59:59, as for the calendar fields
+		return us > 999999 || unix > 253402300799ULL ? -1 : VMS_1970 + (long long)unix * 10000000LL + (long long)us * 10;
+	if (pm >= 0) {
+		if (h < 1 || h > 12)
+			return -1;
+		h = h % 12 + (pm ? 12 : 0);
+	}
+	if (Y > 9999 || M > 12 || D > 31 || h > 23 || m > 59 || s > 59 || us > 999999)
+		return -1;
+	return toVMS(Y, M, D, h, m, s, us);
+}
+
+/*
+ *  Format argument at index: either a compiled Ltime.Format or a format string
+ *  A string is compiled into memory, which must hold formatMemorySize(length) bytes
+ *  (length as returned by formatArgumentLength)
+ */
+size_t formatArgumentLength(lua_State *L, int index, const char *mt) {
+
+	size_t length = 0;
+	if (luaL_testudata(L, index, mt))
+		return 0;
+	if (lua_type(L, index) != LUA_TSTRING)
+		luaL_error(L, LTIME_ERR_DATETIME_MISSING_FORMAT);
+	lua_tolstring(L, index, &length);
 	return length;
 }
 
+t_format *formatArgument(lua_State *L, int index, const char *mt, void *memory, int (*lookup)(char, int *)) {
+
+	t_format *format = (t_format *)luaL_testudata(L, index, mt);
+	if (format)
+		return format;
+	size_t length;
+	const char *string = lua_tolstring(L, index, &length);
+	return compileFormat(memory, string, length, lookup);
+}
+
 /*
  *  string = Time:format(format_string)
+ *  string = Time:format(Format)
  */
 int datetime_format(lua_State *L) {
 
 	t_datetime *self = (t_datetime *)luaL_checkudata(L, 1, LTIME_MT_DATETIME);
-	if (lua_gettop(L) == 1 || lua_type(L, 2) != LUA_TSTRING)
-		luaL_error(L, LTIME_ERR_DATETIME_MISSING_FORMAT);
-	const char *format = lua_tostring(L, 2);
-	//printf("Format max length: %d\n", format_max_length(format));
-	char buffer[format_max_length(format) + 1];
-	int cursor = 0;
+	size_t length = formatArgumentLength(L, 2, LTIME_MT_FORMAT);
+	long long memory[formatMemorySize(length) / sizeof(long long) + 1];
+	t_format *format = formatArgument(L, 2, LTIME_MT_FORMAT, memory, datetime_spec);
+	char buffer[format->max_length + 1];
+	STAT(TIME_FORMAT);
+	PROBE1(format_entry, (long)length);
+	STAT_BEGIN(start);
+	int cursor = formatVMS(format, self->t, buffer);
+	STAT_END(TIME_FORMAT, start);
+	PROBE1(format_return, cursor);
+	lua_pushlstring(L, buffer, cursor);
+	return 1;
+}
+
+/*
+ *  HTTP date cache: the last rendered second and its text
+ */
+typedef struct s_http_date_cache {
+	long long	second;
+	char		text[29];
+} t_http_date_cache;
+
+/*
+ *  Preferred HTTP date format (RFC 7231 IMF-fixdate)
+ *  Consecutive calls within the same second return the cached string
+ *  Years after 9999 have no 4 digit representation and raise an error
+ *  string = Time:http_date()
+ */
+int datetime_http_date(lua_State *L) {
+
+	t_datetime *self = (t_datetime *)luaL_checkudata(L, 1, LTIME_MT_DATETIME);
+	if (self->t < 0 || self->t >= 2973484LL * 864000000000LL)	// 10000-01-01
+		luaL_error(L, LTIME_ERR_DATETIME_OUT_OF_RANGE);
+	t_http_date_cache *cache = (t_http_date_cache *)lua_touserdata(L, lua_upvalueindex(1));
+	long long second = self->t / 10000000LL;
+	if (second != cache->second) {
+		unsigned Y, M, D, h, m, s, us;
+		char *p = cache->text;
+		fromVMS(self->t, &Y, &M, &D, &h, &m, &s, &us);
+		memcpy(p, abreviated_weekdays[(self->t / 864000000000LL + 2) % 7], 3);
+		p[3] = ',';
+		p[4] = ' ';
+		writeUnsigned(&p[5], D, 2, '0');
+		p[7] = ' ';
+		memcpy(&p[8], abreviated_months[M - 1], 3);
+		p[11] = ' ';
+		writeUnsigned(&p[12], Y, 4, '0');
+		p[16] = ' ';
+		writeTime(&p[17], h, m, s);
+		memcpy(&p[25], " GMT", 4);
+		cache->second = second;
+	}
+	lua_pushlstring(L, cache->text, 29);
+	return 1;
+}
+
+/*
+ *  Push the cache used by Time:http_date()
+ */
+void newHttpDateCache(lua_State *L) {
+
+	t_http_date_cache *cache = (t_http_date_cache *)lua_newuserdata(L, sizeof(t_http_date_cache));
+	cache->second = -1;
+}
+
+/*
+ *  RFC 3339 timestamp in UTC, with digits (0 to 7, default 0) fraction digits
+ *  string = Time:rfc3339([digits])
+ */
+int datetime_rfc3339(lua_State *L) {
+
+	t_datetime *self = (t_datetime *)luaL_checkudata(L, 1, LTIME_MT_DATETIME);
+	lua_Integer digits = luaL_optinteger(L, 2, 0);
+	if (digits < 0 || digits > 7)
+		luaL_error(L, LTIME_ERR_RFC3339_DIGITS);
 	unsigned Y, M, D, h, m, s, us;
+	char buffer[40];
 	fromVMS(self->t, &Y, &M, &D, &h, &m, &s, &us);
-	for (int i = 0; format[i]; i++) {
-		if (format[i] == '%' && format[i + 1] != '\0') {
-			int j;
-			for (j = 0; specs[j].c; j++) {
-				if (format[i + 1] == specs[j].c) {
-					cursor += specs[j].func(&buffer[cursor], self->t, Y, M, D, h, m, s, us);
-					break;
-				}
-			}
-			if (specs[j].c == 0) {
-				strncpy(&buffer[cursor], &format[i], 2);
-				cursor += 2;
-			}
-			i++;
-		} else {
-			buffer[cursor++] = format[i];
+	int cursor = writeUnsigned(buffer, Y, 4, '0');
+	buffer[cursor++] = '-';
+	cursor += writeUnsigned(&buffer[cursor], M, 2, '0');
+	buffer[cursor++] = '-';
+	cursor += writeUnsigned(&buffer[cursor], D, 2, '0');
+	buffer[cursor++] = 'T';
+	cursor += writeTime(&buffer[cursor], h, m, s);
+	if (digits) {
+		unsigned long long fraction = self->t % 10000000LL;
+		for (int n = 7; n > digits; n--)
+			fraction /= 10;
+		buffer[cursor++] = '.';
+		cursor += writeUnsigned(&buffer[cursor], fraction, digits, '0');
+	}
+	buffer[cursor++] = 'Z';
+	lua_pushlstring(L, buffer, cursor);
+	return 1;
+}
+
+/*
+ *  Read exactly n digits
+ *  Return -1 if there are not n digits at p
+ */
+static long long readDigits(const char **p, const char *end, int n) {
+
+	long long value = 0;
+	if (end - *p < n)
+		return -1;
+	for (int i = 0; i < n; i++) {
+		if (!isdigit((unsigned char)(*p)[i]))
+			return -1;
+		value = value * 10 + ((*p)[i] - '0');
+	}
+	*p += n;
+	return value;
+}
+
+/*
+ *  Match the character c at p
+ */
+static int readChar(const char **p, const char *end, char c) {
+
+	if (*p >= end || **p != c)
+		return 0;
+	(*p)++;
+	return 1;
+}
+
+/*
+ *  Parse an HTTP date: IMF-fixdate, obsolete RFC 850 or asctime format
+ *  Return -1 if the string is not a valid HTTP date
+ */
+long long parseHttpDate(const char *p, size_t length) {
+
+	const char *end = p + length;
+	long long Y, M, D, h, m, s;
+	while (p < end && isalpha((unsigned char)*p))
+		p++;
+	if (readChar(&p, end, ',')) {
+		// Sun, 06 Nov 1994 08:49:37 GMT or Sunday, 06-Nov-94 08:49:37 GMT
+		if (!readChar(&p, end, ' ') || (D = readDigits(&p, end, 2)) < 0)
+			return -1;
+		char sep = p < end ? *p : 0;
+		if ((sep != ' ' && sep != '-') || !readChar(&p, end, sep) || !(M = scanMonth(&p, end, 0))
+			|| !readChar(&p, end, sep))
+			return -1;
+		if (sep == ' ') {
+			Y = readDigits(&p, end, 4);
+		} else if ((Y = readDigits(&p, end, 2)) >= 0) {
+			Y += Y < 70 ? 2000 : 1900;
 		}
+		if (Y < 0 || !readChar(&p, end, ' ') || (h = readDigits(&p, end, 2)) < 0 || !readChar(&p, end, ':')
+			|| (m = readDigits(&p, end, 2)) < 0 || !readChar(&p, end, ':') || (s = readDigits(&p, end, 2)) < 0
+			|| end - p != 4 || memcmp(p, " GMT", 4))
+			return -1;
+	} else {
+		// Sun Nov  6 08:49:37 1994
+		if (!readChar(&p, end, ' ') || !(M = scanMonth(&p, end, 0)) || !readChar(&p, end, ' '))
+			return -1;
+		readChar(&p, end, ' ');
+		const char *start = p;
+		D = 0;
+		while (p < end && p - start < 2 && isdigit((unsigned char)*p))
+			D = D * 10 + (*p++ - '0');
+		if (p == start || !readChar(&p, end, ' ') || (h = readDigits(&p, end, 2)) < 0 || !readChar(&p, end, ':')
+			|| (m = readDigits(&p, end, 2)) < 0 || !readChar(&p, end, ':') || (s = readDigits(&p, end, 2)) < 0
+			|| !readChar(&p, end, ' ') || (Y = readDigits(&p, end, 4)) < 0 || p != end)
+			return -1;
+	}
+	return toVMS(Y, M, D, h, m, s, 0);
+}
+
+/*
+ *  Parse an RFC 3339 timestamp, the offset is applied to return UTC
+ *  Fractions are read up to the 100ns tick, further digits are ignored
+ *  Return -1 if the string is not a valid RFC 3339 timestamp
+ */
+long long parseRfc3339(const char *p, size_t length) {
+
+	const char *end = p + length;
+	long long Y, M, D, h, m, s, fraction = 0, offset = 0;
+	if ((Y = readDigits(&p, end, 4)) < 0 || !readChar(&p, end, '-') || (M = readDigits(&p, end, 2)) < 0
+		|| !readChar(&p, end, '-') || (D = readDigits(&p, end, 2)) < 0)
+		return -1;
+	if (!readChar(&p, end, 'T') && !readChar(&p, end, 't') && !readChar(&p, end, ' '))
+		return -1;
+	if ((h = readDigits(&p, end, 2)) < 0 || !readChar(&p, end, ':') || (m = readDigits(&p, end, 2)) < 0
+		|| !readChar(&p, end, ':') || (s = readDigits(&p, end, 2)) < 0)
+		return -1;
+	if (readChar(&p, end, '.')) {
+		int n = 0;
+		if (p >= end || !isdigit((unsigned char)*p))
+			return -1;
+		for (; p < end && isdigit((unsigned char)*p); p++, n++)
+			if (n < 7)
+				fraction = fraction * 10 + (*p - '0');
+		for (; n < 7; n++)
+			fraction *= 10;
 	}
-	buffer[cursor] = '\0';
-	lua_pushstring(L, buffer);
+	if (!readChar(&p, end, 'Z') && !readChar(&p, end, 'z')) {
+		int sign = p < end && *p == '-' ? -1 : 1;
+		long long oh, om;
+		if ((!readChar(&p, end, '+') && !readChar(&p, end, '-')) || (oh = readDigits(&p, end, 2)) < 0
+			|| !readChar(&p, end, ':') || (om = readDigits(&p, end, 2)) < 0 || oh > 23 || om > 59)
+			return -1;
+		offset = sign * (oh * 60 + om) * 600000000LL;
+	}
+	long long t = p == end ? toVMS(Y, M, D, h, m, s, 0) : -1;
+	if (t < 0 || t + fraction - offset < 0)
+		return -1;
+	return t + fraction - offset;
+}
+
+/*
+ *  Time = Ltime.parse_http_date(string)
+ *  Return nil if the string is not a valid HTTP date
+ */
+int datetime_parse_http_date(lua_State *L) {
+
+	size_t length;
+	const char *p = luaL_checklstring(L, 1, &length);
+	long long t = parseHttpDate(p, length);
+	if (t < 0)
+		return 0;
+	newDatetime(L)->t = t;
+	return 1;
+}
+
+/*
+ *  Time = Ltime.parse_rfc3339(string)
+ *  Return nil if the string is not a valid RFC 3339 timestamp
+ */
+int datetime_parse_rfc3339(lua_State *L) {
+
+	size_t length;
+	const char *p = luaL_checklstring(L, 1, &length);
+	long long t = parseRfc3339(p, length);
+	if (t < 0)
+		return 0;
+	newDatetime(L)->t = t;
+	return 1;
+}
+
+/*
+ *  Format = Ltime.Format(format_string)
+ *  Compile a format string once, for repeated use with Time:format()
+ */
+int format_new(lua_State *L) {
+
+	size_t length;
+	const char *string = luaL_checklstring(L, 1, &length);
+	void *memory = lua_newuserdata(L, formatMemorySize(length));
+	compileFormat(memory, string, length, datetime_spec);
+	luaL_setmetatable(L, LTIME_MT_FORMAT);
+	return 1;
+}
+
+/*
+ *  Format:__tostring()
+ *  Return the source format string
+ */
+int format_tostring(lua_State *L) {
+
+	t_format *self = (t_format *)lua_touserdata(L, 1);
+	lua_pushstring(L, self->text);
+	return 1;
+}
+
+int open_format(lua_State *L) {
+
+	static const luaL_Reg format_meta_methods[] = {
+		{"__tostring", format_tostring},
+		{NULL, NULL}
+	};
+
+	luaL_newmetatable(L, LTIME_MT_FORMAT);
+	luaL_setfuncs(L, format_meta_methods, 0);
 	return 1;
 }
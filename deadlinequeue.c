@@ -0,0 +1,322 @@
+#include "ltime.h"
+
+/*
+ *  Deadline priority queue
+ *
+ *  A binary min-heap of packed deadlines, ordered by deadline then by
+ *  insertion order. Each entry has a stable id whose position tracks where
+ *  the entry sits in the heap, so update() and remove() find it in O(1) and
+ *  restore the heap in O(log n). The Lua values attached to the entries live
+ *  in the uservalue table, keyed by id.
+ */
+
+typedef struct s_deadline {
+	long long	t;		/* VMS timestamp */
+	long long	seq;	/* insertion order, breaks deadline ties */
+	int			id;
+} t_deadline;
+
+typedef struct s_entry {
+	int			position;	/* index in the heap, -1 when the entry is free */
+	int			next;		/* free list link */
+	unsigned	generation;	/* bumped on release, invalidates old handles */
+} t_entry;
+
+typedef struct s_deadlinequeue {
+	t_deadline	*heap;
+	t_entry		*entries;
+	int			count;
+	int			capacity;
+	int			free;		/* free list head */
+	long long	seq;
+} t_deadlinequeue;
+
+#define isDeadlineQueue(L, i) ((t_deadlinequeue *)luaL_checkudata(L, i, LTIME_MT_DEADLINEQUEUE))
+
+static int before(const t_deadline *a, const t_deadline *b) {
+
+	return a->t < b->t || (a->t == b->t && a->seq < b->seq);
+}
+
+/*
+ *  Store d at heap index k and update its position
+ */
+static void put(t_deadlinequeue *self, int k, const t_deadline *d) {
+
+	self->heap[k] = *d;
+	self->entries[d->id].position = k;
+}
+
+static void siftUp(t_deadlinequeue *self, int k) {
+
+	t_deadline d = self->heap[k];
+	while (k > 0) {
+		int parent = (k - 1) / 2;
+		if (!before(&d, &self->heap[parent]))
+			break;
+		put(self, k, &self->heap[parent]);
+		k = parent;
+	}
+	put(self, k, &d);
+}
+
+static void siftDown(t_deadlinequeue *self, int k) {
+
+	t_deadline d = self->heap[k];
+	for (;;) {
+		int child = 2 * k + 1;
+		if (child >= self->count)
+			break;
+		if (child + 1 < self->count && before(&self->heap[child + 1], &self->heap[child]))
+			child++;
+		if (!before(&self->heap[child], &d))
+			break;
+		put(self, k, &self->heap[child]);
+		k = child;
+	}
+	put(self, k, &d);
+}
+
+/*
+ *  Take the entry at heap index k out of the heap and free its id
+ *  The value table must be at the top of the stack, the value is pushed above it
+ */
+static void removeAt(lua_State *L, t_deadlinequeue *self, int k) {
+
+	int id = self->heap[k].id;
+	t_entry *entry = &self->entries[id];
+	entry->position = -1;
+	entry->generation++;
+	entry->next = self->free;
+	self->free = id;
+	if (k != --self->count) {
+		// move the last entry into the hole, then restore the heap either way
+		put(self, k, &self->heap[self->count]);
+		if (k > 0 && before(&self->heap[k], &self->heap[(k - 1) / 2]))
+			siftUp(self, k);
+		else
+			siftDown(self, k);
+	}
+	lua_rawgeti(L, -1, id + 1);
+	lua_pushnil(L);
+	lua_rawseti(L, -3, id + 1);
+}
+
+/*
+ *  Resolve a handle to an entry id, -1 if it expired or was removed
+ */
+static int handleToId(t_deadlinequeue *self, long long handle) {
+
+	long long id = (handle & 0xFFFFFFFFLL) - 1;
+	if (id < 0 || id >= self->capacity || self->entries[id].position < 0
+		|| self->entries[id].generation != (unsigned)((unsigned long long)handle >> 32))
+		return -1;
+	return id;
+}
+
+/*
+ *  DeadlineQueue = Ltime.DeadlineQueue()
+ */
+int deadlinequeue_new(lua_State *L) {
+
+	t_deadlinequeue *self = (t_deadlinequeue *)lua_newuserdata(L, sizeof(t_deadlinequeue));
+	memset(self, 0, sizeof(t_deadlinequeue));
+	self->free = -1;
+	luaL_setmetatable(L, LTIME_MT_DEADLINEQUEUE);
+	lua_newtable(L);
+	lua_setuservalue(L, -2);
+	return 1;
+}
+
+/*
+ *  Queue value with deadline t
+ *  handle = DeadlineQueue:push(t, value)
+ */
+static int deadlinequeue_push(lua_State *L) {
+
+	t_deadlinequeue *self = isDeadlineQueue(L, 1);
+	long long t = timeArgument(L, 2);
+	luaL_checkany(L, 3);
+	if (self->free < 0) {
+		int capacity = self->capacity ? self->capacity * 2 : 64;
+		t_deadline *heap = realloc(self->heap, capacity * sizeof(t_deadline));
+		if (!heap)
+			luaL_error(L, LTIME_ERR_OUT_OF_MEMORY);
+		self->heap = heap;
+		t_entry *entries = realloc(self->entries, capacity * sizeof(t_entry));
+		if (!entries)
+			luaL_error(L, LTIME_ERR_OUT_OF_MEMORY);
+		self->entries = entries;
+		for (int i = capacity - 1; i >= self->capacity; i--) {
+			entries[i].position = -1;
+			entries[i].generation = 0;
+			entries[i].next = self->free;
+			self->free = i;
+		}
+		self->capacity = capacity;
+	}
+	int id = self->free;
+	self->free = self->entries[id].next;
+	t_deadline d = {t, self->seq++, id};
+	put(self, self->count++, &d);
+	siftUp(self, self->count - 1);
+	lua_getuservalue(L, 1);
+	lua_pushvalue(L, 3);
+	lua_rawseti(L, -2, id + 1);
+	lua_pushinteger(L, (lua_Integer)(((unsigned long long)self->entries[id].generation << 32) | (id + 1)));
+	return 1;
+}
+
+/*
+ *  Earliest deadline and its value, without removing it
+ *  Return nothing when the queue is empty
+ *  Time, value = DeadlineQueue:peek()
+ */
+static int deadlinequeue_peek(lua_State *L) {
+
+	t_deadlinequeue *self = isDeadlineQueue(L, 1);
+	if (self->count == 0)
+		return 0;
+	newDatetime(L)->t = self->heap[0].t;
+	lua_getuservalue(L, 1);
+	lua_rawgeti(L, -1, self->heap[0].id + 1);
+	lua_remove(L, -2);
+	return 2;
+}
+
+/*
+ *  Remove the earliest deadline
+ *  Return nothing when the queue is empty
+ *  Time, value = DeadlineQueue:pop()
+ */
+static int deadlinequeue_pop(lua_State *L) {
+
+	t_deadlinequeue *self = isDeadlineQueue(L, 1);
+	if (self->count == 0)
+		return 0;
+	newDatetime(L)->t = self->heap[0].t;
+	lua_getuservalue(L, 1);
+	removeAt(L, self, 0);
+	lua_remove(L, -2);
+	return 2;
+}
+
+/*
+ *  Remove all the deadlines up to now (default current time)
+ *  Return their values in deadline order
+ *  table = DeadlineQueue:pop_until([now])
+ */
+static int deadlinequeue_pop_until(lua_State *L) {
+
+	t_deadlinequeue *self = isDeadlineQueue(L, 1);
+	long long now = timeArgument(L, 2);
+	lua_newtable(L);
+	lua_getuservalue(L, 1);
+	for (int n = 1; self->count > 0 && self->heap[0].t <= now; n++) {
+		removeAt(L, self, 0);
+		lua_rawseti(L, -3, n);
+	}
+	lua_pop(L, 1);
+	return 1;
+}
+
+/*
+ *  Move a queued deadline to t
+ *  Return false if the handle was already popped or removed
+ *  boolean = DeadlineQueue:update(handle, t)
+ */
+static int deadlinequeue_update(lua_State *L) {
+
+	t_deadlinequeue *self = isDeadlineQueue(L, 1);
+	int id = handleToId(self, luaL_checkinteger(L, 2));
+	long long t = timeArgument(L, 3);
+	if (id < 0) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	int k = self->entries[id].position;
+	long long old = self->heap[k].t;
+	self->heap[k].t = t;
+	if (t < old)
+		siftUp(self, k);
+	else
+		siftDown(self, k);
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/*
+ *  Remove a queued deadline
+ *  Return false if the handle was already popped or removed
+ *  boolean = DeadlineQueue:remove(handle)
+ */
+static int deadlinequeue_remove(lua_State *L) {
+
+	t_deadlinequeue *self = isDeadlineQueue(L, 1);
+	int id = handleToId(self, luaL_checkinteger(L, 2));
+	if (id < 0) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	lua_getuservalue(L, 1);
+	removeAt(L, self, self->entries[id].position);
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/*
+ *  Number of queued deadlines
+ *  count = DeadlineQueue:count()
+ */
+static int deadlinequeue_count(lua_State *L) {
+
+	t_deadlinequeue *self = isDeadlineQueue(L, 1);
+	lua_pushinteger(L, self->count);
+	return 1;
+}
+
+/*
+ *  DeadlineQueue:__gc()
+ */
+static int deadlinequeue_gc(lua_State *L) {
+
+	t_deadlinequeue *self = isDeadlineQueue(L, 1);
+	free(self->heap);
+	free(self->entries);
+	self->heap = NULL;
+	self->entries = NULL;
+	self->count = self->capacity = 0;
+	return 0;
+}
+
+int open_deadlinequeue(lua_State *L) {
+
+	static const luaL_Reg deadlinequeue_methods[] = {
+		{"push", deadlinequeue_push},
+		{"peek", deadlinequeue_peek},
+		{"pop", deadlinequeue_pop},
+		{"pop_until", deadlinequeue_pop_until},
+		{"update", deadlinequeue_update},
+		{"remove", deadlinequeue_remove},
+		{"count", deadlinequeue_count},
+		{NULL, NULL}
+	};
+
+	static const luaL_Reg deadlinequeue_meta_methods[] = {
+		{"__len", deadlinequeue_count},
+		{"__gc", deadlinequeue_gc},
+		{NULL, NULL}
+	};
+
+	// create the metatable first
+	luaL_newmetatable(L, LTIME_MT_DEADLINEQUEUE);
+	// and set all metamethods except __index
+	luaL_setfuncs(L, deadlinequeue_meta_methods, 0);
+
+	// create the library table
+	luaL_newlib(L, deadlinequeue_methods);
+	// and set the __index metamethod
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}
@@ -1,4 +1,5 @@
 #include "ltime.h"
+#include <limits.h>
 /*
  * 2014-01-28	__eq/le/lt and parameterToEpoch fixed.... big time...
  */
@@ -13,10 +14,121 @@
 t_epoch *newEpoch(lua_State *L) {
 	t_epoch *self = (t_epoch *)lua_newuserdata(L, sizeof(t_epoch));
 	luaL_setmetatable(L, LTIME_MT_EPOCH);
+	STAT(EPOCH_ALLOC);
 	return self;
 }
 
+/*
+ * Destination of a getter: the Epoch object at index if there is one,
+ * otherwise a new one
+ * - leave the object on top of the stack
+ */
+t_epoch *destEpoch(lua_State *L, int index) {
+	if (lua_isnoneornil(L, index))
+		return newEpoch(L);
+	t_epoch *self = (t_epoch *)luaL_checkudata(L, index, LTIME_MT_EPOCH);
+	lua_pushvalue(L, index);
+	return self;
+}
+
+
+
+/*
+ *  Duration string to 100 nanosecond ticks: ISO 8601 duration or [D ]h:m[:s[.us]]
+ *  Pure C, safe to call from any thread
+ *  Return 0 if the string is not a valid duration
+ */
+int parseTicks(const char *p, long long *t) {
+
+	// Relaxed version.... more like MySQL. And hopefully fast.
+	unsigned int D = 0, h = 0, m = 0, s = 0, us = 0;
+	int sign = 1;
+	register int n;
+
+	while (*p && isspace(*p)) p++;		// skip leading spaces
+	if (!*p) return 0;
+	if (*p=='+') p++;					// optional sign
+	else if (*p=='-') { sign = -1; p++; };
+
+	if (*p=='P') {						// ISO 8601 duration P[nW][nD][T[nH][nM][n[.f]S]]
+		static const char designators[] = "WDHMS";
+		static const long long units[] = { 7 * 864000000000LL, 864000000000LL, 36000000000LL, 600000000LL, 10000000LL };
+		long long total = 0;
+		int time = 0, last = -1;
+		p++;
+		while (*p) {
+			long long value = 0, fraction = 0;
+			if (*p=='T') {					// once, and followed by a time part
+				if (time || !p[1]) return 0;
+				time = 1;
+				p++;
+				continue;
+			}
+			if (!isdigit(*p)) return 0;
+			n = 9;
+			while (*p && isdigit(*p) && n--) value=value*10+(*p++ -'0');
+			if (time && (*p=='.' || *p==',')) {	// fractional seconds, down to the tick
+				p++;
+				n = 7;
+				while (*p && isdigit(*p) && n--) fraction=fraction*10+(*p++ -'0');
+				while (n-- > 0) fraction=fraction*10; // right pad
+				while (*p && isdigit(*p)) p++;		// ignore below tick precision
+				if (*p!='S') return 0;
+			}
+			// years and months have no fixed length, designators in order and at most once
+			const char *d = *p ? strchr(designators, *p) : NULL;
+			if (!d) return 0;
+			int k = d - designators;
+			if ((k >= 2) != time || k <= last) return 0;
+			if (value > (LLONG_MAX - total - fraction) / units[k]) return 0;
+			total += value * units[k] + fraction;
+			last = k;
+			p++;
+		}
+		if (last < 0) return 0;
+		*t = sign * total;
+		return 1;
+	}
+
+	n = 9;								// up to 9 digits allowed for days (below 2^32)
+	while (*p && isdigit(*p) && n--) D=D*10+(*p++ -'0');
+	if (!*p) return 0;
+
+	if (isspace(*p)) {					// space separator: D was really D and not h
+		p++;
+		// need to do hours now
+		n = 9;							// up to 9 digits allowed for hours (below 2^32)
+		while (*p && isdigit(*p) && n--) h=h*10+(*p++ -'0');
+		if (!*p) return 0;
+	}
+	else {								// other separator, number was probably hours
+		h = D; D = 0;
+	}
 
+	// now looking at the colon preceding the mandatory minutes
+	if (*p!=':') return 0;
+	p++; 
+	n = 2; // minutes have 1 or 2 digits
+	while (*p && isdigit(*p) && n--) m=m*10+(*p++ -'0');
+	//if (n==2) return 0;
+	if (*p) {							// if anything follows, must be a colon
+		if (*p!=':') return 0;
+		p++;
+		n = 2; 							// seconds
+		while (*p && isdigit(*p) && n--) s=s*10+(*p++ -'0');
+		// now look at optional fractional seconds
+		if (*p) {
+			if (*p!='.') return 0;
+			p++;
+			n=6;
+			while (*p && isdigit(*p) && n--) us=us*10+(*p++ -'0');
+			while (n-- > 0) us=us*10; // right pad
+		}
+	}
+
+	*t = sign * (((((long long)D * 24 + h) * 60 + m) * 60 + s) * (long long)1e6 + us) * 10;
+	return 1;
+}
 
 /*
  *  Lua parameter at index to 100 nanosecond ticks
@@ -29,6 +141,7 @@ long long parameterToTicks(lua_State *L, int index) {
 	}
 	/* Parameter is a number, considered number of seconds */
 	else if (ltype == LUA_TNUMBER) {
+		STAT(EPOCH_NUMBER);
 		// Must do this below to avoid pathological truncation errors....
 		lua_Number x = lua_tonumber(L, index) * 1e7;
 		x += x>0 ? .5 : -.5;
@@ -36,63 +149,18 @@ long long parameterToTicks(lua_State *L, int index) {
 	}
 	/* Parameter is a string, considered deltatime string */
 	else if (ltype == LUA_TSTRING) {
-		// Relaxed version.... more like MySQL. And hopefully fast.
-		unsigned int D = 0, h = 0, m = 0, s = 0, us = 0;
-		int sign = 1;
-		register int n;
-		char *p = (char *)lua_tostring(L, index);
-
-		while (*p && isspace(*p)) p++;		// skip leading spaces
-		if (!*p) goto fail;
-		if (*p=='+') p++;					// optional sign
-		else if (*p=='-') { sign = -1; p++; };
-
-		n = 9;								// up to 9 digits allowed for days (below 2^32)
-		while (*p && isdigit(*p) && n--) D=D*10+(*p++ -'0');
-		if (!*p) goto fail;
-
-		if (isspace(*p)) {					// space separator: D was really D and not h
-			p++;
-			// need to do hours now
-			n = 9;							// up to 9 digits allowed for hours (below 2^32)
-			while (*p && isdigit(*p) && n--) h=h*10+(*p++ -'0');
-			if (!*p) goto fail;
-		}
-		else {								// other separator, number was probably hours
-			h = D; D = 0;
-		}
-
-		// now looking at the colon preceding the mandatory minutes
-		if (*p!=':') goto fail;
-		p++; 
-		n = 2; // minutes have 1 or 2 digits
-		while (*p && isdigit(*p) && n--) m=m*10+(*p++ -'0');
-		//if (n==2) goto fail;
-		if (*p) {							// if anything follows, must be a colon
-			if (*p!=':') goto fail;
-			p++;
-			n = 2; 							// seconds
-			while (*p && isdigit(*p) && n--) s=s*10+(*p++ -'0');
-			// now look at optional fractional seconds
-			if (*p) {
-				if (*p!='.') goto fail;
-				p++;
-				n=6;
-				while (*p && isdigit(*p) && n--) us=us*10+(*p++ -'0');
-				while (n-- > 0) us=us*10; // right pad
-			}
-		}
-
-		return sign * (((((long long)D * 24 + h) * 60 + m) * 60 + s) * (long long)1e6 + us) * 10;
-
-fail:
-		luaL_error(L, LTIME_ERR_EPOCH_CONSTRUCTOR);
-		return 0;
-
-		//*/
+		long long t;
+		STAT(EPOCH_STRING);
+		STAT_BEGIN(start);
+		int valid = parseTicks(lua_tostring(L, index), &t);
+		STAT_END(EPOCH_STRING, start);
+		if (!valid)
+			luaL_error(L, LTIME_ERR_EPOCH_CONSTRUCTOR);
+		return t;
 	}
 	else {
 		t_epoch *param = luaL_checkudata(L, index, LTIME_MT_EPOCH);
+		STAT(EPOCH_OBJECT);
 		return param->t;
 	}
 
@@ -123,19 +191,21 @@ int fromTicks(long long t, unsigned *D, unsigned *h, unsigned *m, unsigned *s, u
  *  Epoch = Ltime.Epoch(parameter)
  */
 int epoch_new(lua_State *L) {
+	PROBE(epoch_new_entry);
 	int top = lua_gettop(L);
 	t_epoch *self = newEpoch(L);
 	self->t = parameterToTicks(L, top>0 ? 1 : 0 );
+	PROBE1(epoch_new_return, self->t);
 	return 1;
 }
 
 /*
- *  Epoch2 = Epoch:clone()
+ *  Epoch2 = Epoch:clone([dest])
  */
 static int epoch_clone(lua_State *L) {
 
 	t_epoch *self = (t_epoch *)luaL_checkudata(L, 1, LTIME_MT_EPOCH);
-	t_epoch *clone = newEpoch(L);
+	t_epoch *clone = destEpoch(L, 2);
 	clone->t = self->t;
 	return 1;
 }
@@ -211,6 +281,7 @@ static int epoch_days(lua_State *L) {
  */
 static int epoch_unm(lua_State *L) {
 	
+	STAT(EPOCH_META);
 	t_epoch *self = (t_epoch *)luaL_checkudata(L, 1, LTIME_MT_EPOCH);
 	self->t = - self->t;
 	return 1;
@@ -220,6 +291,8 @@ static int epoch_unm(lua_State *L) {
  *  Epoch.__add(a, b)
  */
 static int epoch_add(lua_State *L) {
+	STAT(EPOCH_META);
+	PROBE1(arith_entry, "epoch_add");
 	long long a, b;
 	t_datetime *d;
 
@@ -233,6 +306,7 @@ static int epoch_add(lua_State *L) {
 		t_epoch *self = newEpoch(L);
 		self->t = a + b;
 	}
+	PROBE1(arith_return, "epoch_add");
 	return 1;
 }
 
@@ -241,11 +315,14 @@ static int epoch_add(lua_State *L) {
  */
 static int epoch_sub(lua_State *L) {
 	
+	STAT(EPOCH_META);
+	PROBE1(arith_entry, "epoch_sub");
 	long long a, b;
 	a = parameterToTicks(L, 1);
 	b = parameterToTicks(L, 2);
 	t_epoch *self = newEpoch(L);
 	self->t = a - b;
+	PROBE1(arith_return, "epoch_sub");
 	return 1;
 }
 
@@ -254,6 +331,8 @@ static int epoch_sub(lua_State *L) {
  */
 static int epoch_mul(lua_State *L) {
 	
+	STAT(EPOCH_META);
+	PROBE1(arith_entry, "epoch_mul");
 	long long t;
 	double x;
 	if (lua_isnumber(L, 1)) {
@@ -269,6 +348,7 @@ static int epoch_mul(lua_State *L) {
 		luaL_error(L, LTIME_ERR_EPOCH_MUL_NO_NUMBER);
 		return 0;
 	}
+	PROBE1(arith_return, "epoch_mul");
 	return 1;
 }
 
@@ -277,6 +357,8 @@ static int epoch_mul(lua_State *L) {
  */
 static int epoch_div(lua_State *L) {
 
+	STAT(EPOCH_META);
+	PROBE1(arith_entry, "epoch_div");
 	if (lua_isnumber(L, 1)) {
 		luaL_error(L, LTIME_ERR_EPOCH_DIV_ARGERR);
 	} else if (lua_isnumber(L, 2)) {
@@ -286,6 +368,7 @@ static int epoch_div(lua_State *L) {
 			luaL_error(L, LTIME_ERR_DIV_ZERO_UNDEFINED);
 		t_epoch *self = newEpoch(L);
 		self->t = t / x;
+		PROBE1(arith_return, "epoch_div");
 		return 1;
 	} else {
 		luaL_error(L, LTIME_ERR_EPOCH_DIV_NO_NUMBER);
@@ -305,6 +388,8 @@ static int epoch_mod(lua_State *L) {
 	self->t = a % b;
 	return 1;
 */
+	STAT(EPOCH_META);
+	PROBE1(arith_entry, "epoch_mod");
 	long long a, b;
 	a = parameterToTicks(L, 1);
 	b = parameterToTicks(L, 2);
@@ -316,6 +401,7 @@ static int epoch_mod(lua_State *L) {
 		t_epoch *self = newEpoch(L);
 		self->t = a % b;
 	}
+	PROBE1(arith_return, "epoch_mod");
 	return 1;
 }
 
@@ -324,6 +410,7 @@ static int epoch_mod(lua_State *L) {
  *  Epoch.__concat(a, b)
  */
 static int epoch_concat(lua_State *L) {
+	STAT(EPOCH_META);
 	luaL_tolstring(L,1,NULL);
 	luaL_tolstring(L,2,NULL);
 	lua_concat(L, 2);
@@ -335,6 +422,7 @@ static int epoch_concat(lua_State *L) {
  *  Epoch.__eq(a, b)
  */
 static int epoch_eq(lua_State *L) {
+	STAT(EPOCH_META);
 	lua_pushboolean(L, parameterToTicks(L, 1) == parameterToTicks(L, 2));
 	return 1;
 }
@@ -343,6 +431,7 @@ static int epoch_eq(lua_State *L) {
  *  Epoch.__lt(a, b)
  */
 static int epoch_lt(lua_State *L) {
+	STAT(EPOCH_META);
 	lua_pushboolean(L, parameterToTicks(L, 1) < parameterToTicks(L, 2));
 	return 1;
 }
@@ -351,43 +440,42 @@ static int epoch_lt(lua_State *L) {
  *  Epoch.__le(a, b)
  */
 static int epoch_le(lua_State *L) {
+	STAT(EPOCH_META);
 	lua_pushboolean(L, parameterToTicks(L, 1) <= parameterToTicks(L, 2));
 	return 1;
 }
 
 /*
- *  Epoch:__tostring() 
+ *  100 nanosecond ticks to [-][D ]hh:mm:ss[.uuuuuu], buffer must hold 50 characters
+ *  Return the length written
  */
-static int epoch_tostring(lua_State *L) {
-	
-	t_epoch *self = (t_epoch *)luaL_checkudata(L, 1, LTIME_MT_EPOCH);
+int epochToString(long long t, char *buffer) {
+
 	unsigned D, h, m, s, us;
-	char buffer[50] = "";
-	
-	char *sign = fromTicks(self->t, &D, &h, &m, &s, &us) < 0 ? "-" : "";
-	
-	if (D && us)
-		sprintf(buffer, "%s%u %02u:%02u:%02u.%06u", sign, D, h,m,s, us);
-	else if (us)
-		sprintf(buffer, "%s%02u:%02u:%02u.%06u", sign, h,m,s, us);
-	else if (D)
-		sprintf(buffer, "%s%u %02u:%02u:%02u", sign, D, h,m,s);
-	else
-		sprintf(buffer, "%s%02u:%02u:%02u", sign, h,m,s);
+	int cursor = 0;
+
+	if (fromTicks(t, &D, &h, &m, &s, &us) < 0)
+		buffer[cursor++] = '-';
+	if (D) {
+		cursor += writeUnsigned(&buffer[cursor], D, 1, '0');
+		buffer[cursor++] = ' ';
+	}
+	cursor += writeTime(&buffer[cursor], h, m, s);
+	if (us) {
+		buffer[cursor++] = '.';
+		cursor += writeUnsigned(&buffer[cursor], us, 6, '0');
+	}
+	return cursor;
+}
 
 /*
-	if (fromTicks(self->t, &D, &h, &m, &s, &us) == -1)
-		strcat(buffer, "-");
-	if (D)
-		sprintf(&buffer[strlen(buffer)], "%u ", D);
-	sprintf(&buffer[strlen(buffer)], "%02u:%02u:%02u", h, m, s);
-	if (us && us % 1000)
-		sprintf(&buffer[strlen(buffer)], ".%06u", us);
-	else if (us)
-		sprintf(&buffer[strlen(buffer)], ".%03u", us / 1000);
-*/
+ *  Epoch:__tostring() 
+ */
+static int epoch_tostring(lua_State *L) {
 	
-	lua_pushstring(L, buffer);
+	t_epoch *self = (t_epoch *)luaL_checkudata(L, 1, LTIME_MT_EPOCH);
+	char buffer[50];
+	lua_pushlstring(L, buffer, epochToString(self->t, buffer));
 	return 1;
 }
 
@@ -403,6 +491,7 @@ static int epoch_gc(lua_State *L) {
 int open_epoch(lua_State *L) {
 	
     static const luaL_Reg epoch_methods[] = {
+		{"format", epoch_format},
 		{"clone", epoch_clone},
 		{"useconds", epoch_useconds},
 		{"mseconds", epoch_mseconds},
@@ -0,0 +1,313 @@
+#include "ltime.h"
+
+typedef struct s_epoch_spec {
+	char	c;
+	int		max_length;
+	int		(*func)(char *, unsigned long long, int, unsigned, unsigned, unsigned, unsigned, unsigned);
+} t_epoch_spec;
+
+/*
+ *  Conversion functions receive the absolute value of the Epoch in ticks,
+ *  its sign and the D h:m:s.us split as returned by fromTicks()
+ */
+
+/*
+ *  %d -> The number of days
+ */
+static int format_d(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, D, 1, '0');
+}
+
+/*
+ *  %h -> The total number of hours
+ */
+static int format_h(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, t / 36000000000ULL, 1, '0');
+}
+
+/*
+ *  %H -> The hour of the day as a decimal number (range 00 to 23)
+ */
+static int format_H(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, h, 2, '0');
+}
+
+/*
+ *  %l -> The total number of milliseconds
+ */
+static int format_l(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, t / 10000ULL, 1, '0');
+}
+
+/*
+ *  %m -> The total number of minutes
+ */
+static int format_m(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, t / 600000000ULL, 1, '0');
+}
+
+/*
+ *  %M -> The minute as a decimal number (range 00 to 59)
+ */
+static int format_M(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, m, 2, '0');
+}
+
+/*
+ *  %n -> A newline character
+ */
+static int format_n(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	buffer[0] = '\n';
+	return 1;
+}
+
+/*
+ *  %i -> ISO 8601 duration, PnDTnHnMnS, zero components omitted
+ */
+static int format_i(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	int cursor = 0;
+	unsigned fraction = t % 10000000ULL;
+	if (sign < 0)
+		buffer[cursor++] = '-';
+	buffer[cursor++] = 'P';
+	if (D) {
+		cursor += writeUnsigned(&buffer[cursor], D, 1, '0');
+		buffer[cursor++] = 'D';
+	}
+	if (h || m || s || fraction || !D) {
+		buffer[cursor++] = 'T';
+		if (h) {
+			cursor += writeUnsigned(&buffer[cursor], h, 1, '0');
+			buffer[cursor++] = 'H';
+		}
+		if (m) {
+			cursor += writeUnsigned(&buffer[cursor], m, 1, '0');
+			buffer[cursor++] = 'M';
+		}
+		if (s || fraction || !(D || h || m)) {
+			cursor += writeUnsigned(&buffer[cursor], s, 1, '0');
+			if (fraction) {
+				int n = 7;
+				while (fraction % 10 == 0) {
+					fraction /= 10;
+					n--;
+				}
+				buffer[cursor++] = '.';
+				cursor += writeUnsigned(&buffer[cursor], fraction, n, '0');
+			}
+			buffer[cursor++] = 'S';
+		}
+	}
+	return cursor;
+}
+
+/*
+ *  %q -> The milliseconds as a decimal number (range 000 to 999)
+ */
+static int format_q(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, us / 1000, 3, '0');
+}
+
+/*
+ *  %Q -> The microseconds as a decimal number (range 000 to 999)
+ */
+static int format_Q(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, us % 1000, 3, '0');
+}
+
+/*
+ *  %s -> The total number of seconds
+ */
+static int format_s(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, t / 10000000ULL, 1, '0');
+}
+
+/*
+ *  %S -> The second as a decimal number (range 00 to 59)
+ */
+static int format_S(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, s, 2, '0');
+}
+
+/*
+ *  %t -> A tab character
+ */
+static int format_t(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	buffer[0] = '\t';
+	return 1;
+}
+
+/*
+ *  %T -> The time of day part in 24-hour notation (%H:%M:%S)
+ */
+static int format_T(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeTime(buffer, h, m, s);
+}
+
+/*
+ *  %u -> The total number of microseconds
+ */
+static int format_u(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, t / 10ULL, 1, '0');
+}
+
+/*
+ *  %- -> A '-' character if the Epoch is negative, nothing otherwise
+ */
+static int format_minus(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	if (sign >= 0)
+		return 0;
+	buffer[0] = '-';
+	return 1;
+}
+
+/*
+ *  %+ -> Either '+' or '-'
+ */
+static int format_plus(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	buffer[0] = sign < 0 ? '-' : '+';
+	return 1;
+}
+
+/*
+ *  %. -> The milliseconds and microseconds as a decimal number (%q%Q)
+ */
+static int format_dot(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return writeUnsigned(buffer, us, 6, '0');
+}
+
+/*
+ *  %% -> A literal '%' character
+ */
+static int format_percent(char *buffer, unsigned long long t, int sign, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	buffer[0] = '%';
+	return 1;
+}
+
+/*
+ *  List of all the Epoch conversion specifier characters, maximum post conversion length and conversion function
+ */
+static t_epoch_spec specs[] = {
+	{'d', 20, format_d},
+	{'h', 20, format_h},
+	{'H', 2, format_H},
+	{'i', 40, format_i},
+	{'l', 20, format_l},
+	{'m', 20, format_m},
+	{'M', 2, format_M},
+	{'n', 1, format_n},
+	{'q', 3, format_q},
+	{'Q', 3, format_Q},
+	{'s', 20, format_s},
+	{'S', 2, format_S},
+	{'t', 1, format_t},
+	{'T', 8, format_T},
+	{'u', 20, format_u},
+	{'-', 1, format_minus},
+	{'+', 1, format_plus},
+	{'.', 6, format_dot},
+	{'%', 1, format_percent},
+	{0, 0, 0}
+};
+
+/*
+ *  Lookup a conversion specifier character in specs[]
+ *  Return its index and set its maximum length, or return -1 if unknown
+ */
+int epoch_spec(char c, int *max_length) {
+
+	for (int j = 0; specs[j].c; j++) {
+		if (specs[j].c == c) {
+			*max_length = specs[j].max_length;
+			return j;
+		}
+	}
+	return -1;
+}
+
+/*
+ *  Render a tick count with a compiled Epoch format
+ *  buffer must hold at least format->max_length characters
+ *  Return the length of the formatted string (not null terminated)
+ */
+int formatTicks(const t_format *format, long long t, char *buffer) {
+
+	int cursor = 0;
+	unsigned D, h, m, s, us;
+	int sign = fromTicks(t, &D, &h, &m, &s, &us);
+	unsigned long long abs = t >= 0 ? (unsigned long long)t : -(unsigned long long)t;
+	for (int i = 0; i < format->count; i++) {
+		const t_format_op *op = &format->ops[i];
+		if (op->spec >= 0) {
+			cursor += specs[op->spec].func(&buffer[cursor], abs, sign, D, h, m, s, us);
+		} else {
+			memcpy(&buffer[cursor], &format->text[op->offset], op->length);
+			cursor += op->length;
+		}
+	}
+	return cursor;
+}
+
+/*
+ *  string = Epoch:format(format_string)
+ *  string = Epoch:format(EpochFormat)
+ */
+int epoch_format(lua_State *L) {
+
+	t_epoch *self = (t_epoch *)luaL_checkudata(L, 1, LTIME_MT_EPOCH);
+	size_t length = formatArgumentLength(L, 2, LTIME_MT_EPOCH_FORMAT);
+	long long memory[formatMemorySize(length) / sizeof(long long) + 1];
+	t_format *format = formatArgument(L, 2, LTIME_MT_EPOCH_FORMAT, memory, epoch_spec);
+	char buffer[format->max_length + 1];
+	STAT(EPOCH_FORMAT);
+	STAT_BEGIN(start);
+	int cursor = formatTicks(format, self->t, buffer);
+	STAT_END(EPOCH_FORMAT, start);
+	lua_pushlstring(L, buffer, cursor);
+	return 1;
+}
+
+/*
+ *  EpochFormat = Ltime.EpochFormat(format_string)
+ *  Compile a format string once, for repeated use with Epoch:format()
+ */
+int epoch_format_new(lua_State *L) {
+
+	size_t length;
+	const char *string = luaL_checklstring(L, 1, &length);
+	void *memory = lua_newuserdata(L, formatMemorySize(length));
+	compileFormat(memory, string, length, epoch_spec);
+	luaL_setmetatable(L, LTIME_MT_EPOCH_FORMAT);
+	return 1;
+}
+
+int open_epoch_format(lua_State *L) {
+
+	static const luaL_Reg epoch_format_meta_methods[] = {
+		{"__tostring", format_tostring},
+		{NULL, NULL}
+	};
+
+	luaL_newmetatable(L, LTIME_MT_EPOCH_FORMAT);
+	luaL_setfuncs(L, epoch_format_meta_methods, 0);
+	return 1;
+}
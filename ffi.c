@@ -0,0 +1,111 @@
+#include "ltime.h"
+#include <sys/time.h>
+
+/*
+ *  Plain C entry points for the LuaJIT FFI binding (ltime_ffi.lua)
+ *
+ *  These functions take and return VMS timestamps and tick counts as
+ *  int64_t and never touch a lua_State. They are built into their own
+ *  library, libltime_ffi.so (make ffi), with only the pure C functions they
+ *  call: it has no reference to the Lua API and loads under LuaJIT even
+ *  with immediate binding.
+ *  The binding does all the arithmetic on cdata and only calls here for
+ *  calendar conversions, parsing and formatting.
+ */
+
+/*
+ *  Current time
+ */
+long long ltime_now(void) {
+
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return VMS_1970 + 10000000LL * (long long)tv.tv_sec + 10LL * (long long)tv.tv_usec;
+}
+
+/*
+ *  ISO 8601 like string to VMS timestamp, -1 if invalid
+ */
+long long ltime_parse(const char *p, size_t length) {
+
+	return parseVMS(p, length);
+}
+
+long long ltime_parse_http_date(const char *p, size_t length) {
+
+	return parseHttpDate(p, length);
+}
+
+long long ltime_parse_rfc3339(const char *p, size_t length) {
+
+	return parseRfc3339(p, length);
+}
+
+/*
+ *  Duration string to ticks
+ *  Return 0 if invalid
+ */
+int ltime_parse_epoch(const char *p, long long *t) {
+
+	return parseTicks(p, t);
+}
+
+/*
+ *  Gregorian calendar to VMS timestamp, -1 if invalid
+ */
+long long ltime_mktime(unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us) {
+
+	return toVMS(Y, M, D, h, m, s, us);
+}
+
+int ltime_mjd(unsigned Y, unsigned M, unsigned D) {
+
+	return toMJD(Y, M, D);
+}
+
+/*
+ *  VMS timestamp to fields: Y, M, D, h, m, s, us
+ */
+void ltime_fields(long long t, unsigned *fields) {
+
+	fromVMS(t, &fields[0], &fields[1], &fields[2], &fields[3], &fields[4], &fields[5], &fields[6]);
+}
+
+/*
+ *  Memory needed to compile a format string of the given length
+ */
+size_t ltime_format_memory(size_t length) {
+
+	return formatMemorySize(length);
+}
+
+/*
+ *  Compile a Time (epoch = 0) or Epoch (epoch = 1) format string into memory
+ *  Return the maximum formatted length
+ */
+int ltime_compile(void *memory, const char *format, size_t length, int epoch) {
+
+	return compileFormat(memory, format, length, epoch ? epoch_spec : datetime_spec)->max_length;
+}
+
+/*
+ *  Format with a compiled format, buffer must hold its maximum length
+ *  Return the length written
+ */
+int ltime_format(const void *format, long long t, char *buffer, int epoch) {
+
+	return epoch ? formatTicks((const t_format *)format, t, buffer) : formatVMS((const t_format *)format, t, buffer);
+}
+
+/*
+ *  Time and Epoch default representations, buffer must hold 50 characters
+ */
+int ltime_time_tostring(long long t, char *buffer) {
+
+	return timeToString(t, buffer);
+}
+
+int ltime_epoch_tostring(long long t, char *buffer) {
+
+	return epochToString(t, buffer);
+}
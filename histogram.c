@@ -0,0 +1,467 @@
+#include "ltime.h"
+#include <limits.h>
+
+/*
+ *  HDR style latency histogram over Epoch values
+ *
+ *  Values (100ns ticks) are counted in log-linear buckets: every power of 2
+ *  range is split into sub_bucket_half_count linear sub-buckets, which keeps
+ *  the relative error below 10^-digits. The counts array is allocated once,
+ *  recording is a couple of shifts and an increment.
+ */
+
+typedef struct s_histogram {
+	int			digits;				/* significant decimal digits */
+	int			bucket_count;		/* number of power of 2 buckets */
+	int			sub_bucket_count;	/* linear sub-buckets per bucket (power of 2) */
+	int			sub_bucket_half_count_magnitude;
+	long long	sub_bucket_mask;
+	long long	highest;			/* highest trackable value, larger values are clamped */
+	long long	total;				/* number of recorded values */
+	long long	min;
+	long long	max;
+	double		sum;
+	int			counts_len;
+	long long	counts[1];
+} t_histogram;
+
+#define isHistogram(L, i) ((t_histogram *)luaL_checkudata(L, i, LTIME_MT_HISTOGRAM))
+
+/*
+ *  Power of 2 bucket index of a value
+ */
+static inline int bucketIndex(const t_histogram *self, long long value) {
+
+	int pow2ceiling = 64 - __builtin_clzll(value | self->sub_bucket_mask);
+	return pow2ceiling - (self->sub_bucket_half_count_magnitude + 1);
+}
+
+/*
+ *  Index in counts[] of a value
+ */
+static inline int countsIndex(const t_histogram *self, long long value) {
+
+	int bucket = bucketIndex(self, value);
+	int sub_bucket = value >> bucket;
+	return ((bucket + 1) << self->sub_bucket_half_count_magnitude) + (sub_bucket - (self->sub_bucket_count >> 1));
+}
+
+/*
+ *  Lowest value counted in counts[index]
+ */
+static long long valueFromIndex(const t_histogram *self, int index, long long *size) {
+
+	int bucket = (index >> self->sub_bucket_half_count_magnitude) - 1;
+	int sub_bucket = (index & ((self->sub_bucket_count >> 1) - 1)) + (self->sub_bucket_count >> 1);
+	if (bucket < 0) {
+		sub_bucket -= self->sub_bucket_count >> 1;
+		bucket = 0;
+	}
+	if (size)
+		*size = 1LL << bucket;
+	return (long long)sub_bucket << bucket;
+}
+
+/*
+ *  Layout of a histogram with the given precision and highest trackable value
+ */
+static void histogramLayout(int digits, long long highest, int *sub_bucket_count, int *bucket_count) {
+
+	long long largest = 2;
+	for (int i = 0; i < digits; i++)
+		largest *= 10;
+	int magnitude = 0;
+	while ((1LL << magnitude) < largest)
+		magnitude++;
+	*sub_bucket_count = 1 << magnitude;
+	long long smallest_untrackable = *sub_bucket_count;
+	*bucket_count = 1;
+	while (smallest_untrackable <= highest) {
+		if (smallest_untrackable > LLONG_MAX / 2) {
+			(*bucket_count)++;
+			break;
+		}
+		smallest_untrackable <<= 1;
+		(*bucket_count)++;
+	}
+}
+
+/*
+ * Create a new, empty histogram
+ * - leave the new object on top of the stack
+ * - return pointer to the histogram object
+ */
+static t_histogram *newHistogram(lua_State *L, int digits, long long highest) {
+
+	int sub_bucket_count, bucket_count;
+	if (digits < 1 || digits > 5)
+		luaL_error(L, LTIME_ERR_HISTOGRAM_DIGITS);
+	if (highest < 2)
+		highest = 2;
+	histogramLayout(digits, highest, &sub_bucket_count, &bucket_count);
+	int counts_len = (bucket_count + 1) * (sub_bucket_count >> 1);
+	t_histogram *self = (t_histogram *)lua_newuserdata(L, sizeof(t_histogram) + (counts_len - 1) * sizeof(long long));
+	luaL_setmetatable(L, LTIME_MT_HISTOGRAM);
+	self->digits = digits;
+	self->bucket_count = bucket_count;
+	self->sub_bucket_count = sub_bucket_count;
+	self->sub_bucket_half_count_magnitude = __builtin_ctz(sub_bucket_count) - 1;
+	self->sub_bucket_mask = sub_bucket_count - 1;
+	self->highest = highest;
+	self->counts_len = counts_len;
+	self->total = 0;
+	self->min = LLONG_MAX;
+	self->max = 0;
+	self->sum = 0;
+	memset(self->counts, 0, counts_len * sizeof(long long));
+	return self;
+}
+
+/*
+ *  Record count occurrences of value (ticks)
+ *  Negative values are recorded as 0, values above the highest trackable value
+ *  are recorded in the last bucket
+ */
+static inline void histogramRecord(t_histogram *self, long long value, long long count) {
+
+	if (value < 0)
+		value = 0;
+	int index = countsIndex(self, value > self->highest ? self->highest : value);
+	if (index >= self->counts_len)
+		index = self->counts_len - 1;
+	self->counts[index] += count;
+	self->total += count;
+	self->sum += (double)value * count;
+	if (value < self->min)
+		self->min = value;
+	if (value > self->max)
+		self->max = value;
+}
+
+/*
+ *  Append an unsigned LEB128 varint to the buffer
+ */
+void addVarint(luaL_Buffer *b, unsigned long long value) {
+
+	while (value >= 0x80) {
+		luaL_addchar(b, (char)(value | 0x80));
+		value >>= 7;
+	}
+	luaL_addchar(b, (char)value);
+}
+
+/*
+ *  Read an unsigned LEB128 varint, return 0 on truncated input
+ */
+int readVarint(const unsigned char **p, const unsigned char *end, unsigned long long *value) {
+
+	int shift = 0;
+	*value = 0;
+	while (*p < end && shift < 64) {
+		unsigned char c = *(*p)++;
+		*value |= (unsigned long long)(c & 0x7F) << shift;
+		if (!(c & 0x80))
+			return 1;
+		shift += 7;
+	}
+	return 0;
+}
+
+/*
+ *  Rebuild a histogram from Histogram:serialize() output
+ *  - leave the new object on top of the stack
+ */
+static t_histogram *deserializeHistogram(lua_State *L, int index) {
+
+	size_t length;
+	const unsigned char *p = (const unsigned char *)lua_tolstring(L, index, &length);
+	const unsigned char *end = p + length;
+	unsigned long long digits = 0, highest = 0, min = 0, max = 0, sum = 0, run = 0;
+	if (length < 4 || memcmp(p, LTIME_HISTOGRAM_MAGIC, 4) != 0)
+		luaL_error(L, LTIME_ERR_HISTOGRAM_FORMAT);
+	p += 4;
+	if (!readVarint(&p, end, &digits) || !readVarint(&p, end, &highest)
+		|| !readVarint(&p, end, &min) || !readVarint(&p, end, &max) || !readVarint(&p, end, &sum)
+		|| digits < 1 || digits > 5)
+		luaL_error(L, LTIME_ERR_HISTOGRAM_FORMAT);
+	t_histogram *self = newHistogram(L, digits, highest);
+	self->min = min;
+	self->max = max;
+	self->sum = sum;
+	// counts: a varint count, zero runs as 0 followed by the run length
+	for (int i = 0; p < end; ) {
+		if (!readVarint(&p, end, &run))
+			luaL_error(L, LTIME_ERR_HISTOGRAM_FORMAT);
+		if (run == 0) {
+			if (!readVarint(&p, end, &run) || run > (unsigned long long)(self->counts_len - i))
+				luaL_error(L, LTIME_ERR_HISTOGRAM_FORMAT);
+			i += run;
+			continue;
+		}
+		if (i >= self->counts_len)
+			luaL_error(L, LTIME_ERR_HISTOGRAM_FORMAT);
+		self->counts[i++] = run;
+		self->total += run;
+	}
+	if (self->total == 0)
+		self->min = LLONG_MAX;
+	return self;
+}
+
+/*
+ *  Histogram = Ltime.Histogram([digits[, highest]])
+ *  Histogram = Ltime.Histogram(serialized_string)
+ *  digits: significant decimal digits, 1 to 5 (default 3)
+ *  highest: highest trackable value, anything accepted by Ltime.Epoch (default 1 hour)
+ */
+int histogram_new(lua_State *L) {
+
+	if (lua_type(L, 1) == LUA_TSTRING) {
+		deserializeHistogram(L, 1);
+		return 1;
+	}
+	int digits = luaL_optinteger(L, 1, 3);
+	long long highest = lua_isnoneornil(L, 2) ? 36000000000LL : parameterToTicks(L, 2);
+	newHistogram(L, digits, highest);
+	return 1;
+}
+
+/*
+ *  Record a value, count times
+ *  Histogram = Histogram:record(value[, count])
+ *  value can be an Epoch, a number of seconds or a deltatime string
+ */
+static int histogram_record(lua_State *L) {
+
+	t_histogram *self = isHistogram(L, 1);
+	t_epoch *epoch = (t_epoch *)luaL_testudata(L, 2, LTIME_MT_EPOCH);
+	long long value = epoch ? epoch->t : parameterToTicks(L, 2);
+	lua_Integer count = luaL_optinteger(L, 3, 1);
+	luaL_argcheck(L, count >= 1, 3, LTIME_ERR_HISTOGRAM_COUNT);
+	histogramRecord(self, value, count);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/*
+ *  Record a raw tick count (100ns units), count times
+ *  Histogram = Histogram:record_ticks(ticks[, count])
+ */
+static int histogram_record_ticks(lua_State *L) {
+
+	t_histogram *self = isHistogram(L, 1);
+	long long value = luaL_checkinteger(L, 2);
+	lua_Integer count = luaL_optinteger(L, 3, 1);
+	luaL_argcheck(L, count >= 1, 3, LTIME_ERR_HISTOGRAM_COUNT);
+	histogramRecord(self, value, count);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/*
+ *  Value at percentile p (0 to 100)
+ *  Epoch = Histogram:percentile(p)
+ */
+static int histogram_percentile(lua_State *L) {
+
+	t_histogram *self = isHistogram(L, 1);
+	double p = luaL_checknumber(L, 2);
+	if (p < 0)
+		p = 0;
+	if (p > 100)
+		p = 100;
+	long long target = (long long)(p / 100 * self->total + 0.5);
+	if (target < 1)
+		target = 1;
+	long long value = 0, cumulative = 0;
+	if (self->total) {
+		for (int i = 0; i < self->counts_len; i++) {
+			cumulative += self->counts[i];
+			if (cumulative >= target) {
+				long long size;
+				value = valueFromIndex(self, i, &size) + size - 1;
+				break;
+			}
+		}
+		if (value > self->max)
+			value = self->max;
+		if (value < self->min)
+			value = self->min;
+	}
+	t_epoch *result = newEpoch(L);
+	result->t = value;
+	return 1;
+}
+
+/*
+ *  Mean of the recorded values
+ *  Epoch = Histogram:mean()
+ */
+static int histogram_mean(lua_State *L) {
+
+	t_histogram *self = isHistogram(L, 1);
+	t_epoch *result = newEpoch(L);
+	result->t = self->total ? (long long)(self->sum / self->total + 0.5) : 0;
+	return 1;
+}
+
+/*
+ *  Largest recorded value
+ *  Epoch = Histogram:max()
+ */
+static int histogram_max(lua_State *L) {
+
+	t_histogram *self = isHistogram(L, 1);
+	t_epoch *result = newEpoch(L);
+	result->t = self->max;
+	return 1;
+}
+
+/*
+ *  Smallest recorded value
+ *  Epoch = Histogram:min()
+ */
+static int histogram_min(lua_State *L) {
+
+	t_histogram *self = isHistogram(L, 1);
+	t_epoch *result = newEpoch(L);
+	result->t = self->total ? self->min : 0;
+	return 1;
+}
+
+/*
+ *  Number of recorded values
+ *  count = Histogram:count()
+ */
+static int histogram_count(lua_State *L) {
+
+	t_histogram *self = isHistogram(L, 1);
+	lua_pushinteger(L, self->total);
+	return 1;
+}
+
+/*
+ *  Add all values recorded in another histogram
+ *  Histogram = Histogram:merge(Histogram2)
+ */
+static int histogram_merge(lua_State *L) {
+
+	t_histogram *self = isHistogram(L, 1);
+	t_histogram *other = isHistogram(L, 2);
+	long long min = self->min, max = self->max;
+	double sum = self->sum;
+	if (self->digits == other->digits && self->counts_len == other->counts_len) {
+		for (int i = 0; i < self->counts_len; i++)
+			self->counts[i] += other->counts[i];
+		self->total += other->total;
+	} else {
+		// different layouts: re-record the median of every non empty bucket
+		for (int i = 0; i < other->counts_len; i++) {
+			if (other->counts[i]) {
+				long long size, value = valueFromIndex(other, i, &size);
+				histogramRecord(self, value + (size >> 1), other->counts[i]);
+			}
+		}
+	}
+	self->sum = sum + other->sum;
+	self->min = other->total && other->min < min ? other->min : min;
+	self->max = other->max > max ? other->max : max;
+	lua_settop(L, 1);
+	return 1;
+}
+
+/*
+ *  Forget all recorded values
+ *  Histogram = Histogram:reset()
+ */
+static int histogram_reset(lua_State *L) {
+
+	t_histogram *self = isHistogram(L, 1);
+	memset(self->counts, 0, self->counts_len * sizeof(long long));
+	self->total = 0;
+	self->min = LLONG_MAX;
+	self->max = 0;
+	self->sum = 0;
+	lua_settop(L, 1);
+	return 1;
+}
+
+/*
+ *  Compact binary representation, see Ltime.Histogram(serialized_string)
+ *  string = Histogram:serialize()
+ */
+static int histogram_serialize(lua_State *L) {
+
+	t_histogram *self = isHistogram(L, 1);
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	luaL_addlstring(&b, LTIME_HISTOGRAM_MAGIC, 4);
+	addVarint(&b, self->digits);
+	addVarint(&b, self->highest);
+	addVarint(&b, self->total ? self->min : 0);
+	addVarint(&b, self->max);
+	addVarint(&b, (unsigned long long)(self->sum + 0.5));
+	int last = self->counts_len;
+	while (last > 0 && self->counts[last - 1] == 0)
+		last--;
+	for (int i = 0; i < last; ) {
+		if (self->counts[i]) {
+			addVarint(&b, self->counts[i++]);
+		} else {
+			int run = 0;
+			while (i < last && self->counts[i] == 0) {
+				run++;
+				i++;
+			}
+			addVarint(&b, 0);
+			addVarint(&b, run);
+		}
+	}
+	luaL_pushresult(&b);
+	return 1;
+}
+
+/*
+ *  Histogram:__tostring()
+ */
+static int histogram_tostring(lua_State *L) {
+
+	t_histogram *self = isHistogram(L, 1);
+	lua_pushfstring(L, "LTime Histogram (%d digits, %d values)", self->digits, (int)self->total);
+	return 1;
+}
+
+int open_histogram(lua_State *L) {
+
+	static const luaL_Reg histogram_methods[] = {
+		{"record", histogram_record},
+		{"record_ticks", histogram_record_ticks},
+		{"percentile", histogram_percentile},
+		{"mean", histogram_mean},
+		{"max", histogram_max},
+		{"min", histogram_min},
+		{"count", histogram_count},
+		{"merge", histogram_merge},
+		{"reset", histogram_reset},
+		{"serialize", histogram_serialize},
+		{NULL, NULL}
+	};
+
+	static const luaL_Reg histogram_meta_methods[] = {
+		{"__len", histogram_count},
+		{"__tostring", histogram_tostring},
+		{NULL, NULL}
+	};
+
+	// create the metatable first
+	luaL_newmetatable(L, LTIME_MT_HISTOGRAM);
+	// and set all metamethods except __index
+	luaL_setfuncs(L, histogram_meta_methods, 0);
+
+	// create the library table
+	luaL_newlib(L, histogram_methods);
+	// and set the __index metamethod
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}
@@ -0,0 +1,184 @@
+#include "ltime.h"
+
+/*
+ *  Log timestamp clock
+ *
+ *  Log lines of the same second share everything but their sub-second
+ *  fields. The format is rendered once per second into a cache, as runs of
+ *  cached text separated by the conversions that change within a second
+ *  (%q, %Q, %., %s, %v). Each call copies the runs and only renders those.
+ */
+
+typedef struct s_piece {
+	int			spec;		/* conversion in specs[], -1 for a cached run */
+	int			offset;		/* cached run in the cache text */
+	int			length;
+} t_piece;
+
+typedef struct s_logclock {
+	t_format	*format;
+	t_piece		*pieces;
+	int			count;
+	char		*cache;
+	long long	second;		/* second of the cache, -1 when empty */
+	unsigned	Y, M, D, h, m, s;
+} t_logclock;
+
+#define isLogClock(L, i) ((t_logclock *)luaL_checkudata(L, i, LTIME_MT_LOGCLOCK))
+
+/*
+ *  Render the cached runs of a second
+ */
+static void renderSecond(t_logclock *self, long long second) {
+
+	const t_format *format = self->format;
+	int cursor = 0;
+	fromVMS(second * 10000000LL, &self->Y, &self->M, &self->D, &self->h, &self->m, &self->s, NULL);
+	self->count = 0;
+	for (int i = 0; i < format->count; i++) {
+		const t_format_op *op = &format->ops[i];
+		if (op->spec >= 0 && datetime_spec_subsecond(op->spec)) {
+			t_piece *piece = &self->pieces[self->count++];
+			piece->spec = op->spec;
+			continue;
+		}
+		if (self->count == 0 || self->pieces[self->count - 1].spec >= 0) {
+			t_piece *piece = &self->pieces[self->count++];
+			piece->spec = -1;
+			piece->offset = cursor;
+			piece->length = 0;
+		}
+		int length;
+		if (op->spec >= 0) {
+			length = formatSpec(op->spec, &self->cache[cursor], second * 10000000LL,
+				self->Y, self->M, self->D, self->h, self->m, self->s, 0);
+		} else {
+			memcpy(&self->cache[cursor], &format->text[op->offset], op->length);
+			length = op->length;
+		}
+		self->pieces[self->count - 1].length += length;
+		cursor += length;
+	}
+	self->second = second;
+}
+
+/*
+ *  Push t formatted
+ */
+static void pushFormatted(lua_State *L, t_logclock *self, long long t) {
+
+	long long second = t / 10000000LL;
+	if (second != self->second)
+		renderSecond(self, second);
+	char buffer[self->format->max_length + 1];
+	unsigned us = t / 10 % 1000000;
+	int cursor = 0;
+	for (int i = 0; i < self->count; i++) {
+		const t_piece *piece = &self->pieces[i];
+		if (piece->spec >= 0) {
+			cursor += formatSpec(piece->spec, &buffer[cursor], t, self->Y, self->M, self->D, self->h, self->m, self->s, us);
+		} else {
+			memcpy(&buffer[cursor], &self->cache[piece->offset], piece->length);
+			cursor += piece->length;
+		}
+	}
+	lua_pushlstring(L, buffer, cursor);
+}
+
+/*
+ *  LogClock = Ltime.LogClock(format_string)
+ *  format_string is a string or an Ltime.Format object
+ */
+int logclock_new(lua_State *L) {
+
+	size_t length;
+	const char *string;
+	t_format *source = (t_format *)luaL_testudata(L, 1, LTIME_MT_FORMAT);
+	if (source) {
+		string = source->text;
+		length = strlen(string);
+	} else {
+		string = luaL_checklstring(L, 1, &length);
+	}
+	// one block: the clock, the compiled format, the pieces and the cache text
+	size_t header = (sizeof(t_logclock) + 7) & ~(size_t)7;
+	size_t memory = (formatMemorySize(length) + 7) & ~(size_t)7;
+	long long scratch[memory / sizeof(long long)];
+	int max_length = compileFormat(scratch, string, length, datetime_spec)->max_length;
+	size_t pieces = (length + 1) * sizeof(t_piece);
+	t_logclock *self = (t_logclock *)lua_newuserdata(L, header + memory + pieces + max_length + 1);
+	self->format = compileFormat((char *)self + header, string, length, datetime_spec);
+	self->pieces = (t_piece *)((char *)self + header + memory);
+	self->cache = (char *)self->pieces + pieces;
+	self->count = 0;
+	self->second = -1;
+	luaL_setmetatable(L, LTIME_MT_LOGCLOCK);
+	return 1;
+}
+
+/*
+ *  Format a time, absent or nil is the current time
+ *  string = LogClock:format([t])
+ */
+static int logclock_format(lua_State *L) {
+
+	t_logclock *self = isLogClock(L, 1);
+	pushFormatted(L, self, timeArgument(L, 2));
+	return 1;
+}
+
+/*
+ *  Format the current time read from the coarse clock, which is much cheaper
+ *  than the precise one but only advances with the kernel tick (1 to 10 ms)
+ *  string = LogClock:now()
+ */
+static int logclock_now(lua_State *L) {
+
+	t_logclock *self = isLogClock(L, 1);
+	struct timespec ts;
+#ifdef CLOCK_REALTIME_COARSE
+	clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+	clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+	pushFormatted(L, self, VMS_1970 + 10000000LL * (long long)ts.tv_sec + ts.tv_nsec / 100);
+	return 1;
+}
+
+/*
+ *  LogClock:__tostring()
+ *  Return the source format string
+ */
+static int logclock_tostring(lua_State *L) {
+
+	t_logclock *self = isLogClock(L, 1);
+	lua_pushstring(L, self->format->text);
+	return 1;
+}
+
+int open_logclock(lua_State *L) {
+
+	static const luaL_Reg logclock_methods[] = {
+		{"format", logclock_format},
+		{"now", logclock_now},
+		{NULL, NULL}
+	};
+
+	static const luaL_Reg logclock_meta_methods[] = {
+		{"__call", logclock_format},
+		{"__tostring", logclock_tostring},
+		{NULL, NULL}
+	};
+
+	// create the metatable first
+	luaL_newmetatable(L, LTIME_MT_LOGCLOCK);
+	// and set all metamethods except __index
+	luaL_setfuncs(L, logclock_meta_methods, 0);
+
+	// create the library table
+	luaL_newlib(L, logclock_methods);
+	// and set the __index metamethod
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}
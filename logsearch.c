@@ -0,0 +1,206 @@
+#include "ltime.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ *  Time window search in text log files
+ *
+ *  The lines of the file start with a timestamp as written by Time:__tostring
+ *  and are in time order. Lines without a leading timestamp (stack traces,
+ *  wrapped messages) belong to the line above. The file is memory mapped and
+ *  bisected by byte offset: a probe resyncs to the next line start and reads
+ *  the first timestamp at or after it, which is non-decreasing with the offset.
+ */
+
+typedef struct s_logfile {
+	const char *map;
+	size_t size;
+	size_t position;	/* next line of the iterator */
+	size_t end;
+} t_logfile;
+
+#define LOGSEARCH_TIMESTAMP_LENGTH	26		/* YYYY-MM-DD hh:mm:ss.ffffff */
+
+/*
+ *  Start of the first line at or after position
+ */
+static size_t lineStart(const char *map, size_t size, size_t position) {
+
+	if (position == 0 || position >= size || map[position - 1] == '\n')
+		return position < size ? position : size;
+	const char *eol = memchr(map + position, '\n', size - position);
+	return eol ? (size_t)(eol - map) + 1 : size;
+}
+
+/*
+ *  Leading timestamp of the line at position, -1 if there is none
+ */
+static long long lineTimestamp(const char *map, size_t size, size_t position) {
+
+	const char *p = map + position;
+	size_t length = size - position;
+	if (length > LOGSEARCH_TIMESTAMP_LENGTH)
+		length = LOGSEARCH_TIMESTAMP_LENGTH;
+	if (length < 10 || !isdigit(p[0]) || !isdigit(p[1]) || !isdigit(p[2]) || !isdigit(p[3]) || p[4] != '-')
+		return -1;
+	const char *eol = memchr(p, '\n', length);
+	if (eol)
+		length = eol - p;
+	return parseVMS(p, length);
+}
+
+/*
+ *  First timestamped line starting at or after position, size if none
+ *  Its timestamp in *t
+ */
+static size_t nextTimestamp(const char *map, size_t size, size_t position, long long *t) {
+
+	for (position = lineStart(map, size, position); position < size; position = lineStart(map, size, position + 1)) {
+		*t = lineTimestamp(map, size, position);
+		if (*t != -1)
+			return position;
+	}
+	return size;
+}
+
+/*
+ *  Offset of the first timestamped line not earlier than t, size if none
+ */
+static size_t lowerBound(const char *map, size_t size, long long t) {
+
+	size_t lo = 0, hi = size;
+	long long found;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (nextTimestamp(map, size, mid, &found) == size || found >= t)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return nextTimestamp(map, size, lo, &found);
+}
+
+/*
+ *  Map the file at path, an empty file maps to NULL
+ *  Return 0 and leave errno set on failure
+ */
+static int mapFile(const char *path, const char **map, size_t *size) {
+
+	*map = NULL;
+	*size = 0;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	struct stat st;
+	int ok = fstat(fd, &st) == 0;
+	if (ok && st.st_size > 0) {
+		void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		ok = p != MAP_FAILED;
+		if (ok) {
+			*map = p;
+			*size = st.st_size;
+		}
+	}
+	int error = errno;
+	close(fd);
+	errno = error;
+	return ok;
+}
+
+/*
+ *  offset, length = Ltime.logsearch(path, t0, t1)
+ *  Byte range of the lines from t0 included to t1 excluded, offset counts from 0
+ *  as file:seek does. Return nil, message if the file cannot be read
+ */
+int logsearch_range(lua_State *L) {
+
+	const char *path = luaL_checkstring(L, 1);
+	luaL_checkany(L, 2);
+	luaL_checkany(L, 3);
+	long long t0 = parameterToVMS(L, 2);
+	long long t1 = parameterToVMS(L, 3);
+	const char *map;
+	size_t size;
+	if (!mapFile(path, &map, &size))
+		return luaL_fileresult(L, 0, path);
+	size_t first = 0, last = 0;
+	if (size > 0) {
+		first = lowerBound(map, size, t0);
+		last = t1 > t0 ? lowerBound(map, size, t1) : first;
+		munmap((void *)map, size);
+	}
+	lua_pushinteger(L, first);
+	lua_pushinteger(L, last > first ? last - first : 0);
+	return 2;
+}
+
+/*
+ *  Iterator over the lines of the window, without their line feed
+ */
+static int logsearch_next(lua_State *L) {
+
+	t_logfile *self = (t_logfile *)lua_touserdata(L, lua_upvalueindex(1));
+	if (self->position >= self->end)
+		return 0;
+	const char *p = self->map + self->position;
+	const char *eol = memchr(p, '\n', self->end - self->position);
+	size_t length = eol ? (size_t)(eol - p) : self->end - self->position;
+	lua_pushlstring(L, p, length);
+	self->position += length + 1;
+	return 1;
+}
+
+/*
+ *  for line in Ltime.loglines(path, t0, t1) do ... end
+ *  Lines from t0 included to t1 excluded, raise an error if the file cannot be read
+ */
+int logsearch_lines(lua_State *L) {
+
+	const char *path = luaL_checkstring(L, 1);
+	luaL_checkany(L, 2);
+	luaL_checkany(L, 3);
+	long long t0 = parameterToVMS(L, 2);
+	long long t1 = parameterToVMS(L, 3);
+	t_logfile *self = (t_logfile *)lua_newuserdata(L, sizeof(t_logfile));
+	self->map = NULL;
+	self->size = self->position = self->end = 0;
+	luaL_setmetatable(L, LTIME_MT_LOGFILE);
+	if (!mapFile(path, &self->map, &self->size))
+		return luaL_error(L, "%s: %s", path, strerror(errno));
+	if (self->size > 0) {
+		self->position = lowerBound(self->map, self->size, t0);
+		self->end = t1 > t0 ? lowerBound(self->map, self->size, t1) : self->position;
+	}
+	lua_pushcclosure(L, logsearch_next, 1);
+	return 1;
+}
+
+/*
+ *  Unmap the file when the iterator is collected
+ */
+static int logfile_gc(lua_State *L) {
+
+	t_logfile *self = (t_logfile *)luaL_checkudata(L, 1, LTIME_MT_LOGFILE);
+	if (self->map) {
+		munmap((void *)self->map, self->size);
+		self->map = NULL;
+		self->position = self->end = 0;
+	}
+	return 0;
+}
+
+int open_logsearch(lua_State *L) {
+
+	static const luaL_Reg logfile_meta_methods[] = {
+		{"__gc", logfile_gc},
+		{NULL, NULL}
+	};
+
+	luaL_newmetatable(L, LTIME_MT_LOGFILE);
+	luaL_setfuncs(L, logfile_meta_methods, 0);
+
+	return 1;
+}
@@ -3,8 +3,72 @@
 int open_datetime(lua_State *L);
 int datetime_new(lua_State *L);
 int datetime_mktime(lua_State *L);
+int datetime_parse_http_date(lua_State *L);
+int datetime_parse_rfc3339(lua_State *L);
 int open_epoch(lua_State *L);
 int epoch_new(lua_State *L);
+int open_format(lua_State *L);
+int format_new(lua_State *L);
+int open_epoch_format(lua_State *L);
+int epoch_format_new(lua_State *L);
+int open_ticks(lua_State *L);
+int ticks_new(lua_State *L);
+int ticks_mmap(lua_State *L);
+int open_sharedticks(lua_State *L);
+int sharedticks_new(lua_State *L);
+int sharedticks_attach(lua_State *L);
+int bulk_parse_many(lua_State *L);
+int bulk_format_many(lua_State *L);
+int bulk_parse_column(lua_State *L);
+int bulk_format_join(lua_State *L);
+int bulk_format_into(lua_State *L);
+int open_histogram(lua_State *L);
+int histogram_new(lua_State *L);
+int open_ratewindow(lua_State *L);
+int ratewindow_new(lua_State *L);
+int open_timerwheel(lua_State *L);
+int timerwheel_new(lua_State *L);
+int open_deadlinequeue(lua_State *L);
+int deadlinequeue_new(lua_State *L);
+int open_compress(lua_State *L);
+int open_logclock(lua_State *L);
+int logclock_new(lua_State *L);
+int open_pool(lua_State *L);
+int pool_new(lua_State *L);
+int open_clock(lua_State *L);
+int clock_cached_now(lua_State *L);
+int clock_cached_now_ticks(lua_State *L);
+int clock_update_now(lua_State *L);
+int clock_start(lua_State *L);
+int clock_stop(lua_State *L);
+int open_logsearch(lua_State *L);
+int logsearch_range(lua_State *L);
+int logsearch_lines(lua_State *L);
+int align_asof(lua_State *L);
+int align_resample(lua_State *L);
+int convert_decode(lua_State *L);
+int convert_encode(lua_State *L);
+int open_streamparser(lua_State *L);
+int streamparser_new(lua_State *L);
+int open_timerfd(lua_State *L);
+int timerfd_new(lua_State *L);
+int ltime_stats(lua_State *L);
+int ltime_stats_reset(lua_State *L);
+int compress_ticks(lua_State *L);
+int decompress_ticks(lua_State *L);
+int encoder_new(lua_State *L);
+int msgpack_encode(lua_State *L);
+int msgpack_decode(lua_State *L);
+int msgpack_encode_many(lua_State *L);
+int msgpack_decode_many(lua_State *L);
+int cbor_encode(lua_State *L);
+int cbor_decode(lua_State *L);
+int cbor_encode_many(lua_State *L);
+int cbor_decode_many(lua_State *L);
+int mysql_encode(lua_State *L);
+int mysql_decode(lua_State *L);
+int mysql_encode_many(lua_State *L);
+int mysql_decode_many(lua_State *L);
 
 /*
  *  version = Ltime.VERSION()
@@ -20,13 +84,77 @@ int luaopen_ltime(lua_State *L) {
     static const luaL_Reg ltime_functions[] = {
 		{"Time", datetime_new},
 		{"mktime", datetime_mktime},
+		{"parse_http_date", datetime_parse_http_date},
+		{"parse_rfc3339", datetime_parse_rfc3339},
 		{"Epoch", epoch_new},
+		{"Format", format_new},
+		{"EpochFormat", epoch_format_new},
+		{"Ticks", ticks_new},
+		{"mmap_ticks", ticks_mmap},
+		{"SharedTicks", sharedticks_new},
+		{"attach_ticks", sharedticks_attach},
+		{"parse_many", bulk_parse_many},
+		{"format_many", bulk_format_many},
+		{"parse_column", bulk_parse_column},
+		{"StreamParser", streamparser_new},
+		{"format_join", bulk_format_join},
+		{"format_into", bulk_format_into},
+		{"Histogram", histogram_new},
+		{"RateWindow", ratewindow_new},
+		{"TimerWheel", timerwheel_new},
+		{"DeadlineQueue", deadlinequeue_new},
+		{"LogClock", logclock_new},
+		{"Pool", pool_new},
+		{"cached_now", clock_cached_now},
+		{"cached_now_ticks", clock_cached_now_ticks},
+		{"update_now", clock_update_now},
+		{"start_clock", clock_start},
+		{"stop_clock", clock_stop},
+		{"timerfd", timerfd_new},
+		{"logsearch", logsearch_range},
+		{"loglines", logsearch_lines},
+		{"asof", align_asof},
+		{"resample", align_resample},
+		{"decode_ticks", convert_decode},
+		{"encode_ticks", convert_encode},
+		{"stats", ltime_stats},
+		{"stats_reset", ltime_stats_reset},
+		{"compress", compress_ticks},
+		{"decompress", decompress_ticks},
+		{"TicksEncoder", encoder_new},
+		{"msgpack_encode", msgpack_encode},
+		{"msgpack_decode", msgpack_decode},
+		{"msgpack_encode_many", msgpack_encode_many},
+		{"msgpack_decode_many", msgpack_decode_many},
+		{"cbor_encode", cbor_encode},
+		{"cbor_decode", cbor_decode},
+		{"cbor_encode_many", cbor_encode_many},
+		{"cbor_decode_many", cbor_decode_many},
+		{"mysql_encode", mysql_encode},
+		{"mysql_decode", mysql_decode},
+		{"mysql_encode_many", mysql_encode_many},
+		{"mysql_decode_many", mysql_decode_many},
 	//	{"VERSION", ltime_version},
 		{NULL, NULL}
 	};
 
 	open_datetime(L);
 	open_epoch(L);
+	open_format(L);
+	open_epoch_format(L);
+	open_ticks(L);
+	open_sharedticks(L);
+	open_histogram(L);
+	open_ratewindow(L);
+	open_timerwheel(L);
+	open_deadlinequeue(L);
+	open_compress(L);
+	open_logclock(L);
+	open_pool(L);
+	open_clock(L);
+	open_timerfd(L);
+	open_logsearch(L);
+	open_streamparser(L);
     luaL_newlib(L, ltime_functions);
 
 	lua_pushstring(L, "VERSION");
@@ -14,6 +14,21 @@
 
 #define LTIME_MT_DATETIME	"LTime_Datetime"
 #define LTIME_MT_EPOCH		"LTime_Epoch"
+#define LTIME_MT_FORMAT		"LTime_Format"
+#define LTIME_MT_EPOCH_FORMAT	"LTime_EpochFormat"
+#define LTIME_MT_TICKS		"LTime_Ticks"
+#define LTIME_MT_HISTOGRAM	"LTime_Histogram"
+#define LTIME_MT_RATEWINDOW	"LTime_RateWindow"
+#define LTIME_MT_TIMERWHEEL	"LTime_TimerWheel"
+#define LTIME_MT_DEADLINEQUEUE	"LTime_DeadlineQueue"
+#define LTIME_MT_TICKS_ENCODER	"LTime_TicksEncoder"
+#define LTIME_MT_LOGCLOCK	"LTime_LogClock"
+#define LTIME_MT_POOL		"LTime_Pool"
+#define LTIME_MT_STREAMPARSER	"LTime_StreamParser"
+#define LTIME_MT_SHARED_TICKS	"LTime_SharedTicks"
+#define LTIME_MT_TIMERFD	"LTime_TimerFd"
+#define LTIME_MT_LOGFILE	"LTime_LogFile"
+#define LTIME_MT_CLOCK_GUARD	"LTime_ClockGuard"
 
 #define LTIME_KEY_YEAR		"year"
 #define LTIME_KEY_MONTH		"month"
@@ -36,11 +51,139 @@
 #define LTIME_ERR_DATETIME_OUT_OF_RANGE		"Ltime: Time object: out of range value.\n"
 #define LTIME_ERR_DATETIME_STRING_FORMAT	"Ltime: Time string format: YYYY-MM-DD[Thh:mm:ss[.uuuuuu]].\n"
 #define LTIME_ERR_DATETIME_MISSING_FORMAT	"Ltime: Missing format string.\n"
+#define LTIME_ERR_RFC3339_DIGITS			"Ltime: rfc3339: digits must be between 0 and 7.\n"
 #define LTIME_ERR_EPOCH_CONSTRUCTOR			"Ltime: Epoch constructor: unsupported parameter.\n"
 #define LTIME_ERR_EPOCH_STRING_FORMAT		"Ltime: Epoch string format: [+/-][D ]hh:mm:ss[.uuuuuu].\n"
 #define LTIME_ERR_EPOCH_MUL_NO_NUMBER		"Ltime: Epoch multiplication: one operand must be a number.\n"
 #define LTIME_ERR_EPOCH_DIV_NO_NUMBER		"Ltime: Epoch division: second operand must be a number.\n"
 #define LTIME_ERR_EPOCH_DIV_ARGERR			"Ltime: Epoch division: first operand must be an Epoch.\n"
+#define LTIME_ERR_TICKS_INDEX				"Ltime: Ticks index out of range.\n"
+#define LTIME_ERR_TICKS_READONLY			"Ltime: Ticks: file views are read-only.\n"
+#define LTIME_ERR_TICKS_FILE_SIZE			"Ltime: Ticks: file size must be a multiple of 8 bytes.\n"
+#define LTIME_ERR_TICKS_BUCKETS				"Ltime: Ticks: bucket width must be positive.\n"
+#define LTIME_ERR_TICKS_BUCKET_COUNT		"Ltime: Ticks: bucket count out of range.\n"
+#define LTIME_ERR_TICKS_ENDIANNESS			"Ltime: Ticks: endianness must be 'big' or 'little'.\n"
+#define LTIME_ERR_BULK_ELEMENT				"Ltime: unsupported value at index %d.\n"
+#define LTIME_ERR_BULK_CLOSED_FILE			"Ltime: format_into: attempt to use a closed file.\n"
+#define LTIME_ERR_BULK_COLUMN				"Ltime: parse_column: col must be between 1 and INT_MAX and sep a single character.\n"
+#define LTIME_ERR_HISTOGRAM_DIGITS			"Ltime: Histogram precision must be between 1 and 5 significant digits.\n"
+#define LTIME_ERR_HISTOGRAM_FORMAT			"Ltime: Histogram: invalid serialized data.\n"
+#define LTIME_ERR_HISTOGRAM_COUNT			"Ltime: Histogram: the count must be at least 1.\n"
+#define LTIME_ERR_COMPRESSED_FORMAT			"Ltime: decompress: invalid compressed data.\n"
+#define LTIME_ERR_MSGPACK_FORMAT			"Ltime: msgpack_decode: invalid timestamp extension.\n"
+#define LTIME_ERR_CBOR_FORMAT				"Ltime: cbor_decode: invalid tag 1 or tag 1001 timestamp.\n"
+#define LTIME_ERR_CBOR_TAG					"Ltime: cbor_encode: tag must be 1 or 1001.\n"
+#define LTIME_ERR_MYSQL_FORMAT				"Ltime: mysql_decode: invalid temporal value.\n"
+#define LTIME_ERR_MYSQL_RANGE				"Ltime: mysql_encode: Time out of range for the layout.\n"
+#define LTIME_ERR_MYSQL_FSP					"Ltime: mysql: fractional seconds precision must be between 0 and 6.\n"
+#define LTIME_ERR_TIMERWHEEL_RESOLUTION		"Ltime: TimerWheel: resolution must be positive.\n"
+#define LTIME_ERR_POOL_RELEASE				"Ltime: Pool: only Time and Epoch objects can be released.\n"
+#define LTIME_ERR_CLOCK_RESOLUTION		"Ltime: start_clock: resolution must be positive and at most one second.\n"
+#define LTIME_ERR_CLOCK_THREAD			"Ltime: start_clock: cannot start the clock thread.\n"
+#define LTIME_ERR_ASOF_TOLERANCE		"Ltime: asof: tolerance must not be negative.\n"
+#define LTIME_ERR_RESAMPLE_STEP			"Ltime: resample: step must be positive and not too small for the span.\n"
+#define LTIME_ERR_RESAMPLE_VALUES		"Ltime: resample: values must be a table of one number per time.\n"
+#define LTIME_ERR_CONVERT_LENGTH		"Ltime: destination Ticks must have as many values as the source.\n"
+#define LTIME_ERR_STREAM_SEPARATOR		"Ltime: StreamParser: sep must be a single character.\n"
+#define LTIME_ERR_SHARED_SEGMENT		"Ltime: attach_ticks: not a SharedTicks segment.\n"
+#define LTIME_ERR_SHARED_READONLY		"Ltime: SharedTicks: attached arrays are read-only.\n"
+#define LTIME_ERR_SHARED_CAPACITY		"Ltime: SharedTicks: more values than the capacity.\n"
+#define LTIME_ERR_SHARED_ANONYMOUS		"Ltime: SharedTicks: anonymous arrays have no name to unlink.\n"
+#define LTIME_ERR_SHARED_GROWN			"Ltime: SharedTicks: cannot map the grown segment.\n"
+#define LTIME_ERR_SHARED_STALLED		"Ltime: SharedTicks: a store never completed, the writer may have died.\n"
+#define LTIME_ERR_TIMERFD_INTERVAL		"Ltime: timerfd: interval must be positive.\n"
+#define LTIME_ERR_TIMERFD_CLOSED		"Ltime: timerfd: attempt to use a closed timer.\n"
+#define LTIME_ERR_TIMERFD_UNSUPPORTED	"Ltime: timerfd: only available on Linux.\n"
+#define LTIME_ERR_OUT_OF_MEMORY				"Ltime: not enough memory.\n"
+#define LTIME_ERR_RATEWINDOW_PARAMS			"Ltime: RateWindow: resolution must be positive and not larger than the window.\n"
+
+/* Bulk conversions: minimum values per thread, thread limit, values rendered per pass */
+#define LTIME_PARALLEL_MIN_CHUNK	1024
+#define LTIME_MAX_THREADS			256
+#define LTIME_BULK_BLOCK			(1 << 20)
+
+/* TimerWheel: LTIME_WHEEL_LEVELS levels of 2^LTIME_WHEEL_BITS slots */
+#define LTIME_WHEEL_BITS			8
+#define LTIME_WHEEL_SLOTS			(1 << LTIME_WHEEL_BITS)
+#define LTIME_WHEEL_LEVELS			4
+
+/* Histogram:serialize() header */
+#define LTIME_HISTOGRAM_MAGIC		"LTH1"
+
+/* Ltime.compress() header */
+#define LTIME_COMPRESSED_MAGIC		"LTC1"
+
+/*
+ *  Hot path counters, compiled in with -DLTIME_STATS, cycle timing of the
+ *  parse and format categories with -DLTIME_STATS_TIMING in addition.
+ *  Counters are shared by all the Lua states of the process, updated with
+ *  relaxed atomics. Compiled out, the macros expand to nothing.
+ */
+#define LTIME_STATS_LIST(X) \
+	X(TIME_NOW, "time_now") \
+	X(TIME_NUMBER, "time_number") \
+	X(TIME_STRING, "time_string") \
+	X(TIME_TABLE, "time_table") \
+	X(TIME_OBJECT, "time_object") \
+	X(EPOCH_NUMBER, "epoch_number") \
+	X(EPOCH_STRING, "epoch_string") \
+	X(EPOCH_OBJECT, "epoch_object") \
+	X(TIME_ALLOC, "time_alloc") \
+	X(EPOCH_ALLOC, "epoch_alloc") \
+	X(TIME_FORMAT, "time_format") \
+	X(EPOCH_FORMAT, "epoch_format") \
+	X(TIME_META, "time_metamethod") \
+	X(EPOCH_META, "epoch_metamethod")
+
+#define LTIME_STAT_ENUM(id, name) LTIME_STAT_##id,
+enum { LTIME_STATS_LIST(LTIME_STAT_ENUM) LTIME_STAT_COUNT };
+
+#ifdef LTIME_STATS
+typedef struct s_stat {
+	unsigned long long count;
+	unsigned long long cycles;
+} t_stat;
+
+extern t_stat ltimeStats[LTIME_STAT_COUNT];
+
+#define STAT(id) __atomic_fetch_add(&ltimeStats[LTIME_STAT_##id].count, 1, __ATOMIC_RELAXED)
+#ifdef LTIME_STATS_TIMING
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define statClock() __rdtsc()
+#else
+static inline unsigned long long statClock(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+#define STAT_BEGIN(var) unsigned long long var = statClock()
+#define STAT_END(id, var) __atomic_fetch_add(&ltimeStats[LTIME_STAT_##id].cycles, statClock() - (var), __ATOMIC_RELAXED)
+#endif
+#else
+#define STAT(id) ((void)0)
+#endif
+
+#ifndef STAT_BEGIN
+#define STAT_BEGIN(var) ((void)0)
+#define STAT_END(id, var) ((void)0)
+#endif
+
+/*
+ *  USDT probes (provider "ltime") for bpftrace and perf, compiled in with
+ *  -DLTIME_USDT, which needs sys/sdt.h (systemtap-sdt-dev). See ltime.bt.
+ */
+#ifdef LTIME_USDT
+#include <sys/sdt.h>
+#define PROBE(name) DTRACE_PROBE(ltime, name)
+#define PROBE1(name, a) DTRACE_PROBE1(ltime, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(ltime, name, a, b)
+#else
+#define PROBE(name) ((void)0)
+#define PROBE1(name, a) ((void)0)
+#define PROBE2(name, a, b) ((void)0)
+#endif
 
 #define MJD_1970	40587
 #define VMS_1970	((long long)40587 * (long long)86400 * (long long)1e7)
@@ -55,13 +198,89 @@ typedef struct s_epoch {
 	long long t;
 } t_epoch;
 
+typedef struct s_ticks {
+	/* Packed VMS timestamps */
+	long long *t;
+	size_t n;
+	/* File views: the mapping to release (NULL for in-memory arrays) and
+	 * whether the stored byte order differs from the host's */
+	void *map;
+	size_t map_length;
+	int swap;
+} t_ticks;
+
+/* Value at index i (0 based) of a packed tick array */
+static inline long long ticksAt(const t_ticks *self, size_t i) {
+	return self->swap ? (long long)__builtin_bswap64(self->t[i]) : self->t[i];
+}
+
+typedef struct s_format_op {
+	/* Index of the conversion in the specs table, -1 for literal text */
+	int spec;
+	/* Literal text: offset in the format text and number of characters */
+	int offset;
+	int length;
+} t_format_op;
+
+typedef struct s_format {
+	/* Compiled format string: a sequence of conversions and literal runs */
+	int count;
+	int max_length;
+	t_format_op *ops;
+	char *text;
+} t_format;
+
 int toMJD(unsigned Y, unsigned M, unsigned D);
 void fromVMS(long long t, unsigned *Y, unsigned *M, unsigned *D, unsigned *h, unsigned *m, unsigned *s, unsigned *us);
+long long toVMS(unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us);
+long long parseVMS(const char *p, size_t length);
+int timeToString(long long t, char *buffer);
+int parseTicks(const char *p, long long *t);
+int epochToString(long long t, char *buffer);
+long long parseHttpDate(const char *p, size_t length);
+long long parseRfc3339(const char *p, size_t length);
+long long parameterToVMS(lua_State *L, int index);
+long long timeArgument(lua_State *L, int index);
 long long parameterToTicks(lua_State *L, int index);
 int fromTicks(long long t, unsigned *D, unsigned *h, unsigned *m, unsigned *s, unsigned *us);
 int datetime_format(lua_State *L);
+int datetime_http_date(lua_State *L);
+void newHttpDateCache(lua_State *L);
+int datetime_rfc3339(lua_State *L);
+int epoch_format(lua_State *L);
+
+int writeUnsigned(char *buffer, unsigned long long value, int width, char pad);
+int writeTime(char *buffer, unsigned h, unsigned m, unsigned s);
+size_t formatMemorySize(size_t length);
+t_format *compileFormat(void *memory, const char *format, size_t length, int (*lookup)(char, int *));
+size_t formatArgumentLength(lua_State *L, int index, const char *mt);
+t_format *formatArgument(lua_State *L, int index, const char *mt, void *memory, int (*lookup)(char, int *));
+int format_tostring(lua_State *L);
+int datetime_spec(char c, int *max_length);
+int epoch_spec(char c, int *max_length);
+int formatVMS(const t_format *format, long long t, char *buffer);
+int formatSpec(int spec, char *buffer, long long t, unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us);
+int datetime_spec_subsecond(int spec);
+long long scanVMS(const t_format *format, const char *p, size_t length);
+int formatTicks(const t_format *format, long long t, char *buffer);
 
 t_epoch *newEpoch(lua_State *L);
+t_epoch *destEpoch(lua_State *L, int index);
 t_datetime *newDatetime(lua_State *L);
+t_datetime *destDatetime(lua_State *L, int index);
+t_ticks *newTicks(lua_State *L, size_t n);
+t_ticks *toTicks(lua_State *L, int index);
+long long elementToVMS(lua_State *L, int index);
+
+void vmsToUnix(long long t, long long *sec, long long *nsec);
+long long unixToVMS(long long sec, long long nsec);
+void writeBigEndian(unsigned char *p, unsigned long long value, int n);
+unsigned long long readBigEndian(const unsigned char *p, int n);
+
+void addVarint(luaL_Buffer *b, unsigned long long value);
+int readVarint(const unsigned char **p, const unsigned char *end, unsigned long long *value);
+
+void parallelFor(size_t n, int threads, void (*func)(void *, size_t, size_t), void *context);
+int threadsOption(lua_State *L, int index);
 
 #endif /* LTIME_H_ */
@@ -0,0 +1,565 @@
+--[[
+	LTime for LuaJIT, on the FFI
+
+	Time and Epoch are ffi.metatype structs holding a single int64_t, the VMS
+	timestamp or the 100ns tick count. Arithmetic and comparisons are plain
+	int64 operations on cdata and compile into traces; only calendar
+	conversions, parsing and formatting call into libltime_ffi.so (make ffi)
+	through ffi.load, with plain C functions that never touch a lua_State
+	(see ffi.c).
+
+	The API is the one of Ltime.Time, Ltime.Epoch, Ltime.mktime, Ltime.Format
+	and Ltime.EpochFormat of the C module, except that:
+	 * Time:vms() returns an int64_t cdata, as LuaJIT numbers are doubles
+	 * unary minus returns a new Epoch instead of negating it in place
+]]
+
+local ffi = require "ffi"
+local bit = require "bit"
+
+ffi.cdef[[
+typedef struct { int64_t t; } ltime_time;
+typedef struct { int64_t t; } ltime_epoch;
+
+int64_t ltime_now(void);
+int64_t ltime_parse(const char *p, size_t length);
+int64_t ltime_parse_http_date(const char *p, size_t length);
+int64_t ltime_parse_rfc3339(const char *p, size_t length);
+int ltime_parse_epoch(const char *p, int64_t *t);
+int64_t ltime_mktime(unsigned Y, unsigned M, unsigned D, unsigned h, unsigned m, unsigned s, unsigned us);
+int ltime_mjd(unsigned Y, unsigned M, unsigned D);
+void ltime_fields(int64_t t, unsigned *fields);
+size_t ltime_format_memory(size_t length);
+int ltime_compile(void *memory, const char *format, size_t length, int epoch);
+int ltime_format(const void *format, int64_t t, char *buffer, int epoch);
+int ltime_time_tostring(int64_t t, char *buffer);
+int ltime_epoch_tostring(int64_t t, char *buffer);
+long long strtoll(const char *nptr, char **endptr, int base);
+]]
+
+local C = ffi.load(package.searchpath and package.searchpath("libltime_ffi", package.cpath) or "ltime_ffi")
+
+local VMS_1970 = 35067168000000000LL
+local TICKS_PER_SECOND = 10000000LL
+local TICKS_PER_DAY = 864000000000LL
+local FORMAT_CACHE_SIZE = 64
+
+local int64 = ffi.typeof "int64_t"
+local fields = ffi.new "unsigned[7]"
+local buffer = ffi.new "char[64]"
+local ticks = ffi.new "int64_t[1]"
+
+local Time, Epoch
+local time_methods, epoch_methods = {}, {}
+
+local function isTime(x)
+	return ffi.istype(Time, x)
+end
+
+local function isEpoch(x)
+	return ffi.istype(Epoch, x)
+end
+
+local function newTime(t)
+	if t < 0 then
+		error("Ltime: Time object: out of range value.", 3)
+	end
+	return Time(t)
+end
+
+--[[
+	Parameter to VMS timestamp, as parameterToVMS
+]]
+local function toVMS(x)
+	if isTime(x) then
+		return x.t
+	end
+	local kind = type(x)
+	if kind == "nil" then
+		return C.ltime_now()
+	elseif kind == "number" then
+		return VMS_1970 + ffi.cast(int64, 1e7 * x)
+	elseif kind == "string" then
+		local t = C.ltime_parse(x, #x)
+		if t ~= -1 then
+			return t
+		end
+	elseif kind == "table" then
+		local t = C.ltime_mktime(x.year or 0, x.month or 0, x.day or 0, x.hour or 0, x.min or 0, x.sec or 0, x.usec or 0)
+		if t ~= -1 then
+			return t
+		end
+	end
+	error("Ltime: Time constructor: unsupported parameter.", 3)
+end
+
+--[[
+	Parameter to 100ns ticks, as parameterToTicks
+]]
+local function toTicks(x)
+	if isEpoch(x) then
+		return x.t
+	end
+	local kind = type(x)
+	if kind == "nil" then
+		return 0LL
+	elseif kind == "number" then
+		x = x * 1e7
+		return ffi.cast(int64, x > 0 and x + .5 or x - .5)
+	elseif kind == "string" and C.ltime_parse_epoch(x, ticks) ~= 0 then
+		return ticks[0]
+	end
+	error("Ltime: Epoch constructor: unsupported parameter.", 3)
+end
+
+--[[
+	Compiled formats
+]]
+local format_mt = {
+	__tostring = function(self) return self.text end
+}
+
+local function compile(text, epoch)
+	local memory = ffi.new("char[?]", C.ltime_format_memory(#text))
+	local max_length = C.ltime_compile(memory, text, #text, epoch)
+	return setmetatable({
+		text = text,
+		epoch = epoch,
+		memory = memory,
+		buffer = ffi.new("char[?]", max_length + 1)
+	}, format_mt)
+end
+
+-- format strings used with Time:format and Epoch:format are compiled once
+local cache, cached = {[0] = {}, [1] = {}}, {[0] = 0, [1] = 0}
+
+local function formatArgument(format, epoch)
+	if getmetatable(format) == format_mt and format.epoch == epoch then
+		return format
+	end
+	if type(format) ~= "string" then
+		error("Ltime: Missing format string.", 3)
+	end
+	local compiled = cache[epoch][format]
+	if not compiled then
+		if cached[epoch] >= FORMAT_CACHE_SIZE then
+			cache[epoch], cached[epoch] = {}, 0
+		end
+		compiled = compile(format, epoch)
+		cache[epoch][format], cached[epoch] = compiled, cached[epoch] + 1
+	end
+	return compiled
+end
+
+local function format(t, format, epoch)
+	local compiled = formatArgument(format, epoch)
+	return ffi.string(compiled.buffer, C.ltime_format(compiled.memory, t, compiled.buffer, epoch))
+end
+
+--[[
+	Time methods
+]]
+function time_methods.format(self, format_string)
+	return format(self.t, format_string, 0)
+end
+
+local http_second, http_text = -1LL, nil
+
+function time_methods.http_date(self)
+	if self.t < 0 or self.t >= 2973484LL * TICKS_PER_DAY then	-- 10000-01-01
+		error("Ltime: Time object: out of range value.", 2)
+	end
+	local second = self.t / TICKS_PER_SECOND
+	if second ~= http_second then
+		http_text = format(self.t, "%a, %d %b %Y %T GMT", 0)
+		http_second = second
+	end
+	return http_text
+end
+
+function time_methods.rfc3339(self, digits)
+	digits = digits or 0
+	if digits < 0 or digits > 7 then
+		error("Ltime: rfc3339: digits must be between 0 and 7.", 2)
+	end
+	local text = format(self.t, "%FT%T", 0)
+	if digits > 0 then
+		text = text .. "." .. string.format("%07d", tonumber(self.t % TICKS_PER_SECOND)):sub(1, digits)
+	end
+	return text .. "Z"
+end
+
+function time_methods.clone(self)
+	return Time(self.t)
+end
+
+function time_methods.date(self, parameter)
+	C.ltime_fields(self.t, fields)
+	if parameter == nil then
+		return Time(C.ltime_mktime(fields[0], fields[1], fields[2], 0, 0, 0, 0))
+	end
+	local h, m, s, us = fields[3], fields[4], fields[5], fields[6]
+	C.ltime_fields(toVMS(parameter), fields)
+	self.t = C.ltime_mktime(fields[0], fields[1], fields[2], h, m, s, us)
+	return self
+end
+
+function time_methods.time(self, parameter)
+	if parameter == nil then
+		return Epoch(self.t % TICKS_PER_DAY)
+	end
+	local t = toTicks(parameter)
+	if t < 0 or t >= TICKS_PER_DAY then
+		error("Ltime: Time of day must be comprised between 00:00:00.000000 and 23.59.59.999999.", 2)
+	end
+	self.t = self.t - self.t % TICKS_PER_DAY + t
+	return self
+end
+
+function time_methods.add(self, parameter)
+	local t = self.t + toTicks(parameter)
+	if t < 0 then
+		error("Ltime: Time object: out of range value.", 2)
+	end
+	self.t = t
+	return self
+end
+
+function time_methods.sub(self, parameter)
+	local t = self.t - toTicks(parameter)
+	if t < 0 then
+		error("Ltime: Time object: out of range value.", 2)
+	end
+	self.t = t
+	return self
+end
+
+function time_methods.floor(self, parameter)
+	local t = toTicks(parameter)
+	if t == 0 then
+		error("Ltime: Modulo zero is undefined.", 2)
+	end
+	self.t = self.t - self.t % t
+	return self
+end
+
+function time_methods.ceil(self, parameter)
+	local t = toTicks(parameter)
+	if t == 0 then
+		error("Ltime: Modulo zero is undefined.", 2)
+	end
+	local x = self.t % t
+	if x > 0 then
+		self.t = self.t + t - x
+	end
+	return self
+end
+
+function time_methods.leap(self)
+	C.ltime_fields(self.t, fields)
+	local Y = fields[0]
+	return Y % 4 == 0 and (Y % 100 ~= 0 or Y % 400 == 0)
+end
+
+function time_methods.yearday(self, yearday)
+	C.ltime_fields(self.t, fields)
+	local Y = fields[0]
+	if type(yearday) == "number" then
+		if yearday >= 1 then
+			self.t = (C.ltime_mjd(Y, 1, 1) + yearday - 1) * TICKS_PER_DAY + self.t % TICKS_PER_DAY
+		end
+		return self
+	end
+	return C.ltime_mjd(Y, fields[1], fields[2]) - C.ltime_mjd(Y, 1, 1) + 1
+end
+time_methods.doy = time_methods.yearday
+
+function time_methods.weekday(self)
+	return tonumber((self.t / TICKS_PER_DAY + 2) % 7 + 1)
+end
+
+function time_methods.mjd(self, mjd)
+	if type(mjd) == "number" then
+		self.t = ffi.cast(int64, mjd * 864e9)
+		return self
+	end
+	return tonumber(self.t) / 864e9
+end
+
+function time_methods.vms(self, parameter)
+	if parameter == nil then
+		return self.t
+	end
+	if type(parameter) == "string" then
+		if #parameter == 2 and parameter:sub(1, 1) == "*" then
+			local mode = parameter:sub(2)
+			if mode == "x" then
+				return bit.tohex(self.t, -16)
+			elseif mode == "h" then
+				return "0x" .. (bit.tohex(self.t, -16):gsub("^0+(.)", "%1"))
+			elseif mode == "b" then
+				local bytes, t = {}, self.t
+				for i = 8, 1, -1 do
+					bytes[i] = string.char(tonumber(bit.band(t, 0xff)))
+					t = bit.rshift(t, 8)
+				end
+				return table.concat(bytes)
+			end
+			return nil
+		end
+		self.t = ffi.C.strtoll(parameter, nil, 0)
+	else
+		local t = ffi.cast(int64, parameter)
+		if t < 0 then
+			error("Ltime: Time object: out of range value.", 2)
+		end
+		self.t = t
+	end
+	return self
+end
+
+function time_methods.unix(self, seconds, useconds)
+	if useconds ~= nil then
+		useconds = math.min(math.max(useconds, 0), 999999)
+		self.t = VMS_1970 + TICKS_PER_SECOND * ffi.cast(int64, seconds) + 10 * useconds
+		return self
+	elseif seconds ~= nil then
+		self.t = VMS_1970 + ffi.cast(int64, 1e7 * seconds)
+		return self
+	end
+	local ts = (self.t - VMS_1970) / 10
+	return tonumber(ts / 1000000), tonumber(ts % 1000000)
+end
+
+--[[
+	Time metamethods
+]]
+local time_mt = {
+	__index = time_methods,
+
+	__add = function(a, b)
+		if isTime(a) then
+			if isTime(b) then
+				error("Ltime: Adding two Time values doesn't make sense.", 2)
+			end
+			return newTime(a.t + toTicks(b))
+		end
+		return newTime(b.t + toTicks(a))
+	end,
+
+	__sub = function(a, b)
+		if not isTime(a) then
+			error("Ltime: Time value as substraction's second operand doesn't make sense.", 2)
+		end
+		if isTime(b) then
+			return Epoch(a.t - b.t)
+		end
+		return newTime(a.t - toTicks(b))
+	end,
+
+	__mod = function(a, b)
+		if not isTime(a) then
+			error("Ltime: Time value as modulo's second operand doesn't make sense.", 2)
+		end
+		if type(b) == "number" then
+			local t = ffi.cast(int64, b * 1e7)
+			if t == 0 then
+				error("Ltime: Modulo zero is undefined.", 2)
+			end
+			return tonumber(a.t % t) / 1e7
+		end
+		local t = toTicks(b)
+		if t == 0 then
+			error("Ltime: Modulo zero is undefined.", 2)
+		end
+		return Epoch(a.t % t)
+	end,
+
+	__unm = function() error("Ltime: Unary minus not defined for Time objects.", 2) end,
+	__mul = function() error("Ltime: Multiplication not defined for Time objects.", 2) end,
+	__div = function() error("Ltime: Division not defined for Time objects.", 2) end,
+
+	__eq = function(a, b)
+		return isTime(a) and isTime(b) and a.t == b.t
+	end,
+
+	__lt = function(a, b)
+		return toVMS(a) < toVMS(b)
+	end,
+
+	__le = function(a, b)
+		return toVMS(a) <= toVMS(b)
+	end,
+
+	__concat = function(a, b)
+		return tostring(a) .. tostring(b)
+	end,
+
+	__tostring = function(self)
+		return ffi.string(buffer, C.ltime_time_tostring(self.t, buffer))
+	end
+}
+
+--[[
+	Epoch methods
+]]
+function epoch_methods.format(self, format_string)
+	return format(self.t, format_string, 1)
+end
+
+function epoch_methods.clone(self)
+	return Epoch(self.t)
+end
+
+function epoch_methods.useconds(self)
+	return tonumber(self.t) / 10
+end
+
+function epoch_methods.mseconds(self)
+	return tonumber(self.t) / 10000
+end
+
+function epoch_methods.seconds(self)
+	return tonumber(self.t) / 10000000
+end
+epoch_methods.tonumber = epoch_methods.seconds
+
+function epoch_methods.minutes(self)
+	return tonumber(self.t) / 600000000
+end
+
+function epoch_methods.hours(self)
+	return tonumber(self.t) / 36000000000
+end
+
+function epoch_methods.days(self)
+	return tonumber(self.t) / 864000000000
+end
+
+--[[
+	Epoch metamethods
+]]
+local epoch_mt = {
+	__index = epoch_methods,
+
+	__unm = function(self)
+		return Epoch(-self.t)
+	end,
+
+	__add = function(a, b)
+		if isTime(b) then
+			return newTime(toTicks(a) + b.t)
+		end
+		return Epoch(toTicks(a) + toTicks(b))
+	end,
+
+	__sub = function(a, b)
+		return Epoch(toTicks(a) - toTicks(b))
+	end,
+
+	__mul = function(a, b)
+		if type(a) == "number" then
+			return Epoch(ffi.cast(int64, tonumber(toTicks(b)) * a))
+		elseif type(b) == "number" then
+			return b * tonumber(toTicks(a)) / 1e7
+		end
+		error("Ltime: Epoch multiplication: one operand must be a number.", 2)
+	end,
+
+	__div = function(a, b)
+		if type(a) == "number" then
+			error("Ltime: Epoch division: first operand must be an Epoch.", 2)
+		elseif type(b) ~= "number" then
+			error("Ltime: Epoch division: second operand must be a number.", 2)
+		elseif b == 0 then
+			error("Ltime: Division by zero is undefined.", 2)
+		end
+		return Epoch(ffi.cast(int64, tonumber(toTicks(a)) / b))
+	end,
+
+	__mod = function(a, b)
+		local x, y = toTicks(a), toTicks(b)
+		if y == 0 then
+			error("Ltime: Modulo zero is undefined.", 2)
+		end
+		if type(b) == "number" then
+			return tonumber(x % y) / 1e7
+		end
+		return Epoch(x % y)
+	end,
+
+	__eq = function(a, b)
+		return isEpoch(a) and isEpoch(b) and a.t == b.t
+	end,
+
+	__lt = function(a, b)
+		return toTicks(a) < toTicks(b)
+	end,
+
+	__le = function(a, b)
+		return toTicks(a) <= toTicks(b)
+	end,
+
+	__concat = function(a, b)
+		return tostring(a) .. tostring(b)
+	end,
+
+	__tostring = function(self)
+		return ffi.string(buffer, C.ltime_epoch_tostring(self.t, buffer))
+	end
+}
+
+Time = ffi.metatype("ltime_time", time_mt)
+Epoch = ffi.metatype("ltime_epoch", epoch_mt)
+
+--[[
+	Module
+]]
+local ltime = {
+	VERSION = "LTime v0.9.1 (LuaJIT FFI)"
+}
+
+function ltime.Time(parameter)
+	return Time(toVMS(parameter))
+end
+
+function ltime.Epoch(parameter)
+	return Epoch(toTicks(parameter))
+end
+
+function ltime.mktime(Y, M, D, h, m, s, us)
+	if Y == nil then
+		error("Ltime: Time constructor: unsupported parameter.", 2)
+	end
+	local t = C.ltime_mktime(Y, M or 1, D or 1, h or 0, m or 0, s or 0, us or 0)
+	if t == -1 then
+		error("Ltime: Time constructor: unsupported parameter.", 2)
+	end
+	return Time(t)
+end
+
+function ltime.Format(format_string)
+	return compile(format_string, 0)
+end
+
+function ltime.EpochFormat(format_string)
+	return compile(format_string, 1)
+end
+
+function ltime.parse_http_date(s)
+	local t = C.ltime_parse_http_date(s, #s)
+	if t >= 0 then
+		return Time(t)
+	end
+end
+
+function ltime.parse_rfc3339(s)
+	local t = C.ltime_parse_rfc3339(s, #s)
+	if t >= 0 then
+		return Time(t)
+	end
+end
+
+ltime.isTime, ltime.isEpoch = isTime, isEpoch
+
+return ltime
@@ -0,0 +1,194 @@
+#include "ltime.h"
+
+/*
+ *  MessagePack timestamp extension (type -1)
+ *
+ *  timestamp 32: fixext 4,  uint32 seconds
+ *  timestamp 64: fixext 8,  uint64 nanoseconds << 34 | seconds
+ *  timestamp 96: ext 8 (12), uint32 nanoseconds, int64 seconds
+ *  The smallest form that holds the value is written. Seconds are unix
+ *  seconds; VMS ticks are 100ns, so decoding drops the last two digits of
+ *  the nanoseconds.
+ */
+
+/* Longest encoded timestamp */
+#define MSGPACK_MAX_LENGTH	15
+
+/*
+ *  Split a VMS timestamp into unix seconds and nanoseconds (always positive)
+ */
+void vmsToUnix(long long t, long long *sec, long long *nsec) {
+
+	long long d = t - VMS_1970;
+	*sec = d / 10000000LL;
+	*nsec = d % 10000000LL;
+	if (*nsec < 0) {
+		(*sec)--;
+		*nsec += 10000000LL;
+	}
+	*nsec *= 100;
+}
+
+/*
+ *  Unix seconds and nanoseconds to a VMS timestamp
+ *  Return -1 if the result is out of the Time range
+ */
+long long unixToVMS(long long sec, long long nsec) {
+
+	// VMS timestamps stay below 2^63 up to about the year 31000
+	if (nsec < 0 || nsec > 999999999 || sec < -VMS_1970 / 10000000LL || sec > 900000000000LL)
+		return -1;
+	return VMS_1970 + sec * 10000000LL + nsec / 100;
+}
+
+/*
+ *  Write n bytes of value, most significant first
+ */
+void writeBigEndian(unsigned char *p, unsigned long long value, int n) {
+
+	while (n--) {
+		p[n] = (unsigned char)value;
+		value >>= 8;
+	}
+}
+
+/*
+ *  Read n bytes, most significant first
+ */
+unsigned long long readBigEndian(const unsigned char *p, int n) {
+
+	unsigned long long value = 0;
+	for (int i = 0; i < n; i++)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+/*
+ *  Encode a VMS timestamp, out must hold MSGPACK_MAX_LENGTH bytes
+ *  Return the encoded length
+ */
+static int msgpackEncode(unsigned char *out, long long t) {
+
+	long long sec, nsec;
+	vmsToUnix(t, &sec, &nsec);
+	if (sec >= 0 && (sec >> 34) == 0) {
+		if (nsec == 0 && (sec >> 32) == 0) {
+			out[0] = 0xd6;
+			out[1] = 0xff;
+			writeBigEndian(&out[2], sec, 4);
+			return 6;
+		}
+		out[0] = 0xd7;
+		out[1] = 0xff;
+		writeBigEndian(&out[2], ((unsigned long long)nsec << 34) | (unsigned long long)sec, 8);
+		return 10;
+	}
+	out[0] = 0xc7;
+	out[1] = 12;
+	out[2] = 0xff;
+	writeBigEndian(&out[3], nsec, 4);
+	writeBigEndian(&out[7], sec, 8);
+	return 15;
+}
+
+/*
+ *  Decode a timestamp at p
+ *  Return the encoded length, 0 if p does not hold a valid timestamp
+ */
+static int msgpackDecode(const unsigned char *p, size_t length, long long *t) {
+
+	long long sec, nsec;
+	int n;
+	if (length >= 6 && p[0] == 0xd6 && p[1] == 0xff) {
+		sec = readBigEndian(&p[2], 4);
+		nsec = 0;
+		n = 6;
+	} else if (length >= 10 && p[0] == 0xd7 && p[1] == 0xff) {
+		unsigned long long value = readBigEndian(&p[2], 8);
+		sec = value & ((1ULL << 34) - 1);
+		nsec = value >> 34;
+		n = 10;
+	} else if (length >= 15 && p[0] == 0xc7 && p[1] == 12 && p[2] == 0xff) {
+		nsec = readBigEndian(&p[3], 4);
+		sec = (long long)readBigEndian(&p[7], 8);
+		n = 15;
+	} else {
+		return 0;
+	}
+	*t = unixToVMS(sec, nsec);
+	return *t < 0 ? 0 : n;
+}
+
+/*
+ *  string = Ltime.msgpack_encode(t)
+ *  t is a Time, raw ticks or anything accepted by Ltime.Time
+ */
+int msgpack_encode(lua_State *L) {
+
+	unsigned char buffer[MSGPACK_MAX_LENGTH];
+	int length = msgpackEncode(buffer, elementToVMS(L, 1));
+	lua_pushlstring(L, (const char *)buffer, length);
+	return 1;
+}
+
+/*
+ *  Time, next = Ltime.msgpack_decode(string[, init])
+ *  Decode the timestamp at position init (default 1), next is the position
+ *  following it
+ */
+int msgpack_decode(lua_State *L) {
+
+	size_t length;
+	const unsigned char *p = (const unsigned char *)luaL_checklstring(L, 1, &length);
+	lua_Integer init = luaL_optinteger(L, 2, 1);
+	long long t;
+	int n = 0;
+	if (init >= 1 && (size_t)init <= length)
+		n = msgpackDecode(p + init - 1, length - init + 1, &t);
+	if (!n)
+		luaL_error(L, LTIME_ERR_MSGPACK_FORMAT);
+	newDatetime(L)->t = t;
+	lua_pushinteger(L, init + n);
+	return 2;
+}
+
+/*
+ *  string = Ltime.msgpack_encode_many(ticks)
+ *  ticks is a Ticks object or a table of Time objects / raw ticks
+ *  Return the concatenated encoded timestamps
+ */
+int msgpack_encode_many(lua_State *L) {
+
+	lua_settop(L, 1);
+	t_ticks *ticks = toTicks(L, 1);
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	for (size_t i = 0; i < ticks->n; i++) {
+		unsigned char *buffer = (unsigned char *)luaL_prepbuffsize(&b, MSGPACK_MAX_LENGTH);
+		luaL_addsize(&b, msgpackEncode(buffer, ticksAt(ticks, i)));
+	}
+	luaL_pushresult(&b);
+	return 1;
+}
+
+/*
+ *  Ticks = Ltime.msgpack_decode_many(string)
+ *  Decode a buffer of concatenated timestamps
+ */
+int msgpack_decode_many(lua_State *L) {
+
+	size_t length;
+	const unsigned char *p = (const unsigned char *)luaL_checklstring(L, 1, &length);
+	size_t n = 0;
+	long long t;
+	for (size_t i = 0; i < length; n++) {
+		int size = msgpackDecode(p + i, length - i, &t);
+		if (!size)
+			luaL_error(L, LTIME_ERR_MSGPACK_FORMAT);
+		i += size;
+	}
+	t_ticks *ticks = newTicks(L, n);
+	for (size_t i = 0, k = 0; k < n; k++)
+		i += msgpackDecode(p + i, length - i, &ticks->t[k]);
+	return 1;
+}
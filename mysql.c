@@ -0,0 +1,260 @@
+#include "ltime.h"
+
+/*
+ *  MySQL/MariaDB binary temporal layouts
+ *
+ *  wire:       MYSQL_TIME of the binary protocol (prepared statements and
+ *              their result sets): a length byte (0, 4, 7 or 11), year on 2
+ *              bytes little endian, month, day, hour, minute, second, then
+ *              the microseconds on 4 bytes little endian. Trailing zero
+ *              parts are omitted, length 0 is the zero date.
+ *  datetime2:  DATETIME(fsp) storage of row based binlog events, 5 bytes big
+ *              endian (sign bit, year * 13 + month on 17 bits, day on 5,
+ *              hour on 5, minute on 6, second on 6) then fsp digits of
+ *              fraction on (fsp + 1) / 2 bytes.
+ *  timestamp2: TIMESTAMP(fsp) storage, unix seconds on 4 bytes big endian then
+ *              the fraction as for datetime2.
+ *  The zero date decodes to nil, or to 0 in a Ticks object.
+ */
+
+#define LAYOUT_WIRE			0
+#define LAYOUT_DATETIME2	1
+#define LAYOUT_TIMESTAMP2	2
+
+/* Longest encoded value */
+#define MYSQL_MAX_LENGTH	12
+
+static const char *layouts[] = {"wire", "datetime2", "timestamp2", NULL};
+
+/*
+ *  Write the fraction of a datetime2/timestamp2 value, us truncated to fsp digits
+ */
+static int writeFraction(unsigned char *p, unsigned us, int fsp) {
+
+	static const unsigned divisors[] = {1, 10000, 10000, 100, 100, 1, 1};
+	static const unsigned truncate[] = {1000000, 100000, 10000, 1000, 100, 10, 1};
+	int n = (fsp + 1) / 2;
+	us -= us % truncate[fsp];
+	writeBigEndian(p, us / divisors[fsp], n);
+	return n;
+}
+
+/*
+ *  Read the fraction of a datetime2/timestamp2 value into microseconds
+ *  Return -1 if out of range
+ */
+static long long readFraction(const unsigned char *p, int fsp) {
+
+	static const unsigned multipliers[] = {1, 10000, 10000, 100, 100, 1, 1};
+	int n = (fsp + 1) / 2;
+	if (n == 0)
+		return 0;
+	long long us = readBigEndian(p, n) * multipliers[fsp];
+	return us > 999999 ? -1 : us;
+}
+
+/*
+ *  Encode a VMS timestamp, out must hold MYSQL_MAX_LENGTH bytes
+ *  Return the encoded length, 0 if out of range for the layout
+ */
+static int mysqlEncode(unsigned char *out, long long t, int layout, int fsp) {
+
+	unsigned Y, M, D, h, m, s, us;
+	if (layout == LAYOUT_TIMESTAMP2) {
+		long long sec, nsec;
+		vmsToUnix(t, &sec, &nsec);
+		if (sec < 1 || sec > 0xffffffffLL)
+			return 0;
+		writeBigEndian(out, sec, 4);
+		return 4 + writeFraction(&out[4], nsec / 1000, fsp);
+	}
+	fromVMS(t, &Y, &M, &D, &h, &m, &s, &us);
+	if (Y > 9999)
+		return 0;
+	if (layout == LAYOUT_DATETIME2) {
+		unsigned long long packed = ((((((unsigned long long)Y * 13 + M) << 5 | D) << 5 | h) << 6 | m) << 6) | s;
+		writeBigEndian(out, packed | 0x8000000000ULL, 5);
+		return 5 + writeFraction(&out[5], us, fsp);
+	}
+	out[0] = us ? 11 : h || m || s ? 7 : 4;
+	out[1] = Y & 0xff;
+	out[2] = Y >> 8;
+	out[3] = M;
+	out[4] = D;
+	out[5] = h;
+	out[6] = m;
+	out[7] = s;
+	for (int i = 0; i < 4; i++)
+		out[8 + i] = (us >> (8 * i)) & 0xff;
+	return out[0] + 1;
+}
+
+/*
+ *  Decode the value at p into t, zero is set for the zero date (t is then 0)
+ *  Return the encoded length, 0 if p does not hold a valid value
+ */
+static int mysqlDecode(const unsigned char *p, size_t length, int layout, int fsp, long long *t, int *zero) {
+
+	unsigned Y = 0, M = 0, D = 0, h = 0, m = 0, s = 0;
+	long long us = 0;
+	int n;
+	*zero = 0;
+	if (layout == LAYOUT_WIRE) {
+		if (length < 1 || (p[0] != 0 && p[0] != 4 && p[0] != 7 && p[0] != 11) || length < (size_t)p[0] + 1)
+			return 0;
+		n = p[0] + 1;
+		if (n > 1) {
+			Y = p[1] | p[2] << 8;
+			M = p[3];
+			D = p[4];
+		}
+		if (n > 5) {
+			h = p[5];
+			m = p[6];
+			s = p[7];
+		}
+		if (n > 8)
+			us = p[8] | p[9] << 8 | p[10] << 16 | (unsigned long long)p[11] << 24;
+	} else {
+		int size = layout == LAYOUT_DATETIME2 ? 5 : 4;
+		n = size + (fsp + 1) / 2;
+		if (length < (size_t)n || (us = readFraction(&p[size], fsp)) < 0)
+			return 0;
+		if (layout == LAYOUT_TIMESTAMP2) {
+			long long sec = readBigEndian(p, 4);
+			*t = 0;
+			if (sec == 0 && us == 0) {
+				*zero = 1;
+				return n;
+			}
+			*t = unixToVMS(sec, us * 1000);
+			return *t < 0 ? 0 : n;
+		}
+		unsigned long long packed = readBigEndian(p, 5);
+		if (!(packed & 0x8000000000ULL))
+			return 0;	// negative values are not dates
+		packed &= 0x7fffffffffULL;
+		s = packed & 0x3f;
+		m = (packed >> 6) & 0x3f;
+		h = (packed >> 12) & 0x1f;
+		D = (packed >> 17) & 0x1f;
+		Y = (packed >> 22) / 13;
+		M = (packed >> 22) % 13;
+	}
+	*t = 0;
+	if (Y == 0 && M == 0 && D == 0 && h == 0 && m == 0 && s == 0 && us == 0) {
+		*zero = 1;
+		return n;
+	}
+	*t = toVMS(Y, M, D, h, m, s, us);
+	return *t < 0 ? 0 : n;
+}
+
+/*
+ *  Layout and fractional seconds precision arguments at index, index + 1
+ */
+static int layoutArgument(lua_State *L, int index, int *fsp) {
+
+	int layout = luaL_checkoption(L, index, NULL, layouts);
+	*fsp = luaL_optinteger(L, index + 1, 6);
+	if (*fsp < 0 || *fsp > 6)
+		luaL_error(L, LTIME_ERR_MYSQL_FSP);
+	return layout;
+}
+
+/*
+ *  string = Ltime.mysql_encode(t, layout[, fsp])
+ *  t is a Time, raw ticks or anything accepted by Ltime.Time
+ *  layout is "wire", "datetime2" or "timestamp2", fsp the fractional seconds
+ *  precision of datetime2 and timestamp2 columns (default 6)
+ */
+int mysql_encode(lua_State *L) {
+
+	int fsp, layout = layoutArgument(L, 2, &fsp);
+	unsigned char buffer[MYSQL_MAX_LENGTH];
+	int length = mysqlEncode(buffer, elementToVMS(L, 1), layout, fsp);
+	if (!length)
+		luaL_error(L, LTIME_ERR_MYSQL_RANGE);
+	lua_pushlstring(L, (const char *)buffer, length);
+	return 1;
+}
+
+/*
+ *  Time, next = Ltime.mysql_decode(string, layout[, fsp[, init]])
+ *  Decode the value at position init (default 1), next is the position
+ *  following it. Time is nil for the zero date.
+ */
+int mysql_decode(lua_State *L) {
+
+	size_t length;
+	const unsigned char *p = (const unsigned char *)luaL_checklstring(L, 1, &length);
+	int fsp, layout = layoutArgument(L, 2, &fsp);
+	lua_Integer init = luaL_optinteger(L, 4, 1);
+	long long t;
+	int zero, n = 0;
+	if (init >= 1 && (size_t)init <= length)
+		n = mysqlDecode(p + init - 1, length - init + 1, layout, fsp, &t, &zero);
+	if (!n)
+		luaL_error(L, LTIME_ERR_MYSQL_FORMAT);
+	if (zero)
+		lua_pushnil(L);
+	else
+		newDatetime(L)->t = t;
+	lua_pushinteger(L, init + n);
+	return 2;
+}
+
+/*
+ *  string = Ltime.mysql_encode_many(ticks, layout[, fsp])
+ *  ticks is a Ticks object or a table of Time objects / raw ticks
+ *  Return the concatenated encoded values
+ */
+int mysql_encode_many(lua_State *L) {
+
+	int fsp, layout = layoutArgument(L, 2, &fsp);
+	lua_settop(L, 3);
+	t_ticks *ticks = toTicks(L, 1);
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	for (size_t i = 0; i < ticks->n; i++) {
+		unsigned char *buffer = (unsigned char *)luaL_prepbuffsize(&b, MYSQL_MAX_LENGTH);
+		int length = mysqlEncode(buffer, ticksAt(ticks, i), layout, fsp);
+		if (!length)
+			luaL_error(L, LTIME_ERR_BULK_ELEMENT, (int)(i + 1));
+		luaL_addsize(&b, length);
+	}
+	luaL_pushresult(&b);
+	return 1;
+}
+
+/*
+ *  Ticks = Ltime.mysql_decode_many(string, layout[, fsp])
+ *  Decode a buffer of concatenated values, zero dates are stored as 0
+ */
+int mysql_decode_many(lua_State *L) {
+
+	size_t length;
+	const unsigned char *p = (const unsigned char *)luaL_checklstring(L, 1, &length);
+	int fsp, layout = layoutArgument(L, 2, &fsp);
+	size_t n = 0, fixed = layout == LAYOUT_WIRE ? 0 : (layout == LAYOUT_DATETIME2 ? 5 : 4) + (fsp + 1) / 2;
+	// binlog layouts have a fixed size, wire values their own length byte
+	if (fixed) {
+		if (length % fixed)
+			luaL_error(L, LTIME_ERR_MYSQL_FORMAT);
+		n = length / fixed;
+	} else {
+		for (size_t i = 0; i < length; n++) {
+			if (p[i] != 0 && p[i] != 4 && p[i] != 7 && p[i] != 11)
+				luaL_error(L, LTIME_ERR_MYSQL_FORMAT);
+			i += p[i] + 1;
+		}
+	}
+	t_ticks *ticks = newTicks(L, n);
+	for (size_t i = 0, k = 0; k < n; k++) {
+		int zero, size = mysqlDecode(p + i, length - i, layout, fsp, &ticks->t[k], &zero);
+		if (!size)
+			luaL_error(L, LTIME_ERR_MYSQL_FORMAT);
+		i += size;
+	}
+	return 1;
+}
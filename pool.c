@@ -0,0 +1,178 @@
+#include "ltime.h"
+
+/*
+ *  Pool of Time and Epoch objects
+ *
+ *  Loops that would allocate a Time or an Epoch per iteration take them from
+ *  the pool and release them when done, so the garbage collector has nothing
+ *  to do. The free objects live in the uservalue table: a stack of free Time
+ *  objects, a stack of free Epoch objects, and the set of all free objects
+ *  which makes releasing the same object twice harmless.
+ */
+
+#define POOL_TIMES	1
+#define POOL_EPOCHS	2
+#define POOL_FREE	3
+
+#define isPool(L, i) luaL_checkudata(L, i, LTIME_MT_POOL)
+
+/*
+ *  Pop a free object from the stack of the pool at index 1
+ *  Leave it on top of the stack, or nothing if the stack is empty
+ */
+static int takeFree(lua_State *L, int stack) {
+
+	lua_getuservalue(L, 1);
+	lua_rawgeti(L, -1, stack);
+	lua_Integer n = luaL_len(L, -1);
+	if (n == 0) {
+		lua_pop(L, 2);
+		return 0;
+	}
+	lua_rawgeti(L, -1, n);
+	lua_pushnil(L);
+	lua_rawseti(L, -3, n);
+	lua_rawgeti(L, -3, POOL_FREE);
+	lua_pushvalue(L, -2);
+	lua_pushnil(L);
+	lua_rawset(L, -3);
+	lua_pop(L, 1);
+	lua_replace(L, -3);
+	lua_pop(L, 1);
+	return 1;
+}
+
+/*
+ *  Push the object at index on the free stack of the pool at index 1
+ */
+static void putFree(lua_State *L, int index, int stack) {
+
+	lua_getuservalue(L, 1);
+	lua_rawgeti(L, -1, POOL_FREE);
+	lua_pushvalue(L, index);
+	if (lua_rawget(L, -2) == LUA_TNIL) {
+		lua_pushvalue(L, index);
+		lua_pushboolean(L, 1);
+		lua_rawset(L, -4);
+		lua_rawgeti(L, -3, stack);
+		lua_pushvalue(L, index);
+		lua_rawseti(L, -2, luaL_len(L, -2) + 1);
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 3);
+}
+
+/*
+ *  Pool = Ltime.Pool([n])
+ *  Pre-allocate n (default 16) Time and n Epoch objects
+ */
+int pool_new(lua_State *L) {
+
+	lua_Integer n = luaL_optinteger(L, 1, 16);
+	lua_settop(L, 0);
+	lua_newuserdata(L, 1);
+	luaL_setmetatable(L, LTIME_MT_POOL);
+	lua_createtable(L, 3, 0);
+	lua_createtable(L, n, 0);
+	lua_rawseti(L, -2, POOL_TIMES);
+	lua_createtable(L, n, 0);
+	lua_rawseti(L, -2, POOL_EPOCHS);
+	lua_createtable(L, 0, 2 * n);
+	lua_rawseti(L, -2, POOL_FREE);
+	lua_setuservalue(L, 1);
+	for (lua_Integer i = 0; i < n; i++) {
+		newDatetime(L)->t = 0;
+		putFree(L, 2, POOL_TIMES);
+		lua_pop(L, 1);
+		newEpoch(L)->t = 0;
+		putFree(L, 2, POOL_EPOCHS);
+		lua_pop(L, 1);
+	}
+	return 1;
+}
+
+/*
+ *  Take a Time from the pool, set as Ltime.Time(parameter) would
+ *  A new one is allocated when the pool is empty
+ *  Time = Pool:time([parameter])
+ */
+static int pool_time(lua_State *L) {
+
+	isPool(L, 1);
+	long long t = parameterToVMS(L, lua_gettop(L) > 1 ? 2 : 0);
+	t_datetime *self = takeFree(L, POOL_TIMES) ? (t_datetime *)lua_touserdata(L, -1) : newDatetime(L);
+	self->t = t;
+	return 1;
+}
+
+/*
+ *  Take an Epoch from the pool, set as Ltime.Epoch(parameter) would
+ *  A new one is allocated when the pool is empty
+ *  Epoch = Pool:epoch([parameter])
+ */
+static int pool_epoch(lua_State *L) {
+
+	isPool(L, 1);
+	long long t = parameterToTicks(L, lua_gettop(L) > 1 ? 2 : 0);
+	t_epoch *self = takeFree(L, POOL_EPOCHS) ? (t_epoch *)lua_touserdata(L, -1) : newEpoch(L);
+	self->t = t;
+	return 1;
+}
+
+/*
+ *  Give Time and Epoch objects back to the pool
+ *  The caller must not use them anymore
+ *  Pool = Pool:release(object, ...)
+ */
+static int pool_release(lua_State *L) {
+
+	isPool(L, 1);
+	int top = lua_gettop(L);
+	for (int i = 2; i <= top; i++) {
+		if (luaL_testudata(L, i, LTIME_MT_DATETIME))
+			putFree(L, i, POOL_TIMES);
+		else if (luaL_testudata(L, i, LTIME_MT_EPOCH))
+			putFree(L, i, POOL_EPOCHS);
+		else
+			luaL_error(L, LTIME_ERR_POOL_RELEASE);
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+/*
+ *  Number of free Time and Epoch objects
+ *  times, epochs = Pool:available()
+ */
+static int pool_available(lua_State *L) {
+
+	isPool(L, 1);
+	lua_getuservalue(L, 1);
+	lua_rawgeti(L, -1, POOL_TIMES);
+	lua_pushinteger(L, luaL_len(L, -1));
+	lua_rawgeti(L, -3, POOL_EPOCHS);
+	lua_pushinteger(L, luaL_len(L, -1));
+	lua_remove(L, -2);
+	return 2;
+}
+
+int open_pool(lua_State *L) {
+
+	static const luaL_Reg pool_methods[] = {
+		{"time", pool_time},
+		{"epoch", pool_epoch},
+		{"release", pool_release},
+		{"available", pool_available},
+		{NULL, NULL}
+	};
+
+	// create the metatable first
+	luaL_newmetatable(L, LTIME_MT_POOL);
+
+	// create the library table
+	luaL_newlib(L, pool_methods);
+	// and set the __index metamethod
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}
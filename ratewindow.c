@@ -0,0 +1,175 @@
+#include "ltime.h"
+#include <limits.h>
+
+/*
+ *  Sliding window event counter
+ *
+ *  A ring of fixed width slots, slot k counts the events of the time range
+ *  [k * resolution, (k + 1) * resolution[. The ring covers the window ending
+ *  at the newest slot seen (head), a running total is kept for that window.
+ *  Moving the head forward clears the slots that fall out of the window,
+ *  so add() and sum() are O(1) amortized and never allocate.
+ */
+
+typedef struct s_ratewindow {
+	long long	resolution;		/* slot width in ticks */
+	int			slots;			/* number of slots in the window */
+	long long	head;			/* newest slot number, LLONG_MIN when empty */
+	long long	total;			/* sum of all the slots */
+	long long	counts[1];
+} t_ratewindow;
+
+#define isRateWindow(L, i) ((t_ratewindow *)luaL_checkudata(L, i, LTIME_MT_RATEWINDOW))
+
+/*
+ *  Move the head of the window forward to slot, expiring older slots
+ */
+static void advance(t_ratewindow *self, long long slot) {
+
+	if (self->head == LLONG_MIN || slot - self->head >= self->slots) {
+		memset(self->counts, 0, self->slots * sizeof(long long));
+		self->total = 0;
+	} else {
+		for (long long k = self->head + 1; k <= slot; k++) {
+			self->total -= self->counts[k % self->slots];
+			self->counts[k % self->slots] = 0;
+		}
+	}
+	self->head = slot;
+}
+
+/*
+ *  Number of events in the window ending at slot
+ */
+static long long windowSum(t_ratewindow *self, long long slot) {
+
+	if (self->head == LLONG_MIN)
+		return 0;
+	if (slot >= self->head) {
+		advance(self, slot);
+		return self->total;
+	}
+	// looking back in time: only the slots still in the ring are known
+	long long sum = 0;
+	for (long long k = slot; k > slot - self->slots && k > self->head - self->slots; k--)
+		sum += self->counts[k % self->slots];
+	return sum;
+}
+
+/*
+ *  RateWindow = Ltime.RateWindow(window, resolution)
+ *  window and resolution can be Epoch objects, numbers of seconds or deltatime strings
+ */
+int ratewindow_new(lua_State *L) {
+
+	long long window = parameterToTicks(L, 1);
+	long long resolution = parameterToTicks(L, 2);
+	if (resolution <= 0 || window < resolution)
+		luaL_error(L, LTIME_ERR_RATEWINDOW_PARAMS);
+	long long slots = (window + resolution - 1) / resolution;
+	if (slots > INT_MAX)
+		luaL_error(L, LTIME_ERR_RATEWINDOW_PARAMS);
+	t_ratewindow *self = (t_ratewindow *)lua_newuserdata(L, sizeof(t_ratewindow) + (slots - 1) * sizeof(long long));
+	luaL_setmetatable(L, LTIME_MT_RATEWINDOW);
+	self->resolution = resolution;
+	self->slots = slots;
+	self->head = LLONG_MIN;
+	self->total = 0;
+	memset(self->counts, 0, slots * sizeof(long long));
+	return 1;
+}
+
+/*
+ *  Count n events (default 1) at time t (default now)
+ *  Events older than the window are ignored
+ *  RateWindow = RateWindow:add([t[, n]])
+ */
+static int ratewindow_add(lua_State *L) {
+
+	t_ratewindow *self = isRateWindow(L, 1);
+	long long slot = timeArgument(L, 2) / self->resolution;
+	long long n = luaL_optinteger(L, 3, 1);
+	if (self->head == LLONG_MIN || slot > self->head)
+		advance(self, slot);
+	if (slot > self->head - self->slots) {
+		self->counts[slot % self->slots] += n;
+		self->total += n;
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+/*
+ *  Number of events in the window ending at now (default current time)
+ *  sum = RateWindow:sum([now])
+ */
+static int ratewindow_sum(lua_State *L) {
+
+	t_ratewindow *self = isRateWindow(L, 1);
+	lua_pushinteger(L, windowSum(self, timeArgument(L, 2) / self->resolution));
+	return 1;
+}
+
+/*
+ *  Events per second in the window ending at now (default current time)
+ *  rate = RateWindow:rate([now])
+ */
+static int ratewindow_rate(lua_State *L) {
+
+	t_ratewindow *self = isRateWindow(L, 1);
+	long long sum = windowSum(self, timeArgument(L, 2) / self->resolution);
+	lua_pushnumber(L, sum / (self->slots * (double)self->resolution / 1e7));
+	return 1;
+}
+
+/*
+ *  Forget all events
+ *  RateWindow = RateWindow:reset()
+ */
+static int ratewindow_reset(lua_State *L) {
+
+	t_ratewindow *self = isRateWindow(L, 1);
+	memset(self->counts, 0, self->slots * sizeof(long long));
+	self->total = 0;
+	self->head = LLONG_MIN;
+	lua_settop(L, 1);
+	return 1;
+}
+
+/*
+ *  RateWindow:__tostring()
+ */
+static int ratewindow_tostring(lua_State *L) {
+
+	t_ratewindow *self = isRateWindow(L, 1);
+	lua_pushfstring(L, "LTime RateWindow (%d slots)", self->slots);
+	return 1;
+}
+
+int open_ratewindow(lua_State *L) {
+
+	static const luaL_Reg ratewindow_methods[] = {
+		{"add", ratewindow_add},
+		{"sum", ratewindow_sum},
+		{"rate", ratewindow_rate},
+		{"reset", ratewindow_reset},
+		{NULL, NULL}
+	};
+
+	static const luaL_Reg ratewindow_meta_methods[] = {
+		{"__tostring", ratewindow_tostring},
+		{NULL, NULL}
+	};
+
+	// create the metatable first
+	luaL_newmetatable(L, LTIME_MT_RATEWINDOW);
+	// and set all metamethods except __index
+	luaL_setfuncs(L, ratewindow_meta_methods, 0);
+
+	// create the library table
+	luaL_newlib(L, ratewindow_methods);
+	// and set the __index metamethod
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}
@@ -0,0 +1,481 @@
+#define _POSIX_C_SOURCE 200112L	/* shm_open, ftruncate, nanosleep */
+#include "ltime.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ *  Packed tick arrays in shared memory
+ *
+ *  The segment is a header followed by the ticks. It is either a named POSIX
+ *  shared memory object, which other processes attach read-only, or an
+ *  anonymous shared mapping inherited by the processes forked afterwards.
+ *  Stores are guarded by a seqlock: the writer makes the sequence odd while
+ *  it copies, readers retry any lookup during which the sequence changed.
+ *  A name created again with a larger capacity grows its segment: readers
+ *  see the new capacity in the header and map the segment again.
+ */
+
+#define SHM_MAGIC	0x4C54696D65546B73ULL	/* "LTimeTks" */
+#define SHM_SPINS	1000					/* reads of an odd sequence before sleeping */
+#define SHM_SLEEPS	1000					/* 1 ms sleeps before giving up on the writer */
+
+typedef struct s_shm_header {
+	unsigned long long	magic;
+	unsigned long long	capacity;
+	unsigned long long	sequence;		/* odd while a store is in progress */
+	unsigned long long	n;
+	long long			t[];
+} t_shm_header;
+
+typedef struct s_shared_ticks {
+	t_shm_header	*shm;
+	size_t			length;			/* of the mapping */
+	size_t			capacity;		/* as mapped, the header may change under readers */
+	int				writable;
+	char			name[];			/* empty for anonymous mappings */
+} t_shared_ticks;
+
+#define isSharedTicks(L, i) ((t_shared_ticks *)luaL_checkudata(L, i, LTIME_MT_SHARED_TICKS))
+
+/*
+ *  Even sequence, once the store in progress is over
+ *  Spin briefly then sleep, and raise an error after about one second: the
+ *  writer died during its store, until the name is created again
+ */
+static unsigned long long waitEven(lua_State *L, const t_shm_header *shm) {
+
+	unsigned long long sequence;
+	for (int i = 0; (sequence = __atomic_load_n(&shm->sequence, __ATOMIC_ACQUIRE)) & 1; i++) {
+		if (i < SHM_SPINS)
+			continue;
+		if (i >= SHM_SPINS + SHM_SLEEPS)
+			luaL_error(L, LTIME_ERR_SHARED_STALLED);
+		struct timespec ts = { 0, 1000000 };
+		nanosleep(&ts, NULL);
+	}
+	return sequence;
+}
+
+/*
+ *  Map a named segment again after it grew, raise an error if it cannot be
+ */
+static void remapShared(lua_State *L, t_shared_ticks *self) {
+
+	void *map = MAP_FAILED;
+	struct stat st;
+	int fd = self->name[0] ? shm_open(self->name, self->writable ? O_RDWR : O_RDONLY, 0) : -1;
+	if (fd >= 0) {
+		if (fstat(fd, &st) == 0 && (size_t)st.st_size > self->length)
+			map = mmap(NULL, st.st_size, self->writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+	}
+	if (map == MAP_FAILED)
+		luaL_error(L, LTIME_ERR_SHARED_GROWN);
+	munmap(self->shm, self->length);
+	self->shm = (t_shm_header *)map;
+	self->length = st.st_size;
+	self->capacity = (self->length - sizeof(t_shm_header)) / sizeof(long long);
+	if (self->shm->magic != SHM_MAGIC || __atomic_load_n(&self->shm->capacity, __ATOMIC_RELAXED) > self->capacity)
+		luaL_error(L, LTIME_ERR_SHARED_GROWN);
+}
+
+/*
+ *  Start of a lookup, once no store is in progress and the whole segment is mapped
+ */
+static unsigned long long readBegin(lua_State *L, t_shared_ticks *self) {
+
+	unsigned long long sequence = waitEven(L, self->shm);
+	if (__atomic_load_n(&self->shm->capacity, __ATOMIC_RELAXED) > self->capacity) {
+		remapShared(L, self);
+		sequence = waitEven(L, self->shm);
+	}
+	return sequence;
+}
+
+static inline int readRetry(const t_shm_header *shm, unsigned long long sequence) {
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&shm->sequence, __ATOMIC_RELAXED) != sequence;
+}
+
+/* Count of values, never beyond the mapping even when read during a store */
+static inline size_t sharedCount(const t_shared_ticks *self) {
+	size_t n = __atomic_load_n(&self->shm->n, __ATOMIC_RELAXED);
+	return n < self->capacity ? n : self->capacity;
+}
+
+static inline long long sharedAt(const t_shm_header *shm, size_t i) {
+	return __atomic_load_n(&shm->t[i], __ATOMIC_RELAXED);
+}
+
+static t_shared_ticks *newSharedTicks(lua_State *L, const char *name) {
+
+	size_t length = name ? strlen(name) : 0;
+	t_shared_ticks *self = (t_shared_ticks *)lua_newuserdata(L, sizeof(t_shared_ticks) + length + 1);
+	self->shm = NULL;
+	self->length = 0;
+	self->capacity = 0;
+	self->writable = 0;
+	memcpy(self->name, name ? name : "", length + 1);
+	luaL_setmetatable(L, LTIME_MT_SHARED_TICKS);
+	return self;
+}
+
+/*
+ *  SharedTicks = Ltime.SharedTicks(capacity[, name])
+ *  Create an empty shared array for up to capacity values, this process is
+ *  its writer. name is a POSIX shared memory name such as "/blackouts",
+ *  without it the array lives in an anonymous mapping shared with the
+ *  processes forked after its creation. Return nil, message on failure
+ */
+int sharedticks_new(lua_State *L) {
+
+	lua_Integer capacity = luaL_checkinteger(L, 1);
+	const char *name = luaL_optstring(L, 2, NULL);
+	luaL_argcheck(L, capacity >= 0 && (unsigned long long)capacity < ((size_t)-1 - sizeof(t_shm_header)) / sizeof(long long), 1, LTIME_ERR_TICKS_INDEX);
+	t_shared_ticks *self = newSharedTicks(L, name);
+	size_t length = sizeof(t_shm_header) + capacity * sizeof(long long);
+	int fd = name ? shm_open(name, O_RDWR | O_CREAT, 0644) : open("/dev/zero", O_RDWR);
+	if (fd < 0)
+		return luaL_fileresult(L, 0, name ? name : "/dev/zero");
+	// an existing segment may be mapped by readers: grow it, never shrink it
+	struct stat st;
+	if (name && fstat(fd, &st) == 0 && (size_t)st.st_size > length) {
+		length = st.st_size;
+		capacity = (length - sizeof(t_shm_header)) / sizeof(long long);
+	} else if (name && ftruncate(fd, length) < 0) {
+		int error = errno;
+		close(fd);
+		errno = error;
+		return luaL_fileresult(L, 0, name);
+	}
+	void *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	int error = errno;
+	close(fd);
+	if (map == MAP_FAILED) {
+		errno = error;
+		return luaL_fileresult(L, 0, name ? name : "/dev/zero");
+	}
+	self->shm = (t_shm_header *)map;
+	self->length = length;
+	self->capacity = capacity;
+	self->writable = 1;
+	// readers attached to a previous segment of this name retry on the sequence change
+	__atomic_store_n(&self->shm->sequence, __atomic_load_n(&self->shm->sequence, __ATOMIC_RELAXED) | 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	self->shm->magic = SHM_MAGIC;
+	self->shm->capacity = capacity;
+	__atomic_store_n(&self->shm->n, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&self->shm->sequence, self->shm->sequence + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/*
+ *  SharedTicks = Ltime.attach_ticks(name)
+ *  Read-only view of a shared array created by another process
+ *  Return nil, message on failure
+ */
+int sharedticks_attach(lua_State *L) {
+
+	const char *name = luaL_checkstring(L, 1);
+	t_shared_ticks *self = newSharedTicks(L, name);
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return luaL_fileresult(L, 0, name);
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int error = errno;
+		close(fd);
+		errno = error;
+		return luaL_fileresult(L, 0, name);
+	}
+	if ((size_t)st.st_size < sizeof(t_shm_header)) {
+		close(fd);
+		return luaL_error(L, LTIME_ERR_SHARED_SEGMENT);
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	int error = errno;
+	close(fd);
+	if (map == MAP_FAILED) {
+		errno = error;
+		return luaL_fileresult(L, 0, name);
+	}
+	self->shm = (t_shm_header *)map;
+	self->length = st.st_size;
+	if (self->shm->magic != SHM_MAGIC)
+		return luaL_error(L, LTIME_ERR_SHARED_SEGMENT);
+	self->capacity = (self->length - sizeof(t_shm_header)) / sizeof(long long);
+	return 1;
+}
+
+/*
+ *  Replace the contents, readers see either the old or the new values
+ *  version = SharedTicks:store(ticks)
+ *  ticks is a Ticks object or a table accepted by Ltime.Ticks
+ */
+static int sharedticks_store(lua_State *L) {
+
+	t_shared_ticks *self = isSharedTicks(L, 1);
+	lua_settop(L, 2);
+	t_ticks *source = toTicks(L, 2);
+	if (!self->writable)
+		return luaL_error(L, LTIME_ERR_SHARED_READONLY);
+	if (source->n > self->capacity)
+		return luaL_error(L, LTIME_ERR_SHARED_CAPACITY);
+	t_shm_header *shm = self->shm;
+	unsigned long long sequence = waitEven(L, shm);
+	while (!__atomic_compare_exchange_n(&shm->sequence, &sequence, sequence + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		sequence = waitEven(L, shm);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for (size_t i = 0; i < source->n; i++)
+		__atomic_store_n(&shm->t[i], ticksAt(source, i), __ATOMIC_RELAXED);
+	__atomic_store_n(&shm->n, source->n, __ATOMIC_RELAXED);
+	__atomic_store_n(&shm->sequence, sequence + 2, __ATOMIC_RELEASE);
+	lua_pushinteger(L, (sequence + 2) / 2);
+	return 1;
+}
+
+/*
+ *  Version of the contents, increases with every store
+ *  version = SharedTicks:version()
+ */
+static int sharedticks_version(lua_State *L) {
+
+	t_shared_ticks *self = isSharedTicks(L, 1);
+	lua_pushinteger(L, readBegin(L, self) / 2);
+	return 1;
+}
+
+/*
+ *  SharedTicks:__len()
+ */
+static int sharedticks_len(lua_State *L) {
+
+	t_shared_ticks *self = isSharedTicks(L, 1);
+	size_t n;
+	unsigned long long sequence;
+	do {
+		sequence = readBegin(L, self);
+		n = sharedCount(self);
+	} while (readRetry(self->shm, sequence));
+	lua_pushinteger(L, n);
+	return 1;
+}
+
+/*
+ *  Value at i (1 based), -1 when out of range
+ */
+static long long sharedGet(lua_State *L, t_shared_ticks *self, lua_Integer i) {
+
+	long long t;
+	unsigned long long sequence;
+	do {
+		sequence = readBegin(L, self);
+		t = i >= 1 && (size_t)i <= sharedCount(self) ? sharedAt(self->shm, i - 1) : -1;
+	} while (readRetry(self->shm, sequence));
+	return t;
+}
+
+/*
+ *  Get the Time at index, into dest if given
+ *  Time = SharedTicks:time(i[, dest])
+ */
+static int sharedticks_time(lua_State *L) {
+
+	t_shared_ticks *self = isSharedTicks(L, 1);
+	long long t = sharedGet(L, self, luaL_checkinteger(L, 2));
+	if (t == -1)
+		luaL_error(L, LTIME_ERR_TICKS_INDEX);
+	destDatetime(L, 3)->t = t;
+	return 1;
+}
+
+/*
+ *  SharedTicks.__index(self, key)
+ *  Integer keys return the raw ticks, other keys are method lookups
+ */
+static int sharedticks_index(lua_State *L) {
+
+	t_shared_ticks *self = isSharedTicks(L, 1);
+	if (lua_isinteger(L, 2)) {
+		long long t = sharedGet(L, self, lua_tointeger(L, 2));
+		if (t == -1)
+			lua_pushnil(L);
+		else
+			lua_pushinteger(L, t);
+		return 1;
+	}
+	lua_pushvalue(L, 2);
+	lua_rawget(L, lua_upvalueindex(1));
+	return 1;
+}
+
+/*
+ *  Binary search in sorted ticks
+ *  Return the index of the first value >= t, #SharedTicks + 1 if there is none
+ *  i = SharedTicks:search(t)
+ */
+static int sharedticks_search(lua_State *L) {
+
+	t_shared_ticks *self = isSharedTicks(L, 1);
+	long long t = elementToVMS(L, 2);
+	size_t low;
+	unsigned long long sequence;
+	do {
+		sequence = readBegin(L, self);
+		size_t high = sharedCount(self);
+		low = 0;
+		while (low < high) {
+			size_t middle = low + (high - low) / 2;
+			if (sharedAt(self->shm, middle) < t)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+	} while (readRetry(self->shm, sequence));
+	lua_pushinteger(L, low + 1);
+	return 1;
+}
+
+/*
+ *  Smallest or largest value as a Time, nil when empty
+ */
+static int sharedExtreme(lua_State *L, int largest) {
+
+	t_shared_ticks *self = isSharedTicks(L, 1);
+	size_t n;
+	long long extreme = 0;
+	unsigned long long sequence;
+	do {
+		sequence = readBegin(L, self);
+		n = sharedCount(self);
+		for (size_t i = 0; i < n; i++) {
+			long long t = sharedAt(self->shm, i);
+			if (i == 0 || (largest ? t > extreme : t < extreme))
+				extreme = t;
+		}
+	} while (readRetry(self->shm, sequence));
+	if (n == 0)
+		return 0;
+	newDatetime(L)->t = extreme;
+	return 1;
+}
+
+/*
+ *  Time = SharedTicks:min()
+ */
+static int sharedticks_min(lua_State *L) {
+
+	return sharedExtreme(L, 0);
+}
+
+/*
+ *  Time = SharedTicks:max()
+ */
+static int sharedticks_max(lua_State *L) {
+
+	return sharedExtreme(L, 1);
+}
+
+/*
+ *  Consistent copy of the values into a Ticks object, for the operations
+ *  taking Ticks (buckets, format_many, asof, ...)
+ *  Ticks = SharedTicks:ticks()
+ */
+static int sharedticks_ticks(lua_State *L) {
+
+	t_shared_ticks *self = isSharedTicks(L, 1);
+	t_ticks *copy = NULL;
+	size_t allocated = 0;
+	unsigned long long sequence;
+	do {
+		sequence = readBegin(L, self);
+		if (!copy || allocated < self->capacity) {	// first time, or the segment grew
+			lua_settop(L, 1);
+			copy = newTicks(L, allocated = self->capacity);
+		}
+		copy->n = sharedCount(self);
+		for (size_t i = 0; i < copy->n; i++)
+			copy->t[i] = sharedAt(self->shm, i);
+	} while (readRetry(self->shm, sequence));
+	return 1;
+}
+
+/*
+ *  Return the raw ticks as a Lua table of integers
+ *  table = SharedTicks:totable()
+ */
+static int sharedticks_totable(lua_State *L) {
+
+	sharedticks_ticks(L);
+	t_ticks *copy = (t_ticks *)lua_touserdata(L, -1);
+	lua_createtable(L, copy->n, 0);
+	for (size_t i = 0; i < copy->n; i++) {
+		lua_pushinteger(L, copy->t[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
+/*
+ *  Remove the name of a named segment, the mappings stay valid
+ *  true = SharedTicks:unlink()
+ */
+static int sharedticks_unlink(lua_State *L) {
+
+	t_shared_ticks *self = isSharedTicks(L, 1);
+	if (!self->name[0])
+		return luaL_error(L, LTIME_ERR_SHARED_ANONYMOUS);
+	return luaL_fileresult(L, shm_unlink(self->name) == 0, self->name);
+}
+
+/*
+ *  SharedTicks:__gc()
+ */
+static int sharedticks_gc(lua_State *L) {
+
+	t_shared_ticks *self = isSharedTicks(L, 1);
+	if (self->shm) {
+		munmap(self->shm, self->length);
+		self->shm = NULL;
+	}
+	return 0;
+}
+
+int open_sharedticks(lua_State *L) {
+
+	static const luaL_Reg sharedticks_methods[] = {
+		{"store", sharedticks_store},
+		{"version", sharedticks_version},
+		{"time", sharedticks_time},
+		{"totable", sharedticks_totable},
+		{"ticks", sharedticks_ticks},
+		{"len", sharedticks_len},
+		{"min", sharedticks_min},
+		{"max", sharedticks_max},
+		{"search", sharedticks_search},
+		{"unlink", sharedticks_unlink},
+		{NULL, NULL}
+	};
+
+	static const luaL_Reg sharedticks_meta_methods[] = {
+		{"__len", sharedticks_len},
+		{"__gc", sharedticks_gc},
+		{NULL, NULL}
+	};
+
+	// create the metatable first
+	luaL_newmetatable(L, LTIME_MT_SHARED_TICKS);
+	// and set all metamethods except __index
+	luaL_setfuncs(L, sharedticks_meta_methods, 0);
+
+	// __index dispatches integer keys, methods are its upvalue
+	luaL_newlib(L, sharedticks_methods);
+	lua_pushcclosure(L, sharedticks_index, 1);
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}
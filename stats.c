@@ -0,0 +1,63 @@
+#include "ltime.h"
+
+/*
+ *  Hot path counters (see LTIME_STATS_LIST in ltime.h)
+ */
+
+#ifdef LTIME_STATS
+
+t_stat ltimeStats[LTIME_STAT_COUNT];
+
+#define LTIME_STAT_NAME(id, name) name,
+static const char *names[] = { LTIME_STATS_LIST(LTIME_STAT_NAME) NULL };
+
+/*
+ *  counts, cycles = Ltime.stats()
+ *  Tables of the counters by name, cycles only with LTIME_STATS_TIMING
+ *  Return nil when built without LTIME_STATS
+ */
+int ltime_stats(lua_State *L) {
+
+	lua_createtable(L, 0, LTIME_STAT_COUNT);
+	for (int i = 0; i < LTIME_STAT_COUNT; i++) {
+		lua_pushinteger(L, __atomic_load_n(&ltimeStats[i].count, __ATOMIC_RELAXED));
+		lua_setfield(L, -2, names[i]);
+	}
+#ifdef LTIME_STATS_TIMING
+	lua_createtable(L, 0, LTIME_STAT_COUNT);
+	for (int i = 0; i < LTIME_STAT_COUNT; i++) {
+		lua_pushinteger(L, __atomic_load_n(&ltimeStats[i].cycles, __ATOMIC_RELAXED));
+		lua_setfield(L, -2, names[i]);
+	}
+	return 2;
+#else
+	return 1;
+#endif
+}
+
+/*
+ *  Ltime.stats_reset()
+ */
+int ltime_stats_reset(lua_State *L) {
+
+	for (int i = 0; i < LTIME_STAT_COUNT; i++) {
+		__atomic_store_n(&ltimeStats[i].count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&ltimeStats[i].cycles, 0, __ATOMIC_RELAXED);
+	}
+	return 0;
+}
+
+#else
+
+int ltime_stats(lua_State *L) {
+
+	lua_pushnil(L);
+	return 1;
+}
+
+int ltime_stats_reset(lua_State *L) {
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,218 @@
+#include "ltime.h"
+
+/*
+ *  Incremental timestamp parser for chunked input
+ *
+ *  The stream is a sequence of records (one timestamp each) ended by a
+ *  separator. Records complete within a chunk are parsed in place; only a
+ *  record straddling two chunks is carried over, in a small buffer of the
+ *  parser, so the chunks are never concatenated.
+ */
+
+#define STREAM_MAX_RECORD	256		/* longer records are reported as bad */
+
+typedef struct s_streamparser {
+	t_format	*format;			/* NULL for ISO 8601 */
+	long long	position;			/* stream offset of the next chunk */
+	long long	start;				/* stream offset of the pending record */
+	size_t		pending;			/* bytes of the pending record */
+	int			partial;			/* a record is pending */
+	int			overflow;			/* the pending record is too long */
+	char		sep;
+	char		record[STREAM_MAX_RECORD];
+} t_streamparser;
+
+#define isStreamParser(L, i) ((t_streamparser *)luaL_checkudata(L, i, LTIME_MT_STREAMPARSER))
+
+/*
+ *  Results of one call: Ticks at index ticks, offsets table above it
+ */
+typedef struct s_stream_results {
+	t_ticks		*ticks;
+	int			offsets;
+	size_t		n;
+	lua_Integer	bad;
+} t_stream_results;
+
+static void addRecord(lua_State *L, t_streamparser *self, t_stream_results *results, const char *p, size_t length, long long offset, int overflow) {
+
+	if (length && p[length - 1] == '\r')
+		length--;
+	if (length == 0 && !overflow)
+		return;
+	long long t = -1;
+	if (!overflow)
+		t = self->format ? scanVMS(self->format, p, length) : parseVMS(p, length);
+	if (t == -1) {
+		t = 0;
+		results->bad++;
+	}
+	results->ticks->t[results->n++] = t;
+	lua_pushinteger(L, offset);
+	lua_rawseti(L, results->offsets, results->n);
+}
+
+static void appendPending(t_streamparser *self, const char *p, size_t length, long long offset) {
+
+	if (!self->partial) {
+		self->partial = 1;
+		self->start = offset;
+	}
+	if (self->overflow || self->pending + length > STREAM_MAX_RECORD) {
+		self->overflow = 1;
+		return;
+	}
+	memcpy(&self->record[self->pending], p, length);
+	self->pending += length;
+}
+
+static void addPending(lua_State *L, t_streamparser *self, t_stream_results *results) {
+
+	if (self->partial)
+		addRecord(L, self, results, self->record, self->pending, self->start, self->overflow);
+	self->pending = 0;
+	self->partial = 0;
+	self->overflow = 0;
+}
+
+/*
+ *  Push the results for at most n records
+ */
+static void newResults(lua_State *L, t_stream_results *results, size_t n) {
+
+	results->ticks = newTicks(L, n);
+	lua_createtable(L, n, 0);
+	results->offsets = lua_gettop(L);
+	results->n = 0;
+	results->bad = 0;
+}
+
+static int pushResults(lua_State *L, t_stream_results *results) {
+
+	results->ticks->n = results->n;
+	lua_pushinteger(L, results->bad);
+	return 3;
+}
+
+/*
+ *  StreamParser = Ltime.StreamParser([options])
+ *  options: {sep = "\n", format = format_string or Ltime.Format}
+ */
+int streamparser_new(lua_State *L) {
+
+	const char *sep = "\n";
+	size_t length = 0;
+	const char *string = NULL;
+	if (lua_type(L, 1) == LUA_TTABLE) {
+		lua_getfield(L, 1, "sep");
+		sep = luaL_optstring(L, -1, "\n");
+		if (strlen(sep) != 1)
+			luaL_error(L, LTIME_ERR_STREAM_SEPARATOR);
+		lua_getfield(L, 1, "format");
+		if (!lua_isnil(L, -1)) {
+			t_format *source = (t_format *)luaL_testudata(L, -1, LTIME_MT_FORMAT);
+			if (source) {
+				string = source->text;
+				length = strlen(string);
+			} else {
+				string = luaL_checklstring(L, -1, &length);
+			}
+		}
+	}
+	// one block: the parser and its compiled format
+	size_t header = (sizeof(t_streamparser) + 7) & ~(size_t)7;
+	t_streamparser *self = (t_streamparser *)lua_newuserdata(L, header + (string ? formatMemorySize(length) : 0));
+	self->format = string ? compileFormat((char *)self + header, string, length, datetime_spec) : NULL;
+	self->position = 0;
+	self->pending = 0;
+	self->partial = 0;
+	self->overflow = 0;
+	self->sep = sep[0];
+	luaL_setmetatable(L, LTIME_MT_STREAMPARSER);
+	return 1;
+}
+
+/*
+ *  Parse the records completed by chunk, keep the rest for the next call
+ *  ticks, offsets, bad = StreamParser:feed(chunk)
+ *  offsets are the stream offsets (from 0) of the records, bad records are
+ *  set to 0 in ticks and counted in bad
+ */
+static int streamparser_feed(lua_State *L) {
+
+	t_streamparser *self = isStreamParser(L, 1);
+	size_t length;
+	const char *chunk = luaL_checklstring(L, 2, &length);
+	const char *p = chunk, *end = chunk + length, *sep;
+	size_t n = 0;
+	for (sep = chunk; (sep = memchr(sep, self->sep, end - sep)) != NULL; sep++)
+		n++;
+	t_stream_results results;
+	newResults(L, &results, n);
+	while (p < end) {
+		long long offset = self->position + (p - chunk);
+		sep = memchr(p, self->sep, end - p);
+		if (!sep) {
+			appendPending(self, p, end - p, offset);
+			break;
+		}
+		if (self->partial) {
+			appendPending(self, p, sep - p, offset);
+			addPending(L, self, &results);
+		} else {
+			addRecord(L, self, &results, p, sep - p, offset, 0);
+		}
+		p = sep + 1;
+	}
+	self->position += length;
+	return pushResults(L, &results);
+}
+
+/*
+ *  Parse the last record when the stream ends without a separator
+ *  ticks, offsets, bad = StreamParser:finish()
+ */
+static int streamparser_finish(lua_State *L) {
+
+	t_streamparser *self = isStreamParser(L, 1);
+	t_stream_results results;
+	newResults(L, &results, 1);
+	addPending(L, self, &results);
+	self->position = 0;
+	return pushResults(L, &results);
+}
+
+/*
+ *  Drop the pending record and start a new stream
+ *  StreamParser = StreamParser:reset()
+ */
+static int streamparser_reset(lua_State *L) {
+
+	t_streamparser *self = isStreamParser(L, 1);
+	self->position = 0;
+	self->pending = 0;
+	self->partial = 0;
+	self->overflow = 0;
+	lua_settop(L, 1);
+	return 1;
+}
+
+int open_streamparser(lua_State *L) {
+
+	static const luaL_Reg streamparser_methods[] = {
+		{"feed", streamparser_feed},
+		{"finish", streamparser_finish},
+		{"reset", streamparser_reset},
+		{NULL, NULL}
+	};
+
+	// create the metatable first
+	luaL_newmetatable(L, LTIME_MT_STREAMPARSER);
+
+	// create the library table
+	luaL_newlib(L, streamparser_methods);
+	// and set the __index metamethod
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}
@@ -152,6 +152,47 @@ assert( (E(999) <= 999) == true )
 assert( (E(999) == 999) == false )	-- not of the same type!
 
 
+print "\nEpoch format"
+
+local d = E"1 02:03:04.005006"
+print( 'Epoch:format("%d %T.%.")', d:format"%d %T.%." )
+assert(d:format"%d %T.%." == "1 02:03:04.005006")
+assert(E"01:02:00":format"%hh%Mm" == "1h02m")
+assert(E"03:04:00":format"%i" == "PT3H4M")
+assert(E(1.5):format"%l ms" == "1500 ms")
+assert(E(-90):format"%-%m:%S" == "-1:30")
+assert(E(-90):format"%+%s" == "-90")
+assert(E(0):format"%i" == "PT0S")
+assert(E"2 00:00:00":format"%i" == "P2D")
+assert(E(-1.25):format"%i" == "-PT1.25S")
+assert(d:format"%i" == "P1DT2H3M4.005006S")
+assert(d:format"%y%%" == "%y%")
+local f = ltime.EpochFormat"%h:%M:%S.%q"
+assert(tostring(f) == "%h:%M:%S.%q")
+assert(E"1 02:03:04.005":format(f) == "26:03:04.005")
+
+print "\nISO 8601 durations"
+
+assert(E"PT3H4M" == E"03:04:00")
+assert(E"P1DT2H3M4.005006S" == d)
+assert(E"P2W" == E"14 00:00:00")
+assert(E"-PT1.5S" == E(-1.5))
+assert(E"PT0.0000001S" * 1e7 == 1)
+assert(E(E"P1D":format"%i") == E"P1D")
+assert(not pcall(E, "P1Y"))
+assert(not pcall(E, "P"))
+assert(not pcall(E, "PT1.5H"))
+assert(not pcall(E, "P1DT") and not pcall(E, "PT") and not pcall(E, "P1DTT1H"))
+assert(not pcall(E, "PT1S1H") and not pcall(E, "P1D2D") and not pcall(E, "P1DT1H2H"))
+assert(not pcall(E, "P999999999W") and not pcall(E, "PT999999999H999999999S"))
+assert(E"P1W1D" == E"P8D")
+assert((T"2014-01-01" + "PT36H") == T"2014-01-02 12:00:00")
+
+local f = ltime.Format"%F %T"
+assert(T"2014-01-28 12:34:56":format(f) == "2014-01-28 12:34:56")
+assert(T"2014-01-28 12:34:56":format"%v%%" == "0x" .. T"2014-01-28 12:34:56":vms"*x":gsub("^0+", "") .. "%")
+
+
 
 -- in Lua 5.3, we have integers that can hold the full timestamp.
 if _VERSION=="Lua 5.3" then
@@ -172,6 +213,472 @@ for i=16,50 do
 	print(x)
 end
 
+print "\nHTTP dates and RFC 3339"
+
+local http = T"1994-11-06 08:49:37"
+assert(http:http_date() == "Sun, 06 Nov 1994 08:49:37 GMT")
+assert(T"1994-11-06 08:49:37.5":http_date() == "Sun, 06 Nov 1994 08:49:37 GMT")
+assert(T"2014-01-28 23:59:59":http_date() == "Tue, 28 Jan 2014 23:59:59 GMT")
+assert(T"9999-12-31 23:59:59":http_date() == "Fri, 31 Dec 9999 23:59:59 GMT")
+local y10k = T"9999-12-31 23:59:59" + E(1)
+assert(not pcall(y10k.http_date, y10k))
+assert(ltime.parse_http_date"Sun, 06 Nov 1994 08:49:37 GMT" == http)
+assert(ltime.parse_http_date"Sunday, 06-Nov-94 08:49:37 GMT" == http)
+assert(ltime.parse_http_date"Sun Nov  6 08:49:37 1994" == http)
+assert(ltime.parse_http_date"Sun, 06 Nov 1994 08:49:37" == nil and ltime.parse_http_date"Sun, 06 Foo 1994 08:49:37 GMT" == nil)
+local stamp3339 = T"2014-01-28 12:34:56.123456" + E(0.0000007)
+assert(stamp3339:rfc3339() == "2014-01-28T12:34:56Z" and stamp3339:rfc3339(3) == "2014-01-28T12:34:56.123Z")
+assert(stamp3339:rfc3339(7) == "2014-01-28T12:34:56.1234567Z")
+assert(ltime.parse_rfc3339"2014-01-28T12:34:56.1234567Z" == stamp3339)
+assert(ltime.parse_rfc3339"2014-01-28t12:34:56.123456789z" == stamp3339)
+assert(ltime.parse_rfc3339"2014-01-28 14:04:56+01:30" == T"2014-01-28 12:34:56")
+assert(ltime.parse_rfc3339"2014-01-28T00:00:00-05:00" == T"2014-01-28 05:00:00")
+assert(ltime.parse_rfc3339"2014-01-28T12:34:56" == nil and ltime.parse_rfc3339"2014-01-28T12:34:56.Z" == nil)
+assert(not pcall(stamp3339.rfc3339, stamp3339, 8))
+
+print "\nPacked ticks and bulk conversions"
+
+local a = ltime.Ticks{T"2014-01-28 12:34:56", "2014-01-29", T"2014-01-30":vms()}
+assert(#a == 3)
+assert(a[1] == T"2014-01-28 12:34:56":vms())
+assert(a:time(2) == T"2014-01-29")
+assert(a[4] == nil)
+a[3] = "2015-01-01"
+assert(a:time(3) == T"2015-01-01")
+assert(#ltime.Ticks(10) == 10 and ltime.Ticks(10)[10] == 0)
+assert(not pcall(ltime.Ticks, 1 << 61) and not pcall(ltime.Ticks, -1))
+assert(ltime.Ticks(a):totable()[3] == a[3])
+
+local strings = {}
+for i = 1, 5000 do
+	strings[i] = tostring(T"2014-01-28 12:34:56.000001" + i * 3600.5)
+end
+local parsed = ltime.parse_many(strings, {threads=4})
+assert(#parsed == 5000)
+for i = 1, 5000 do
+	assert(parsed:time(i) == T(strings[i]))
+end
+local formatted = ltime.format_many(parsed, "%Y-%m-%d %H:%M:%S.%.", {threads=4})
+for i = 1, 5000 do
+	assert(formatted[i] == strings[i], formatted[i])
+end
+assert(ltime.format_many({T"2014-01-28"}, ltime.Format"%F")[1] == "2014-01-28")
+local lines = ltime.parse_many("2014-01-28 12:00:00\r\n2014-01-29\n2014-01-30T01:02:03")
+assert(#lines == 3 and lines:time(3) == T"2014-01-30 01:02:03" and lines:time(1) == T"2014-01-28 12:00:00")
+assert(not pcall(ltime.parse_many, {"2014-01-28", "garbage"}))
+
+assert(ltime.format_join(a, "%F", ",") == "2014-01-28,2014-01-29,2015-01-01")
+assert(ltime.format_join({T"2014-01-28"}, ltime.Format("%Y")) == "2014" and ltime.format_join({}, "%F", ",") == "")
+local out = io.tmpfile()
+assert(ltime.format_into(out, a, "%F %T", "\n") == out)
+out:seek("set")
+assert(out:read("a") == "2014-01-28 12:34:56\n2014-01-29 00:00:00\n2015-01-01 00:00:00")
+out:close()
+assert(not pcall(ltime.format_into, out, a, "%F"))
+
+local csv = 'id,name,when\r\n1,a,2014-01-28 12:00:00\r\n2,"b, c","2014-01-29"\r\n\r\n3,d,garbage\n4,e\n'
+local column, errors, bad = ltime.parse_column(csv, {col=3, header=true})
+assert(#column == 4 and bad == 2 and errors == "\12")
+assert(column:time(1) == T"2014-01-28 12:00:00" and column:time(2) == T"2014-01-29" and column[3] == 0)
+column, errors, bad = ltime.parse_column("x\t28/Jan/2014:12:34:56.5\ny\t01/feb/2014:01:30:00 PM\n",
+	{sep="\t", col=2, format="%d/%b/%Y:%T%n%p"})
+assert(bad == 1 and errors == "\1")
+column = ltime.parse_column("x\t28/Jan/2014:12:34:56.5\n", {sep="\t", col=2, format=ltime.Format("%d/%b/%Y:%T.%.")})
+assert(column:time(1) == T"2014-01-28 12:34:56.5")
+column = ltime.parse_column("01:30 pm, March 10 2015\n1390912496.25", {sep="|", format="%I:%M %p, %B %e %Y"})
+assert(column:time(1) == T"2015-03-10 13:30:00" and column[2] == 0)
+assert(ltime.parse_column("1390912496.25", {format="%s.%."}):time(1) == T"2014-01-28 12:34:56.25")
+local sround = T"2014-01-28 12:34:56.25"
+assert(sround:format"%s.%." == "1390912496.250000" and T"1969-12-31 23:59:59.5":format"%s" == "-1")
+assert(ltime.parse_column(sround:format"%s.%.", {format="%s.%."}):time(1) == sround)
+assert(not pcall(ltime.parse_column, "x", {sep=";;"}))
+assert(not pcall(ltime.parse_column, "2014-01-28", {col=(1 << 32) + 1}) and not pcall(ltime.parse_column, "x", {col=0}))
+column, errors, bad = ltime.parse_column("253402300799\n253402300800\n999999999999\n", {format="%s"})
+assert(column:time(1) == T"9999-12-31 23:59:59" and bad == 2)
+column, errors, bad = ltime.parse_column("9999-12-31\n10000-01-01\n99999-01-01\n", {format="%F"})
+assert(column:time(1) == T"9999-12-31" and bad == 2)
+
+local sorted = ltime.Ticks{"2014-01-28", "2014-01-28 06:00:00", "2014-01-28 12:00:00", "2014-01-29"}
+assert(sorted:min() == T"2014-01-28" and sorted:max() == T"2014-01-29")
+assert(sorted:search(T"2014-01-28 06:00:00") == 2 and sorted:search(T"2014-01-28 07:00:00") == 3)
+assert(sorted:search(T"2014-01-27") == 1 and sorted:search(T"2014-02-01") == 5)
+local counts = sorted:buckets(T"2014-01-28", "12:00:00", 2)
+assert(not pcall(sorted.buckets, sorted, T"2014-01-28", "12:00:00", -1))
+local wide = ltime.Ticks{math.mininteger, -1, math.maxinteger}:buckets(math.mininteger, "24:00:00", 2)
+assert(wide[1] == 1 and wide[2] == 0)
+assert(not pcall(sorted.buckets, sorted, T"2014-01-28", "12:00:00", math.maxinteger))
+assert(#counts == 2 and counts[1] == 2 and counts[2] == 1)
+assert(ltime.Ticks(0):min() == nil)
+
+local path = os.tmpname()
+local file = io.open(path, "wb")
+for i = 1, #sorted do file:write(sorted:time(i):vms("*b")) end
+file:close()
+local view = ltime.mmap_ticks(path)
+assert(#view == 4 and view[2] == sorted[2] and view:time(4) == T"2014-01-29")
+assert(view:min() == sorted:min() and view:search(T"2014-01-28 07:00:00") == 3)
+assert(ltime.format_many(view, "%F")[4] == "2014-01-29")
+assert(ltime.Ticks(view)[3] == sorted[3])
+assert(not pcall(function() view[1] = 0 end))
+assert(ltime.mmap_ticks(path, "little")[1] ~= sorted[1])
+os.remove(path)
+assert(ltime.mmap_ticks(path) == nil)
+
+print "\nCompression"
+
+local series = {}
+for i = 1, 1000 do series[i] = T"2014-01-28":vms() + i * 10000000 + (i % 7 == 0 and 12345 or 0) end
+local blob = ltime.compress(series)
+assert(#blob < 1000 * 8 / 4)
+local restored = ltime.decompress(blob)
+assert(#restored == 1000 and restored[1] == series[1] and restored[1000] == series[1000] and restored[700] == series[700])
+local encoder = ltime.TicksEncoder()
+for i = 1, #series do encoder:append(series[i]) end
+assert(#encoder == 1000 and encoder:data() == blob)
+assert(ltime.decompress(ltime.compress{T"2014-01-28", 0, math.maxinteger})[3] == math.maxinteger)
+assert(#ltime.decompress(ltime.TicksEncoder():data()) == 0)
+assert(not pcall(ltime.decompress, "LTC1\5") and not pcall(ltime.decompress, "garbage"))
+
+print "\nMessagePack and CBOR"
+
+local stamp = T"2014-01-28 12:34:56"
+assert(ltime.msgpack_encode(stamp) == "\xd6\xff\x52\xe7\xa3\xf0")
+assert(#ltime.msgpack_encode(stamp + 0.1) == 10 and #ltime.msgpack_encode(T"1900-01-01") == 15)
+assert(ltime.cbor_encode(stamp) == "\xc1\x1a\x52\xe7\xa3\xf0")
+assert(ltime.cbor_encode(stamp + E"00:00:00.1234567", 1001) == "\xd9\x03\xe9\xa2\x01\x1a\x52\xe7\xa3\xf0\x28\x1a\x07\x5b\xca\x00")
+for _, v in ipairs{stamp, stamp + E"00:00:00.1234567", T"1900-01-01", T"1858-11-17"} do
+	assert(ltime.msgpack_decode(ltime.msgpack_encode(v)) == v)
+	assert(ltime.cbor_decode(ltime.cbor_encode(v, 1001)) == v)
+end
+assert(ltime.cbor_decode(ltime.cbor_encode(stamp + 0.5)) == stamp + 0.5)
+assert(ltime.cbor_decode("\xc1\xf9\x3c\x00") == T"1970-01-01 00:00:01")
+local packed = ltime.msgpack_encode_many{stamp, stamp + 0.1}
+local first, next = ltime.msgpack_decode(packed)
+assert(first == stamp and next == 7 and ltime.msgpack_decode(packed, next) == stamp + 0.1)
+assert(ltime.msgpack_decode_many(packed)[2] == (stamp + 0.1):vms())
+assert(ltime.cbor_decode_many(ltime.cbor_encode_many({stamp, stamp + 0.1}, 1001))[2] == (stamp + 0.1):vms())
+assert(not pcall(ltime.msgpack_decode, "\xd6\xff\0") and not pcall(ltime.cbor_decode, "\xc2\0"))
+assert(not pcall(ltime.cbor_encode, stamp, 2))
+
+print "\nMySQL binary layouts"
+
+local dt = T"2014-01-28 12:34:56.123456"
+assert(ltime.mysql_encode(dt, "wire") == "\11\xde\7\1\28\12\34\56\x40\xe2\1\0")
+assert(ltime.mysql_encode(T"2014-01-28", "wire") == "\4\xde\7\1\28")
+assert(ltime.mysql_encode(dt, "datetime2") == "\x99\x91\xf8\xc8\xb8\x01\xe2\x40")
+assert(ltime.mysql_encode(dt, "datetime2", 3) == "\x99\x91\xf8\xc8\xb8\x04\xce")
+assert(ltime.mysql_encode(dt, "timestamp2", 0) == "\x52\xe7\xa3\xf0")
+for _, layout in ipairs{"wire", "datetime2", "timestamp2"} do
+	local value, next = ltime.mysql_decode(ltime.mysql_encode(dt, layout), layout)
+	assert(value == dt and next == #ltime.mysql_encode(dt, layout) + 1)
+	assert(layout == "wire" or ltime.mysql_decode(ltime.mysql_encode(dt, layout, 3), layout, 3) == T"2014-01-28 12:34:56.123")
+	local many = ltime.mysql_decode_many(ltime.mysql_encode_many({dt, T"2000-02-29 23:59:59"}, layout, 0), layout, 0)
+	assert(#many == 2 and (layout == "wire" or many:time(1) == T"2014-01-28 12:34:56") and many:time(2) == T"2000-02-29 23:59:59")
+end
+assert(ltime.mysql_decode("\0", "wire") == nil and ltime.mysql_decode("\x80\0\0\0\0", "datetime2", 0) == nil)
+assert(ltime.mysql_decode_many("\0\4\xde\7\1\28", "wire")[1] == 0)
+assert(not pcall(ltime.mysql_decode, "\3\1\2\3", "wire") and not pcall(ltime.mysql_encode, dt, "binary"))
+assert(not pcall(ltime.mysql_encode, T"1900-01-01", "timestamp2"))
+
+print "\nHistogram"
+
+local h = ltime.Histogram(3)
+for i = 1, 10000 do h:record(E(i / 1000)) end
+assert(h:count() == 10000 and #h == 10000)
+assert(h:max() == E(10) and h:min() == E(0.001))
+assert(h:mean() == E(5.0005))
+assert(math.abs(h:percentile(50):seconds() - 5) < 5 * 1e-3)
+assert(math.abs(h:percentile(99):seconds() - 9.9) < 9.9 * 1e-3)
+assert(h:percentile(100) == E(10))
+local h2 = ltime.Histogram(h:serialize())
+assert(h2:count() == h:count() and h2:mean() == h:mean() and h2:percentile(90) == h:percentile(90))
+h2:merge(h)
+assert(h2:count() == 20000 and h2:percentile(50) == h:percentile(50))
+local h3 = ltime.Histogram(2, "24:00:00"):merge(h)
+assert(h3:count() == 10000 and math.abs(h3:percentile(50):seconds() - 5) < 5 * 1e-2)
+h:record_ticks(10000000, 10)
+assert(h:count() == 10010)
+assert(not pcall(h.record_ticks, h, 10000000, 0) and not pcall(h.record, h, E(1), -5) and h:count() == 10010)
+h:reset()
+assert(h:count() == 0 and h:max() == E(0))
+assert(not pcall(ltime.Histogram, 6))
+assert(not pcall(ltime.Histogram, "garbage"))
+
+print "\nRateWindow"
+
+local rw = ltime.RateWindow(E"00:01:00", 1)
+local t0 = T"2014-01-28 12:00:00"
+for i = 0, 119 do rw:add(t0 + i, 2) end
+assert(rw:sum(t0 + 119) == 120)
+assert(rw:rate(t0 + 119) == 2)
+assert(rw:sum(t0 + 149) == 60)
+assert(rw:sum(t0 + 90) == 2)	-- only slot 90 is still in the ring
+rw:add(t0 + 80)	-- too old, ignored
+assert(rw:sum(t0 + 149) == 60)
+assert(rw:sum(t0 + 1000) == 0)
+rw:add(t0 + 1000.5):add(t0 + 1000.9, 3)
+assert(rw:sum(t0 + 1000) == 4 and rw:sum(t0 + 1059) == 4 and rw:sum(t0 + 1060) == 0)
+assert(rw:reset():sum(t0) == 0)
+assert(ltime.RateWindow(60, 1):add():sum() == 1)
+assert(not pcall(ltime.RateWindow, 1, 2))
+
+print "\nTimerWheel"
+
+local tw = ltime.TimerWheel(E(0.001), t0)
+local late = tw:schedule(t0 + 86400 * 30, "late")	-- past all the levels
+tw:schedule(t0 + 2, "b")
+tw:schedule(t0 + 1, "a")
+tw:schedule(t0 + 2, "c")
+local gone = tw:schedule(t0 + 1.5, "gone")
+tw:schedule(t0 + 3600, "hour")
+assert(tw:count() == 6 and #tw == 6)
+assert(tw:cancel(gone) and not tw:cancel(gone))
+assert(#tw:advance(t0 + 0.999) == 0)
+local fired = tw:advance(t0 + 2)
+assert(#fired == 3 and fired[1] == "a" and fired[2] == "b" and fired[3] == "c")
+tw:schedule(t0, "due")
+assert(tw:advance(t0 + 2)[1] == "due")
+fired = tw:advance(t0 + 86400 * 30)
+assert(#fired == 2 and fired[1] == "hour" and fired[2] == "late")
+assert(#tw == 0 and not tw:cancel(late))
+assert(not pcall(ltime.TimerWheel, 0))
+
+print "\nDeadlineQueue"
+
+local dq = ltime.DeadlineQueue()
+local lease = dq:push(t0 + 30, "lease")
+dq:push(t0 + 10, "retry1")
+local retry2 = dq:push(t0 + 10, "retry2")
+dq:push(t0 + 20, "retry3")
+assert(#dq == 4 and dq:count() == 4)
+local dt, dv = dq:peek()
+assert(dt == t0 + 10 and dv == "retry1" and #dq == 4)
+assert(dq:update(lease, t0 + 5))
+assert(dq:remove(retry2) and not dq:remove(retry2) and not dq:update(retry2, t0))
+dt, dv = dq:pop()
+assert(dt == t0 + 5 and dv == "lease")
+local drained = dq:pop_until(t0 + 20)
+assert(#drained == 2 and drained[1] == "retry1" and drained[2] == "retry3")
+assert(#dq == 0 and dq:pop() == nil and #dq:pop_until(t0 + 100) == 0)
+
+print "\nLogClock"
+
+local clock = ltime.LogClock"%F %T.%q [%Y]"
+assert(clock:format(T"2014-01-28 12:34:56.123456") == "2014-01-28 12:34:56.123 [2014]")
+assert(clock(T"2014-01-28 12:34:56.987") == "2014-01-28 12:34:56.987 [2014]")
+assert(clock(T"2014-01-28 12:34:57.5") == "2014-01-28 12:34:57.500 [2014]")
+assert(ltime.LogClock(ltime.Format"%T%.")(T"2014-01-28 12:34:56.123456") == "12:34:56123456")
+assert(tostring(clock) == "%F %T.%q [%Y]" and #clock:now() == 30 and #clock:format() == 30)
+
+print "\nPool"
+
+local pool = ltime.Pool(2)
+assert(select(1, pool:available()) == 2 and select(2, pool:available()) == 2)
+local pt, pe = pool:time"2014-01-28 12:34:56", pool:epoch"01:00:00"
+assert(pt == T"2014-01-28 12:34:56" and pe == E"01:00:00" and pool:available() == 1)
+assert(pt:date(nil, pool:time()) == T"2014-01-28" and pt:time(nil, pe) == E"12:34:56" and pe == E"12:34:56")
+assert(pt:clone(pt) == pt and pt:date() == T"2014-01-28" and pt:time() == pe)
+pool:release(pt, pe, pe)
+local times, epochs = pool:available()
+assert(times == 1 and epochs == 2 and rawequal(pool:epoch(), pe))
+assert(pool:time() and pool:time() and pool:available() == 0 and pool:time(0) == T(0))
+assert(not pcall(pool.release, pool, {}))
+local pticks = ltime.Ticks{T"2014-01-28"}
+assert(rawequal(pticks:time(1, pt), pt) and pt == T"2014-01-28")
+
+-- collection cycles of a loop over times, counted by a finalizer re-armed each cycle
+local function gcCycles(loop)
+	local cycles, armed = 0, true
+	local function sentinel()
+		setmetatable({}, {__gc = function() cycles = cycles + 1; if armed then sentinel() end end})
+	end
+	loop()	-- warm up
+	collectgarbage("collect")
+	sentinel()
+	for _ = 1, 200 do loop() end
+	armed = false
+	return cycles
+end
+local pseries = ltime.Ticks(1000)
+for i = 1, #pseries do pseries[i] = T"2014-01-28":vms() + i * 10000000 end
+assert(gcCycles(function()
+	for i = 1, #pseries do local t = pseries:time(i); t:date(); t:time() end
+end) > 0)
+local pd = pool:time()
+assert(gcCycles(function()
+	for i = 1, #pseries do pseries:time(i, pt):date(nil, pd); pt:time(nil, pe) end
+end) == 0)
+
+print "\nCached now"
+
+ltime.update_now()
+local cn = ltime.cached_now()
+assert(T() - cn < 1 and T() >= cn and ltime.cached_now_ticks() == cn:vms())
+assert(rawequal(ltime.cached_now(pt), pt) and pt == cn)
+assert(not pcall(ltime.start_clock, 0) and not pcall(ltime.start_clock, 2))
+ltime.start_clock(0.001)
+ltime.start_clock"00:00:00.002"
+local spin = os.clock()
+while ltime.cached_now_ticks() == cn:vms() and os.clock() - spin < 1 do end
+assert(ltime.cached_now() > cn)
+ltime.stop_clock()
+ltime.stop_clock()
+
+print "\nTimer descriptors"
+
+local timer = ltime.timerfd(E"00:00:00.02", 0.01)
+if timer then
+	assert(timer:fd() >= 0 and timer:read_expirations() == 0)
+	local left = timer:remaining()
+	assert(left > 0 and left <= E"00:00:00.02")
+	local spin = os.clock()
+	while timer:read_expirations() == 0 and os.clock() - spin < 1 do end
+	assert(rawequal(timer:disarm(), timer) and timer:remaining() == nil)
+	local rt = ltime.timerfd(T() - 60)
+	spin = os.clock()
+	local fired = 0
+	while fired == 0 and os.clock() - spin < 1 do fired = rt:read_expirations() end
+	assert(fired == 1 and rt:rearm(T() + 3600):remaining() > E"00:59:00")
+	rt:close()
+	assert(not pcall(rt.read_expirations, rt) and not pcall(timer.rearm, timer, 1, 0))
+end
+
+print "\nLog search"
+
+local logpath = os.tmpname()
+local logfile = io.open(logpath, "w")
+local logt = T"2014-01-28 12:00:00"
+for i = 0, 999 do
+	logfile:write(tostring(logt + i * 1.5), " INFO event ", i, "\n")
+	if i % 100 == 0 then logfile:write("  continuation of ", i, "\n") end
+end
+logfile:close()
+local offset, length = ltime.logsearch(logpath, logt + 30, logt + 60)
+logfile = io.open(logpath)
+logfile:seek("set", offset)
+local window = logfile:read(length)
+logfile:close()
+assert(window:match"^2014%-01%-28 12:00:30 INFO event 20\n" and select(2, window:gsub("\n", "")) == 20)
+local lines = {}
+for line in ltime.loglines(logpath, logt + 149, "2014-01-28 12:02:32") do lines[#lines + 1] = line end
+assert(#lines == 3 and lines[1]:match"event 100$" and lines[2] == "  continuation of 100" and lines[3]:match"event 101$")
+assert(select(2, ltime.logsearch(logpath, logt - 10, logt + 3000)) == #io.open(logpath):read"a")
+assert(select(2, ltime.logsearch(logpath, logt + 3000, logt + 4000)) == 0)
+assert(ltime.logsearch(logpath .. ".missing", logt, logt) == nil and not pcall(ltime.loglines, logpath .. ".missing", logt, logt))
+os.remove(logpath)
+
+print "\nStreamParser"
+
+local sp = ltime.StreamParser()
+local sk, so, sbad = sp:feed"2014-01-28 12:34:56\n2014-01-2"
+assert(#sk == 1 and sk:time(1) == T"2014-01-28 12:34:56" and so[1] == 0 and sbad == 0)
+sk, so, sbad = sp:feed"9 08:00:00.5\r\n\ngarbage\n2014-"
+assert(#sk == 2 and sk:time(1) == T"2014-01-29 08:00:00.5" and so[1] == 20 and so[2] == 44 and sk[2] == 0 and sbad == 1)
+sk, so = sp:feed""
+assert(#sk == 0 and #so == 0)
+sk, so, sbad = sp:finish()
+assert(#sk == 1 and so[1] == 52 and sbad == 1 and #sp:finish() == 0)
+sp = ltime.StreamParser{sep = ";", format = ltime.Format"%d/%m/%Y %H:%M"}
+sk = sp:feed"28/01/2014 12:3"
+assert(#sk == 0)
+sk = sp:feed(string.rep("x", 300) .. ";28/01/2014 12:35;")
+assert(#sk == 2 and sk[1] == 0 and sk:time(2) == T"2014-01-28 12:35")
+assert(#sp:reset():feed"28/01/2014 12:36;" == 1 and not pcall(ltime.StreamParser, {sep = "ab"}))
+
+print "\nSeries alignment"
+
+local at = T"2014-01-28 12:00:00"
+local src = ltime.Ticks{at, at + 10, at + 20, at + 35}
+local ref = {at - 1, at + 5, at + 20, at + 59}
+local idx = ltime.asof(ref, src)
+assert(idx[1] == 0 and idx[2] == 1 and idx[3] == 3 and idx[4] == 4)
+idx = ltime.asof(ref, src, 5)
+assert(idx[2] == 1 and idx[3] == 3 and idx[4] == 0 and #ltime.asof({}, src) == 0)
+local grid, ff = ltime.resample(src, 15, "ffill")
+assert(#grid == 3 and grid:time(1) == at and grid:time(3) == at + 30)
+assert(ff[1] == 1 and ff[2] == 2 and ff[3] == 3)
+local _, near = ltime.resample(src, "00:00:15", "nearest")
+assert(near[1] == 1 and near[2] == 2 and near[3] == 4)
+local _, cnt = ltime.resample(src, 15, "count")
+assert(cnt[1] == 2 and cnt[2] == 1 and cnt[3] == 1)
+local _, mean = ltime.resample(src, 5, "mean", {1, 2, 3, 4})
+assert(#mean == 8 and mean[1] == 1 and mean[2] ~= mean[2] and mean[3] == 2 and mean[8] == 4)
+local _, sum = ltime.resample(src, 5, "sum", {1, 2, 3, 4})
+assert(sum[2] == 0 and sum[5] == 3 and select(2, ltime.resample(src, 60, "max", {1, 5, 3, 4}))[1] == 5)
+assert(not pcall(ltime.resample, src, 0, "count") and not pcall(ltime.resample, src, 10, "median"))
+assert(not pcall(ltime.resample, src, 10, "sum", {1}) and #ltime.resample({}, 10, "count") == 0)
+
+print "\nSharedTicks"
+
+local shared = ltime.SharedTicks(4)
+assert(#shared == 0 and shared:search(0) == 1 and shared:min() == nil and shared[1] == nil)
+local sv = shared:version()
+assert(shared:store{T"2014-01-28", T"2014-02-01", T"2014-03-01"} == sv + 1 and shared:version() == sv + 1)
+assert(#shared == 3 and shared:time(2) == T"2014-02-01" and shared[3] == T"2014-03-01":vms())
+assert(shared:search"2014-01-30" == 2 and shared:search"2015-01-01" == 4 and shared:max() == T"2014-03-01")
+assert(#shared:ticks() == 3 and shared:ticks()[1] == shared:totable()[1])
+assert(not pcall(shared.store, shared, ltime.Ticks(5)) and not pcall(shared.unlink, shared))
+local shmname = "/ltime_test_" .. tostring(os.time())
+local named = ltime.SharedTicks(8, shmname)
+if named then
+	named:store(shared:ticks())
+	local attached = assert(ltime.attach_ticks(shmname))
+	assert(#attached == 3 and attached:time(1) == T"2014-01-28" and attached:version() == named:version())
+	assert(not pcall(attached.store, attached, {}))
+	named:store{T"2014-04-01"}
+	assert(#attached == 1 and attached:time(1) == T"2014-04-01")
+	local again = assert(ltime.SharedTicks(2, shmname))
+	assert(again:store(ltime.Ticks(8)) and #attached == 8 and attached[8] == 0)
+	local grown = assert(ltime.SharedTicks(16, shmname))
+	grown:store(ltime.Ticks(16))
+	assert(#attached == 16 and attached[16] == 0 and attached:search(1) == 17 and #attached:ticks() == 16)
+	assert(#again == 16 and again:max():vms() == 0)
+	assert(named:unlink() and ltime.attach_ticks(shmname) == nil)
+end
+
+print "\nForeign encodings"
+
+local ft = T"2014-01-28 12:34:56.123456" + E(0.0000007)
+local fk = ltime.Ticks{ft, T"1969-12-31 23:59:59.5"}
+local ux = ltime.encode_ticks("unix", fk)
+assert(ux[1] == 1390912496 and ux[2] == -1)
+assert(ltime.encode_ticks("unix_ms", fk)[2] == -500 and ltime.encode_ticks("unix_ns", fk)[1] == 1390912496123456700)
+assert(ltime.decode_ticks("unix_us", {1390912496123456}):time(1) == T"2014-01-28 12:34:56.123456")
+assert(ltime.decode_ticks("unix_ns", {1390912496123456789})[1] == ft:vms())
+assert(ltime.decode_ticks("filetime", {130353860961234567})[1] == ft:vms())
+assert(ltime.encode_ticks("excel", {T"2014-01-28 12:00:00"})[1] == 41667.5)
+assert(ltime.decode_ticks("excel", {41667.5}):time(1) == T"2014-01-28 12:00:00")
+assert(ltime.decode_ticks("ntp", {(3599901296 << 32) | 0x80000000}):time(1) == T"2014-01-28 12:34:56.5")
+for _, enc in ipairs{"unix_us", "filetime", "ntp"} do
+	local copy = ltime.Ticks(fk)
+	assert(rawequal(ltime.encode_ticks(enc, copy, copy), copy))
+	assert(rawequal(ltime.decode_ticks(enc, copy, copy), copy) and copy[2] == fk[2])
+end
+assert(not pcall(ltime.decode_ticks, "unix", {1.5}) and not pcall(ltime.decode_ticks, "mjd", {1}))
+assert(not pcall(ltime.encode_ticks, "unix", fk, ltime.Ticks(3)))
+assert(not pcall(ltime.decode_ticks, "unix", {0, 1 << 60}) and not pcall(ltime.decode_ticks, "unix_ms", {math.mininteger}))
+assert(select(2, pcall(ltime.decode_ticks, "unix", {0, 1 << 60})):find"index 2")
+assert(not pcall(ltime.decode_ticks, "excel", {0 / 0}) and not pcall(ltime.decode_ticks, "excel", {math.huge}))
+assert(not pcall(ltime.decode_ticks, "excel", {1e300}) and not pcall(ltime.decode_ticks, "excel", {-1e300}))
+assert(not pcall(ltime.encode_ticks, "unix_ns", {T"2262-04-12"}) and ltime.encode_ticks("unix_ns", {T"2262-04-11"})[1] > 0)
+assert(not pcall(ltime.encode_ticks, "ntp", {T"2036-02-08"}) and not pcall(ltime.encode_ticks, "ntp", {T"1899-12-31"}))
+assert(not pcall(ltime.encode_ticks, "unix", {math.mininteger}) and not pcall(ltime.encode_ticks, "filetime", {math.maxinteger}))
+
+print "\nStats"
+
+-- counters are only compiled in with -DLTIME_STATS
+if ltime.stats() then
+	ltime.stats_reset()
+	local st = T"2014-01-28" + E"01:00:00"
+	local fmt = st:format"%F"
+	local counts, cycles = ltime.stats()
+	assert(counts.time_string == 1 and counts.epoch_string == 1 and counts.time_format == 1)
+	assert(counts.time_alloc == 2 and counts.epoch_alloc == 1 and counts.time_metamethod == 1)
+	assert(cycles == nil or cycles.time_format > 0)
+	ltime.stats_reset()
+	assert(ltime.stats().time_alloc == 0)
+end
+
 -- Concat operation
 print("Current UTC time is " .. T())
 print(T() .. " is the current UTC time is")
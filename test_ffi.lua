@@ -0,0 +1,103 @@
+-- Compatibility tests of the LuaJIT FFI binding, the Time and Epoch checks of test.lua
+print "LTime FFI module test for LuaJIT"
+
+package.cpath = "./?.so;" .. package.cpath
+package.path = "./?.lua;" .. package.path
+local ltime = require"ltime_ffi"
+
+-- Shortcuts
+local T, E = ltime.Time, ltime.Epoch
+
+print( "Time module ", ltime.VERSION)
+
+local now = T()
+local strtime = tostring(now)
+print("Now", now)
+assert(now == T(strtime))
+assert(tostring(now) == strtime)
+
+print "\nTime arithmetics"
+
+assert(now+3600 == now + E"01:00:00")
+assert(now+E"01:00:00" == now + "01:00:00")
+assert(now-3600 == now - E"01:00:00")
+assert(now-E"01:00:00" == now - "01:00:00")
+assert(ltime.isEpoch(now - T"2013-09-01") and now - T"2013-09-01" > 0)
+assert(not pcall(function() return -now end) and not pcall(function() return now * 5 end))
+assert(not pcall(function() return now + now end))
+
+local t = T"2014-01-28 12:34:56.123456"
+assert(tostring(t) == "2014-01-28 12:34:56.123456" and tostring(T"2014-01-28") == "2014-01-28 00:00:00")
+assert(t % 3600 == 34 * 60 + 56.123456)
+assert(t % E"01:00:00" == E"00:34:56.123456" and t % "01:00:00" == E"00:34:56.123456")
+assert(t:clone():floor(1800) == T"2014-01-28 12:30:00" and t:clone():floor"00:30:00" == T"2014-01-28 12:30:00")
+assert(t:clone():ceil(E"00:30:00") == T"2014-01-28 13:00:00")
+assert(t < t + 1e-7 and t <= t and not (t < t) and t > T"2014-01-28")
+assert(t .. "" == tostring(t) and "at " .. t == "at " .. tostring(t))
+
+print "\nTime methods"
+
+assert(t:time() == E"12:34:56.123456" and t:date() == T"2014-01-28")
+assert(t:clone():time"08:00:00" == T"2014-01-28 08:00:00")
+assert(t:clone():date"2013-08-01" == T"2013-08-01 12:34:56.123456")
+assert(t:doy() == 28 and t:yearday() == 28 and t:weekday() == 2 and not t:leap() and T"2012-06-01":leap())
+assert(t:clone():doy(60) == T"2014-03-01 12:34:56.123456")
+assert(T"2014-01-28":mjd() == 56685 and T():mjd(56546.5) == T"2013-09-11 12:00:00")
+assert(t:clone():add(60) == t + 60 and t:clone():sub"00:01:00" == t - 60)
+assert(T"1969-06-11 16:12:43.000001":vms() == 0x7BF5A162B54F8ALL)
+assert(tostring(T():vms(0x7BF5A162B54F8ALL)) == "1969-06-11 16:12:43.000001")
+assert(T():vms"0xAE4C7CE0776CD9":vms"*x" == "00AE4C7CE0776CD9")
+assert(T():vms"0xAE4C7CE0776CD9":vms"*h" == "0xAE4C7CE0776CD9")
+assert(T():vms"0xAE4C7CE0776CD9":vms"*b" == "\0\xAE\x4C\x7C\xE0\x77\x6C\xD9")
+local sec, usec = t:unix()
+assert(sec == 1390912496 and usec == 123456 and T():unix(1390912496, 123456) == t)
+assert(T(1390912496) == T"2014-01-28 12:34:56" and T{year = 2014, month = 1, day = 28} == T"2014-01-28")
+assert(ltime.mktime(2014, 1, 28, 12, 34, 56, 123456) == t)
+assert(not pcall(T, "garbage") and not pcall(ltime.mktime, 1800))
+
+print "\nTime format"
+
+assert(t:format"%F %T.%." == "2014-01-28 12:34:56.123456")
+assert(t:format"%a %A %b %B %j %p %s" == "Tue Tuesday Jan January 028 PM 1390912496")
+assert(t:format(ltime.Format"%F %T") == "2014-01-28 12:34:56" and tostring(ltime.Format"%F") == "%F")
+assert(T"1994-11-06 08:49:37":http_date() == "Sun, 06 Nov 1994 08:49:37 GMT")
+local y10k = T"9999-12-31 23:59:59" + E(1)
+assert(not pcall(y10k.http_date, y10k))
+assert(t:rfc3339() == "2014-01-28T12:34:56Z" and t:rfc3339(3) == "2014-01-28T12:34:56.123Z")
+assert(ltime.parse_http_date"Sun Nov  6 08:49:37 1994" == T"1994-11-06 08:49:37")
+assert(ltime.parse_rfc3339"2014-01-28T13:34:56.123456+01:00" == t and ltime.parse_rfc3339"x" == nil)
+
+print "\nEpoch"
+
+local d = E"01:00:00"
+assert(tostring(d) == "01:00:00" and tostring(-d) == "-01:00:00")
+assert(d + 3600 == E"02:00:00" and d - "00:30:00" == E"00:30:00")
+assert(d * 2 == 7200 and 2 * d == E"02:00:00" and d / 4 == E"00:15:00")
+assert(d % 1000 == 600 and d % E"00:07:00" == E"00:04:00")
+assert(ltime.isTime(d + now) and d + now == now + d)
+assert(d:seconds() == 3600 and d:tonumber() == 3600 and d:mseconds() == 3600000 and d:hours() == 1 and d:days() == 1 / 24)
+assert((E(123) > 120) == true and (E(120) > 123) == false)
+assert((E(999) >= 999) == true and (E(999) <= 999) == true)
+assert((E(999) == 999) == false)	-- not of the same type!
+assert(not pcall(function() return 5 / d end) and not pcall(function() return d / 0 end))
+
+local d = E"1 02:03:04.005006"
+assert(tostring(d) == "1 02:03:04.005006")
+assert(d:format"%d %T.%." == "1 02:03:04.005006")
+assert(E"01:02:00":format"%hh%Mm" == "1h02m")
+assert(E(1.5):format"%l ms" == "1500 ms")
+assert(E(-1.25):format"%i" == "-PT1.25S")
+local f = ltime.EpochFormat"%h:%M:%S.%q"
+assert(tostring(f) == "%h:%M:%S.%q" and E"1 02:03:04.005":format(f) == "26:03:04.005")
+assert(not pcall(d.format, d, ltime.Format"%F"))
+
+print "\nISO 8601 durations"
+
+assert(E"PT3H4M" == E"03:04:00")
+assert(E"P1DT2H3M4.005006S" == d)
+assert(E"-PT1.5S" == E(-1.5))
+assert(E"PT0.0000001S" * 1e7 == 1)
+assert(not pcall(E, "P1Y") and not pcall(E, "P"))
+assert((T"2014-01-01" + "PT36H") == T"2014-01-02 12:00:00")
+
+print("\n"..ltime.VERSION.." OK")
@@ -0,0 +1,353 @@
+#include "ltime.h"
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Create a new packed tick array of n values, storage follows the header
+ * - raise an error if the size of n values overflows
+ * - leave the new object on top of the stack
+ * - return pointer to the ticks object
+ */
+t_ticks *newTicks(lua_State *L, size_t n) {
+	if (n > ((size_t)-1 - sizeof(t_ticks)) / sizeof(long long))
+		luaL_error(L, LTIME_ERR_TICKS_INDEX);
+	t_ticks *self = (t_ticks *)lua_newuserdata(L, sizeof(t_ticks) + n * sizeof(long long));
+	self->t = (long long *)(self + 1);
+	self->n = n;
+	self->map = NULL;
+	self->map_length = 0;
+	self->swap = 0;
+	luaL_setmetatable(L, LTIME_MT_TICKS);
+	return self;
+}
+
+/*
+ *  Array element at index to VMS timestamp
+ *  Integers are raw VMS ticks (as returned by Time:vms()), anything else
+ *  is handled like a Time constructor parameter
+ */
+long long elementToVMS(lua_State *L, int index) {
+	if (lua_isinteger(L, index))
+		return lua_tointeger(L, index);
+	if (lua_isnoneornil(L, index))
+		luaL_error(L, LTIME_ERR_DATETIME_CONSTRUCTOR);
+	return parameterToVMS(L, index);
+}
+
+/*
+ *  Lua parameter at index to packed ticks
+ *  A Ticks object is returned as is, a table is converted into a new
+ *  Ticks object left on top of the stack
+ */
+t_ticks *toTicks(lua_State *L, int index) {
+	t_ticks *self = (t_ticks *)luaL_testudata(L, index, LTIME_MT_TICKS);
+	if (self)
+		return self;
+	luaL_checktype(L, index, LUA_TTABLE);
+	index = lua_absindex(L, index);
+	size_t n = lua_rawlen(L, index);
+	self = newTicks(L, n);
+	for (size_t i = 0; i < n; i++) {
+		lua_rawgeti(L, index, i + 1);
+		self->t[i] = elementToVMS(L, -1);
+		lua_pop(L, 1);
+	}
+	return self;
+}
+
+/*
+ *  Ticks = Ltime.Ticks(n)
+ *  Ticks = Ltime.Ticks(table)
+ *  Ticks = Ltime.Ticks(Ticks)
+ */
+int ticks_new(lua_State *L) {
+	if (lua_type(L, 1) == LUA_TNUMBER) {
+		lua_Integer n = luaL_checkinteger(L, 1);
+		if (n < 0)
+			luaL_error(L, LTIME_ERR_TICKS_INDEX);
+		t_ticks *self = newTicks(L, n);
+		memset(self->t, 0, n * sizeof(long long));
+		return 1;
+	}
+	t_ticks *other = (t_ticks *)luaL_testudata(L, 1, LTIME_MT_TICKS);
+	if (other) {
+		t_ticks *self = newTicks(L, other->n);
+		for (size_t i = 0; i < other->n; i++)
+			self->t[i] = ticksAt(other, i);
+	} else {
+		toTicks(L, 1);
+	}
+	return 1;
+}
+
+/*
+ *  Get the Time at index, into dest if given
+ *  Time = Ticks:time(i[, dest])
+ */
+static int ticks_time(lua_State *L) {
+
+	t_ticks *self = (t_ticks *)luaL_checkudata(L, 1, LTIME_MT_TICKS);
+	lua_Integer i = luaL_checkinteger(L, 2);
+	if (i < 1 || (size_t)i > self->n)
+		luaL_error(L, LTIME_ERR_TICKS_INDEX);
+	t_datetime *result = destDatetime(L, 3);
+	result->t = ticksAt(self, i - 1);
+	return 1;
+}
+
+/*
+ *  Return the raw ticks as a Lua table of integers
+ *  table = Ticks:totable()
+ */
+static int ticks_totable(lua_State *L) {
+
+	t_ticks *self = (t_ticks *)luaL_checkudata(L, 1, LTIME_MT_TICKS);
+	lua_createtable(L, self->n, 0);
+	for (size_t i = 0; i < self->n; i++) {
+		lua_pushinteger(L, ticksAt(self, i));
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
+/*
+ *  Ticks:__len()
+ */
+static int ticks_len(lua_State *L) {
+
+	t_ticks *self = (t_ticks *)luaL_checkudata(L, 1, LTIME_MT_TICKS);
+	lua_pushinteger(L, self->n);
+	return 1;
+}
+
+/*
+ *  Ticks.__index(self, key)
+ *  Integer keys return the raw ticks, other keys are method lookups
+ */
+static int ticks_index(lua_State *L) {
+
+	t_ticks *self = (t_ticks *)luaL_checkudata(L, 1, LTIME_MT_TICKS);
+	if (lua_isinteger(L, 2)) {
+		lua_Integer i = lua_tointeger(L, 2);
+		if (i >= 1 && (size_t)i <= self->n)
+			lua_pushinteger(L, ticksAt(self, i - 1));
+		else
+			lua_pushnil(L);
+		return 1;
+	}
+	lua_pushvalue(L, 2);
+	lua_rawget(L, lua_upvalueindex(1));
+	return 1;
+}
+
+/*
+ *  Ticks.__newindex(self, i, value)
+ *  value can be a raw tick integer or anything accepted by Ltime.Time
+ */
+static int ticks_newindex(lua_State *L) {
+
+	t_ticks *self = (t_ticks *)luaL_checkudata(L, 1, LTIME_MT_TICKS);
+	lua_Integer i = luaL_checkinteger(L, 2);
+	if (self->map)
+		luaL_error(L, LTIME_ERR_TICKS_READONLY);
+	if (i < 1 || (size_t)i > self->n)
+		luaL_error(L, LTIME_ERR_TICKS_INDEX);
+	self->t[i - 1] = elementToVMS(L, 3);
+	return 0;
+}
+
+/*
+ *  Smallest value as a Time, nil when empty
+ *  Time = Ticks:min()
+ */
+static int ticks_min(lua_State *L) {
+
+	t_ticks *self = (t_ticks *)luaL_checkudata(L, 1, LTIME_MT_TICKS);
+	if (self->n == 0)
+		return 0;
+	long long min = ticksAt(self, 0);
+	for (size_t i = 1; i < self->n; i++) {
+		long long t = ticksAt(self, i);
+		min = t < min ? t : min;
+	}
+	newDatetime(L)->t = min;
+	return 1;
+}
+
+/*
+ *  Largest value as a Time, nil when empty
+ *  Time = Ticks:max()
+ */
+static int ticks_max(lua_State *L) {
+
+	t_ticks *self = (t_ticks *)luaL_checkudata(L, 1, LTIME_MT_TICKS);
+	if (self->n == 0)
+		return 0;
+	long long max = ticksAt(self, 0);
+	for (size_t i = 1; i < self->n; i++) {
+		long long t = ticksAt(self, i);
+		max = t > max ? t : max;
+	}
+	newDatetime(L)->t = max;
+	return 1;
+}
+
+/*
+ *  Binary search in sorted ticks
+ *  Return the index of the first value >= t, #Ticks + 1 if there is none
+ *  i = Ticks:search(t)
+ */
+static int ticks_search(lua_State *L) {
+
+	t_ticks *self = (t_ticks *)luaL_checkudata(L, 1, LTIME_MT_TICKS);
+	long long t = elementToVMS(L, 2);
+	size_t low = 0, high = self->n;
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		if (ticksAt(self, middle) < t)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	lua_pushinteger(L, low + 1);
+	return 1;
+}
+
+/*
+ *  Count the values in count consecutive buckets of width starting at origin
+ *  Values outside of the buckets are ignored
+ *  table = Ticks:buckets(origin, width, count)
+ */
+static int ticks_buckets(lua_State *L) {
+
+	t_ticks *self = (t_ticks *)luaL_checkudata(L, 1, LTIME_MT_TICKS);
+	long long origin = elementToVMS(L, 2);
+	long long width = parameterToTicks(L, 3);
+	lua_Integer count = luaL_checkinteger(L, 4);
+	if (width <= 0)
+		luaL_error(L, LTIME_ERR_TICKS_BUCKETS);
+	// the counts become a Lua table, which holds at most INT_MAX entries
+	if (count < 0 || count > INT_MAX)
+		luaL_error(L, LTIME_ERR_TICKS_BUCKET_COUNT);
+	lua_Integer *counts = (lua_Integer *)lua_newuserdata(L, count * sizeof(lua_Integer) + 1);
+	memset(counts, 0, count * sizeof(lua_Integer));
+	for (size_t i = 0; i < self->n; i++) {
+		long long t = ticksAt(self, i);
+		// raw values may span the whole range, the difference only fits unsigned
+		unsigned long long bucket = ((unsigned long long)t - (unsigned long long)origin) / (unsigned long long)width;
+		if (t >= origin && bucket < (unsigned long long)count)
+			counts[bucket]++;
+	}
+	lua_createtable(L, count, 0);
+	for (lua_Integer k = 0; k < count; k++) {
+		lua_pushinteger(L, counts[k]);
+		lua_rawseti(L, -2, k + 1);
+	}
+	return 1;
+}
+
+/*
+ *  Ticks:__gc()
+ *  Unmap file views
+ */
+static int ticks_gc(lua_State *L) {
+
+	t_ticks *self = (t_ticks *)luaL_checkudata(L, 1, LTIME_MT_TICKS);
+	if (self->map) {
+		munmap(self->map, self->map_length);
+		self->map = NULL;
+		self->n = 0;
+	}
+	return 0;
+}
+
+/*
+ *  Ticks = Ltime.mmap_ticks(path[, endianness])
+ *  Read-only view over a file of 8 byte VMS timestamps, as written by
+ *  Time:vms("*b"). endianness is "big" (default) or "little".
+ *  Return nil, message, errno when the file cannot be mapped
+ */
+int ticks_mmap(lua_State *L) {
+
+	const char *path = luaL_checkstring(L, 1);
+	const char *endianness = luaL_optstring(L, 2, "big");
+	int big;
+	if (!strcmp(endianness, "big"))
+		big = 1;
+	else if (!strcmp(endianness, "little"))
+		big = 0;
+	else
+		return luaL_error(L, LTIME_ERR_TICKS_ENDIANNESS);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return luaL_fileresult(L, 0, path);
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int error = errno;
+		close(fd);
+		errno = error;
+		return luaL_fileresult(L, 0, path);
+	}
+	if (st.st_size % sizeof(long long)) {
+		close(fd);
+		return luaL_error(L, LTIME_ERR_TICKS_FILE_SIZE);
+	}
+	t_ticks *self = newTicks(L, 0);
+	if (st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED) {
+			int error = errno;
+			close(fd);
+			errno = error;
+			return luaL_fileresult(L, 0, path);
+		}
+		self->map = map;
+		self->map_length = st.st_size;
+		self->t = (long long *)map;
+		self->n = st.st_size / sizeof(long long);
+	}
+	close(fd);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	self->swap = !big;
+#else
+	self->swap = big;
+#endif
+	return 1;
+}
+
+int open_ticks(lua_State *L) {
+
+	static const luaL_Reg ticks_methods[] = {
+		{"time", ticks_time},
+		{"totable", ticks_totable},
+		{"len", ticks_len},
+		{"min", ticks_min},
+		{"max", ticks_max},
+		{"search", ticks_search},
+		{"buckets", ticks_buckets},
+		{NULL, NULL}
+	};
+
+	static const luaL_Reg ticks_meta_methods[] = {
+		{"__len", ticks_len},
+		{"__newindex", ticks_newindex},
+		{"__gc", ticks_gc},
+		{NULL, NULL}
+	};
+
+	// create the metatable first
+	luaL_newmetatable(L, LTIME_MT_TICKS);
+	// and set all metamethods except __index
+	luaL_setfuncs(L, ticks_meta_methods, 0);
+
+	// __index dispatches integer keys, methods are its upvalue
+	luaL_newlib(L, ticks_methods);
+	lua_pushcclosure(L, ticks_index, 1);
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}
@@ -0,0 +1,241 @@
+#include "ltime.h"
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+/*
+ *  Deadline timers for event loops (Linux timerfd)
+ *
+ *  A Time deadline arms a CLOCK_REALTIME timer at that absolute time, an
+ *  Epoch delay arms a CLOCK_MONOTONIC timer relative to now, both at full
+ *  tick precision. The descriptor becomes readable when the timer expires,
+ *  for epoll/poll based loops; it is non-blocking and closed on exec.
+ */
+
+typedef struct s_timerfd {
+	int fd;			/* -1 once closed */
+	int realtime;	/* clock of the timer */
+} t_timerfd;
+
+#define isTimerFd(L, i) ((t_timerfd *)luaL_checkudata(L, i, LTIME_MT_TIMERFD))
+
+#ifdef __linux__
+
+/*
+ *  Ticks to timespec, never zero which would disarm the timer
+ */
+static void ticksToTimespec(long long t, struct timespec *ts) {
+
+	if (t <= 0) {
+		ts->tv_sec = 0;
+		ts->tv_nsec = 1;
+		return;
+	}
+	ts->tv_sec = t / 10000000LL;
+	ts->tv_nsec = t % 10000000LL * 100;
+}
+
+/*
+ *  Arm the timer with the deadline at index and the optional interval above it
+ *  A Time is absolute, anything else is an Epoch from now
+ */
+static int armTimer(lua_State *L, t_timerfd *self, int index) {
+
+	struct itimerspec spec;
+	int flags = 0;
+	t_datetime *deadline = (t_datetime *)luaL_testudata(L, index, LTIME_MT_DATETIME);
+	if (deadline && self->realtime) {
+		ticksToTimespec(deadline->t - VMS_1970, &spec.it_value);
+		flags = TFD_TIMER_ABSTIME;
+	} else if (deadline) {
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		ticksToTimespec(deadline->t - VMS_1970 - 10000000LL * (long long)now.tv_sec - now.tv_nsec / 100, &spec.it_value);
+	} else {
+		ticksToTimespec(parameterToTicks(L, index), &spec.it_value);
+	}
+	if (lua_isnoneornil(L, index + 1)) {
+		spec.it_interval.tv_sec = 0;
+		spec.it_interval.tv_nsec = 0;
+	} else {
+		long long interval = parameterToTicks(L, index + 1);
+		luaL_argcheck(L, interval > 0, index + 1, LTIME_ERR_TIMERFD_INTERVAL);
+		ticksToTimespec(interval, &spec.it_interval);
+	}
+	return timerfd_settime(self->fd, flags, &spec, NULL) == 0;
+}
+
+/*
+ *  TimerFd = Ltime.timerfd(deadline[, interval])
+ *  deadline is a Time (CLOCK_REALTIME, absolute) or anything accepted by
+ *  Ltime.Epoch (CLOCK_MONOTONIC, from now), interval an optional period
+ *  Return nil, message on failure
+ */
+int timerfd_new(lua_State *L) {
+
+	luaL_checkany(L, 1);
+	lua_settop(L, 2);
+	int realtime = luaL_testudata(L, 1, LTIME_MT_DATETIME) != NULL;
+	t_timerfd *self = (t_timerfd *)lua_newuserdata(L, sizeof(t_timerfd));
+	self->fd = -1;
+	self->realtime = realtime;
+	luaL_setmetatable(L, LTIME_MT_TIMERFD);
+	self->fd = timerfd_create(realtime ? CLOCK_REALTIME : CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (self->fd < 0 || !armTimer(L, self, 1))
+		return luaL_fileresult(L, 0, NULL);
+	return 1;
+}
+
+/*
+ *  Arm again, replacing the current deadline and interval
+ *  TimerFd = TimerFd:rearm(deadline[, interval])
+ */
+static int timerfd_rearm(lua_State *L) {
+
+	t_timerfd *self = isTimerFd(L, 1);
+	luaL_checkany(L, 2);
+	if (self->fd < 0)
+		return luaL_error(L, LTIME_ERR_TIMERFD_CLOSED);
+	if (!armTimer(L, self, 2))
+		return luaL_fileresult(L, 0, NULL);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/*
+ *  Stop the timer without closing it
+ *  TimerFd = TimerFd:disarm()
+ */
+static int timerfd_disarm(lua_State *L) {
+
+	t_timerfd *self = isTimerFd(L, 1);
+	if (self->fd < 0)
+		return luaL_error(L, LTIME_ERR_TIMERFD_CLOSED);
+	struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+	if (timerfd_settime(self->fd, 0, &spec, NULL) != 0)
+		return luaL_fileresult(L, 0, NULL);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/*
+ *  Number of expirations since the last read, 0 if none (never blocks)
+ *  n = TimerFd:read_expirations()
+ */
+static int timerfd_read_expirations(lua_State *L) {
+
+	t_timerfd *self = isTimerFd(L, 1);
+	if (self->fd < 0)
+		return luaL_error(L, LTIME_ERR_TIMERFD_CLOSED);
+	unsigned long long expirations;
+	if (read(self->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+		if (errno != EAGAIN)
+			return luaL_fileresult(L, 0, NULL);
+		expirations = 0;
+	}
+	lua_pushinteger(L, expirations);
+	return 1;
+}
+
+/*
+ *  Time left before the next expiration, nil when disarmed
+ *  Epoch = TimerFd:remaining()
+ */
+static int timerfd_remaining(lua_State *L) {
+
+	t_timerfd *self = isTimerFd(L, 1);
+	if (self->fd < 0)
+		return luaL_error(L, LTIME_ERR_TIMERFD_CLOSED);
+	struct itimerspec spec;
+	if (timerfd_gettime(self->fd, &spec) != 0)
+		return luaL_fileresult(L, 0, NULL);
+	if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+		return 0;
+	newEpoch(L)->t = 10000000LL * (long long)spec.it_value.tv_sec + spec.it_value.tv_nsec / 100;
+	return 1;
+}
+
+#else
+
+int timerfd_new(lua_State *L) {
+
+	return luaL_error(L, LTIME_ERR_TIMERFD_UNSUPPORTED);
+}
+
+static int timerfd_rearm(lua_State *L) {
+
+	return luaL_error(L, LTIME_ERR_TIMERFD_UNSUPPORTED);
+}
+
+static int timerfd_disarm(lua_State *L) {
+
+	return luaL_error(L, LTIME_ERR_TIMERFD_UNSUPPORTED);
+}
+
+static int timerfd_read_expirations(lua_State *L) {
+
+	return luaL_error(L, LTIME_ERR_TIMERFD_UNSUPPORTED);
+}
+
+static int timerfd_remaining(lua_State *L) {
+
+	return luaL_error(L, LTIME_ERR_TIMERFD_UNSUPPORTED);
+}
+
+#endif
+
+/*
+ *  The descriptor, to register in the event loop
+ *  fd = TimerFd:fd()
+ */
+static int timerfd_fd(lua_State *L) {
+
+	t_timerfd *self = isTimerFd(L, 1);
+	lua_pushinteger(L, self->fd);
+	return 1;
+}
+
+/*
+ *  TimerFd:close(), also TimerFd:__gc()
+ */
+static int timerfd_close(lua_State *L) {
+
+	t_timerfd *self = isTimerFd(L, 1);
+	if (self->fd >= 0) {
+		close(self->fd);
+		self->fd = -1;
+	}
+	return 0;
+}
+
+int open_timerfd(lua_State *L) {
+
+	static const luaL_Reg timerfd_methods[] = {
+		{"fd", timerfd_fd},
+		{"rearm", timerfd_rearm},
+		{"disarm", timerfd_disarm},
+		{"read_expirations", timerfd_read_expirations},
+		{"remaining", timerfd_remaining},
+		{"close", timerfd_close},
+		{NULL, NULL}
+	};
+
+	static const luaL_Reg timerfd_meta_methods[] = {
+		{"__gc", timerfd_close},
+		{NULL, NULL}
+	};
+
+	// create the metatable first
+	luaL_newmetatable(L, LTIME_MT_TIMERFD);
+	// and set all metamethods except __index
+	luaL_setfuncs(L, timerfd_meta_methods, 0);
+
+	// create the library table
+	luaL_newlib(L, timerfd_methods);
+	// and set the __index metamethod
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}
@@ -0,0 +1,376 @@
+#include "ltime.h"
+
+/*
+ *  Hierarchical timer wheel
+ *
+ *  Deadlines are rounded up to wheel ticks (deadline / resolution). Level L has
+ *  LTIME_WHEEL_SLOTS slots indexed by bits [8L, 8L + 8[ of the tick. A timer
+ *  lives in the level of the highest bit where its tick differs from the
+ *  current tick; when the current tick reaches the start of a higher level
+ *  slot, that slot is cascaded down. Ticks too far ahead for the wheel wait
+ *  in an overflow list, deadlines already passed in a due list.
+ *
+ *  Timers are kept in a C array with a free list and doubly linked slot
+ *  lists, so schedule() and cancel() are O(1). The Lua values attached to
+ *  the timers live in the uservalue table, keyed by timer index.
+ */
+
+#define LIST_OVERFLOW	(LTIME_WHEEL_LEVELS * LTIME_WHEEL_SLOTS)
+#define LIST_DUE		(LIST_OVERFLOW + 1)
+#define LIST_COUNT		(LIST_DUE + 1)
+
+typedef struct s_timer {
+	long long	deadline;	/* VMS timestamp */
+	long long	tick;		/* deadline in wheel ticks */
+	long long	seq;		/* scheduling order, breaks deadline ties */
+	int			next;		/* list links, -1 terminated */
+	int			prev;
+	int			list;		/* owning list, -1 when the timer is free */
+	unsigned	generation;	/* bumped on release, invalidates old handles */
+} t_timer;
+
+typedef struct s_expired {
+	long long	deadline;
+	long long	seq;
+	int			index;
+} t_expired;
+
+typedef struct s_timerwheel {
+	long long	resolution;		/* wheel tick in 100ns ticks */
+	long long	current;		/* last processed wheel tick */
+	long long	seq;
+	int			count;			/* scheduled timers */
+	int			level_count[LTIME_WHEEL_LEVELS];
+	int			heads[LIST_COUNT];
+	t_timer		*timers;
+	int			capacity;
+	int			free;			/* free list head, linked through next */
+	t_expired	*expired;		/* scratch list filled by advance() */
+	int			expired_count;
+	int			expired_capacity;
+} t_timerwheel;
+
+#define isTimerWheel(L, i) ((t_timerwheel *)luaL_checkudata(L, i, LTIME_MT_TIMERWHEEL))
+
+/*
+ *  Append timer i to list
+ */
+static void listAppend(t_timerwheel *self, int list, int i) {
+
+	t_timer *timer = &self->timers[i];
+	timer->list = list;
+	timer->prev = -1;
+	timer->next = self->heads[list];
+	if (timer->next >= 0)
+		self->timers[timer->next].prev = i;
+	self->heads[list] = i;
+	if (list < LIST_OVERFLOW)
+		self->level_count[list / LTIME_WHEEL_SLOTS]++;
+}
+
+/*
+ *  Remove timer i from its list
+ */
+static void listRemove(t_timerwheel *self, int i) {
+
+	t_timer *timer = &self->timers[i];
+	if (timer->prev >= 0)
+		self->timers[timer->prev].next = timer->next;
+	else
+		self->heads[timer->list] = timer->next;
+	if (timer->next >= 0)
+		self->timers[timer->next].prev = timer->prev;
+	if (timer->list < LIST_OVERFLOW)
+		self->level_count[timer->list / LTIME_WHEEL_SLOTS]--;
+	timer->list = -1;
+}
+
+/*
+ *  Put timer i in the list matching its tick, relative to the current tick
+ */
+static void place(t_timerwheel *self, int i) {
+
+	long long tick = self->timers[i].tick;
+	if (tick <= self->current) {
+		listAppend(self, LIST_DUE, i);
+		return;
+	}
+	unsigned long long diff = (unsigned long long)(tick ^ self->current);
+	int level = (63 - __builtin_clzll(diff)) / LTIME_WHEEL_BITS;
+	if (level >= LTIME_WHEEL_LEVELS) {
+		listAppend(self, LIST_OVERFLOW, i);
+		return;
+	}
+	int slot = (tick >> (level * LTIME_WHEEL_BITS)) & (LTIME_WHEEL_SLOTS - 1);
+	listAppend(self, level * LTIME_WHEEL_SLOTS + slot, i);
+}
+
+/*
+ *  Move all the timers of a list to the lists matching their tick
+ */
+static void cascade(t_timerwheel *self, int list) {
+
+	int i = self->heads[list];
+	while (i >= 0) {
+		int next = self->timers[i].next;
+		listRemove(self, i);
+		place(self, i);
+		i = next;
+	}
+}
+
+/*
+ *  Move all the timers of a list to the expired scratch list
+ *  Return 0 when out of memory
+ */
+static int expire(t_timerwheel *self, int list) {
+
+	while (self->heads[list] >= 0) {
+		int i = self->heads[list];
+		if (self->expired_count == self->expired_capacity) {
+			int capacity = self->expired_capacity ? self->expired_capacity * 2 : 64;
+			t_expired *expired = realloc(self->expired, capacity * sizeof(t_expired));
+			if (!expired)
+				return 0;
+			self->expired = expired;
+			self->expired_capacity = capacity;
+		}
+		listRemove(self, i);
+		t_expired *e = &self->expired[self->expired_count++];
+		e->deadline = self->timers[i].deadline;
+		e->seq = self->timers[i].seq;
+		e->index = i;
+	}
+	return 1;
+}
+
+/*
+ *  Process all the wheel ticks up to target, collecting expired timers
+ *  Empty levels are skipped in one step
+ *  Return 0 when out of memory
+ */
+static int advanceTo(t_timerwheel *self, long long target) {
+
+	if (!expire(self, LIST_DUE))
+		return 0;
+	while (self->current < target) {
+		if (self->count == self->expired_count) {	// nothing left in the wheel
+			self->current = target;
+			break;
+		}
+		int level = 0;
+		while (level < LTIME_WHEEL_LEVELS && self->level_count[level] == 0)
+			level++;
+		if (level > 0) {
+			// nothing can fire before the next slot boundary of that level
+			long long span = 1LL << (level * LTIME_WHEEL_BITS);
+			long long boundary = (self->current | (span - 1)) + 1;
+			if (boundary > target) {
+				self->current = target;
+				break;
+			}
+			self->current = boundary - 1;
+		}
+		long long tick = ++self->current;
+		if ((tick & ((1LL << (LTIME_WHEEL_LEVELS * LTIME_WHEEL_BITS)) - 1)) == 0)
+			cascade(self, LIST_OVERFLOW);
+		for (int l = LTIME_WHEEL_LEVELS - 1; l > 0; l--) {
+			if ((tick & ((1LL << (l * LTIME_WHEEL_BITS)) - 1)) == 0)
+				cascade(self, l * LTIME_WHEEL_SLOTS + ((tick >> (l * LTIME_WHEEL_BITS)) & (LTIME_WHEEL_SLOTS - 1)));
+		}
+		if (!expire(self, tick & (LTIME_WHEEL_SLOTS - 1)) || !expire(self, LIST_DUE))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ *  qsort comparator: deadline order, then scheduling order
+ */
+static int compareExpired(const void *a, const void *b) {
+
+	const t_expired *x = (const t_expired *)a, *y = (const t_expired *)b;
+	if (x->deadline != y->deadline)
+		return x->deadline < y->deadline ? -1 : 1;
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/*
+ *  TimerWheel = Ltime.TimerWheel(resolution[, start])
+ *  resolution: the wheel tick, anything accepted by Ltime.Epoch
+ *  start: Time of the first wheel tick (default now)
+ */
+int timerwheel_new(lua_State *L) {
+
+	long long resolution = parameterToTicks(L, 1);
+	if (resolution <= 0)
+		luaL_error(L, LTIME_ERR_TIMERWHEEL_RESOLUTION);
+	long long start = timeArgument(L, 2);
+	t_timerwheel *self = (t_timerwheel *)lua_newuserdata(L, sizeof(t_timerwheel));
+	memset(self, 0, sizeof(t_timerwheel));
+	self->resolution = resolution;
+	self->current = start / resolution;
+	self->free = -1;
+	for (int i = 0; i < LIST_COUNT; i++)
+		self->heads[i] = -1;
+	luaL_setmetatable(L, LTIME_MT_TIMERWHEEL);
+	lua_newtable(L);
+	lua_setuservalue(L, -2);
+	return 1;
+}
+
+/*
+ *  Schedule value to expire at deadline
+ *  handle = TimerWheel:schedule(deadline, value)
+ */
+static int timerwheel_schedule(lua_State *L) {
+
+	t_timerwheel *self = isTimerWheel(L, 1);
+	long long deadline = timeArgument(L, 2);
+	luaL_checkany(L, 3);
+	if (self->free < 0) {
+		int capacity = self->capacity ? self->capacity * 2 : 64;
+		t_timer *timers = realloc(self->timers, capacity * sizeof(t_timer));
+		if (!timers)
+			luaL_error(L, LTIME_ERR_OUT_OF_MEMORY);
+		for (int i = capacity - 1; i >= self->capacity; i--) {
+			timers[i].list = -1;
+			timers[i].generation = 0;
+			timers[i].next = self->free;
+			self->free = i;
+		}
+		self->timers = timers;
+		self->capacity = capacity;
+	}
+	int i = self->free;
+	t_timer *timer = &self->timers[i];
+	self->free = timer->next;
+	timer->deadline = deadline;
+	timer->tick = (deadline + self->resolution - 1) / self->resolution;	// never fire early
+	timer->seq = self->seq++;
+	place(self, i);
+	self->count++;
+	lua_getuservalue(L, 1);
+	lua_pushvalue(L, 3);
+	lua_rawseti(L, -2, i + 1);
+	lua_pushinteger(L, (lua_Integer)(((unsigned long long)timer->generation << 32) | (i + 1)));
+	return 1;
+}
+
+/*
+ *  Release timer i and its value (value table at the top of the stack)
+ */
+static void release(lua_State *L, t_timerwheel *self, int i) {
+
+	t_timer *timer = &self->timers[i];
+	timer->generation++;
+	timer->list = -1;
+	timer->next = self->free;
+	self->free = i;
+	self->count--;
+	lua_pushnil(L);
+	lua_rawseti(L, -2, i + 1);
+}
+
+/*
+ *  Cancel a scheduled timer
+ *  Return false if the handle already expired or was canceled
+ *  boolean = TimerWheel:cancel(handle)
+ */
+static int timerwheel_cancel(lua_State *L) {
+
+	t_timerwheel *self = isTimerWheel(L, 1);
+	long long handle = luaL_checkinteger(L, 2);
+	long long i = (handle & 0xFFFFFFFFLL) - 1;
+	if (i < 0 || i >= self->capacity || self->timers[i].list < 0
+		|| self->timers[i].generation != (unsigned)((unsigned long long)handle >> 32)) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	listRemove(self, i);
+	lua_getuservalue(L, 1);
+	release(L, self, i);
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/*
+ *  Move the wheel forward to now (default current time)
+ *  Return the values of the expired timers in deadline order
+ *  table = TimerWheel:advance([now])
+ */
+static int timerwheel_advance(lua_State *L) {
+
+	t_timerwheel *self = isTimerWheel(L, 1);
+	long long now = timeArgument(L, 2);
+	self->expired_count = 0;
+	if (!advanceTo(self, now / self->resolution))
+		luaL_error(L, LTIME_ERR_OUT_OF_MEMORY);
+	qsort(self->expired, self->expired_count, sizeof(t_expired), compareExpired);
+	lua_getuservalue(L, 1);
+	lua_createtable(L, self->expired_count, 0);
+	for (int k = 0; k < self->expired_count; k++) {
+		int i = self->expired[k].index;
+		lua_rawgeti(L, -2, i + 1);
+		lua_rawseti(L, -2, k + 1);
+		lua_pushvalue(L, -2);
+		release(L, self, i);
+		lua_pop(L, 1);
+	}
+	self->expired_count = 0;
+	return 1;
+}
+
+/*
+ *  Number of scheduled timers
+ *  count = TimerWheel:count()
+ */
+static int timerwheel_count(lua_State *L) {
+
+	t_timerwheel *self = isTimerWheel(L, 1);
+	lua_pushinteger(L, self->count);
+	return 1;
+}
+
+/*
+ *  TimerWheel:__gc()
+ */
+static int timerwheel_gc(lua_State *L) {
+
+	t_timerwheel *self = isTimerWheel(L, 1);
+	free(self->timers);
+	free(self->expired);
+	self->timers = NULL;
+	self->expired = NULL;
+	self->capacity = self->expired_capacity = 0;
+	return 0;
+}
+
+int open_timerwheel(lua_State *L) {
+
+	static const luaL_Reg timerwheel_methods[] = {
+		{"schedule", timerwheel_schedule},
+		{"cancel", timerwheel_cancel},
+		{"advance", timerwheel_advance},
+		{"count", timerwheel_count},
+		{NULL, NULL}
+	};
+
+	static const luaL_Reg timerwheel_meta_methods[] = {
+		{"__len", timerwheel_count},
+		{"__gc", timerwheel_gc},
+		{NULL, NULL}
+	};
+
+	// create the metatable first
+	luaL_newmetatable(L, LTIME_MT_TIMERWHEEL);
+	// and set all metamethods except __index
+	luaL_setfuncs(L, timerwheel_meta_methods, 0);
+
+	// create the library table
+	luaL_newlib(L, timerwheel_methods);
+	// and set the __index metamethod
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}